@@ -0,0 +1,427 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+// Compares opening and scanning a decodeless file against a conventional
+// fread() and field-by-field deserialization of the same data. Both formats
+// hold an app header per chunk of vertices, as in the README's AppHeader
+// example. Reported times are the minimum over the repeats.
+//
+// Usage: decodeless_header_baseline [--scales 1M,100M,10G] [--dir path]
+//                                   [--repeat n]
+//
+// The 10G scale is not run by default. It needs twice that much disk space
+// and, for the conventional baseline, as much memory. Cold cache runs drop
+// the file's pages with posix_fadvise() and are skipped elsewhere.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <decodeless/batched_writer.hpp>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/header.hpp>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+using namespace decodeless;
+
+namespace {
+
+struct Vertex {
+    float    position[3];
+    uint32_t color;
+};
+
+constexpr size_t ChunkVertices = (256 << 10) / sizeof(Vertex); // 256 KiB per app header
+constexpr size_t MaxNameLength = 32;
+
+struct BaselineRootHeader : RootHeader {
+    BaselineRootHeader()
+        : RootHeader("DECODELESS-BENCH") {}
+};
+
+struct AppHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"app-chunk"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    AppHeader(const Magic& identifier)
+        : Header{.identifier = identifier, .version = VersionSupported, .gitHash = ""} {}
+    offset_span<char>   name;
+    offset_span<Vertex> vertices;
+};
+
+// Conventional in-memory form, filled by deserialization
+struct AppChunk {
+    std::string         name;
+    std::vector<Vertex> vertices;
+};
+
+std::string chunkName(size_t i) {
+    char name[MaxNameLength];
+    std::snprintf(name, sizeof(name), "chunk-%08zu", i);
+    return name;
+}
+
+Magic chunkIdentifier(size_t i) {
+    return Magic(chunkName(i));
+}
+
+Vertex makeVertex(size_t i) {
+    float v = float(i % 1024);
+    return Vertex{{v, v + 1.0f, v + 2.0f}, uint32_t(i)};
+}
+
+// Touches every field so neither side can skip work
+uint64_t checksum(std::span<const Vertex> vertices) {
+    uint64_t sum = 0;
+    for (const Vertex& vertex : vertices)
+        sum += uint64_t(vertex.position[0] + vertex.position[1] + vertex.position[2]) +
+               vertex.color;
+    return sum;
+}
+
+void writeDecodeless(const std::filesystem::path& path, size_t chunks) {
+    batched_writer_options options;
+    options.scratchSize = sizeof(AppHeader) + MaxNameLength + ChunkVertices * sizeof(Vertex) + 64;
+    batched_writer<BaselineRootHeader> writer(path, chunks, options);
+    for (size_t c = 0; c < chunks; ++c) {
+        std::string name = chunkName(c);
+        auto*       header = writer.create<AppHeader>(chunkIdentifier(c));
+        header->name = detail::allocateArray<char>(writer.memory(), name.size());
+        std::ranges::copy(name, header->name.begin());
+        header->vertices = detail::allocateArray<Vertex>(writer.memory(), ChunkVertices);
+        for (size_t i = 0; i < ChunkVertices; ++i)
+            header->vertices[i] = makeVertex(c * ChunkVertices + i);
+    }
+    writer.finish();
+}
+
+// Length prefixed fields, each written individually as a hand-written
+// serializer would
+class field_writer {
+public:
+    explicit field_writer(const std::filesystem::path& path)
+        : m_file(std::fopen(path.string().c_str(), "wb")) {
+        if (!m_file)
+            throw std::runtime_error("Failed to create " + path.string());
+    }
+    ~field_writer() { std::fclose(m_file); }
+    template <class T>
+    void write(const T& value) {
+        if (std::fwrite(&value, sizeof(value), 1, m_file) != 1)
+            throw std::runtime_error("Write failed");
+    }
+
+private:
+    std::FILE* m_file;
+};
+
+void writeConventional(const std::filesystem::path& path, size_t chunks) {
+    field_writer out(path);
+    out.write(uint64_t(chunks));
+    for (size_t c = 0; c < chunks; ++c) {
+        std::string name = chunkName(c);
+        out.write(uint64_t(name.size()));
+        for (char ch : name)
+            out.write(ch);
+        out.write(uint64_t(ChunkVertices));
+        for (size_t i = 0; i < ChunkVertices; ++i) {
+            Vertex vertex = makeVertex(c * ChunkVertices + i);
+            out.write(vertex.position[0]);
+            out.write(vertex.position[1]);
+            out.write(vertex.position[2]);
+            out.write(vertex.color);
+        }
+    }
+}
+
+// fread() in large blocks and decode one field at a time
+class field_reader {
+public:
+    explicit field_reader(const std::filesystem::path& path)
+        : m_file(std::fopen(path.string().c_str(), "rb"))
+        , m_buffer(1 << 20) {
+        if (!m_file)
+            throw std::runtime_error("Failed to open " + path.string());
+    }
+    ~field_reader() { std::fclose(m_file); }
+    template <class T>
+    T read() {
+        if (m_end - m_position < sizeof(T))
+            refill();
+        T value;
+        std::memcpy(&value, m_buffer.data() + m_position, sizeof(T));
+        m_position += sizeof(T);
+        return value;
+    }
+
+private:
+    void refill() {
+        size_t remaining = m_end - m_position;
+        std::memmove(m_buffer.data(), m_buffer.data() + m_position, remaining);
+        m_end = remaining + std::fread(m_buffer.data() + remaining, 1,
+                                       m_buffer.size() - remaining, m_file);
+        m_position = 0;
+        if (m_end == remaining)
+            throw std::runtime_error("Unexpected end of file");
+    }
+
+    std::FILE*        m_file;
+    std::vector<char> m_buffer;
+    size_t            m_position = 0;
+    size_t            m_end = 0;
+};
+
+std::vector<AppChunk> deserialize(const std::filesystem::path& path) {
+    field_reader          in(path);
+    std::vector<AppChunk> result(in.read<uint64_t>());
+    for (AppChunk& chunk : result) {
+        chunk.name.resize(in.read<uint64_t>());
+        for (char& ch : chunk.name)
+            ch = in.read<char>();
+        chunk.vertices.resize(in.read<uint64_t>());
+        for (Vertex& vertex : chunk.vertices) {
+            vertex.position[0] = in.read<float>();
+            vertex.position[1] = in.read<float>();
+            vertex.position[2] = in.read<float>();
+            vertex.color = in.read<uint32_t>();
+        }
+    }
+    return result;
+}
+
+// Read only mapping of a whole file
+class mapped_view {
+public:
+    explicit mapped_view(const std::filesystem::path& path) {
+#if defined(_WIN32)
+        m_file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open " + path.string());
+        LARGE_INTEGER size;
+        ::GetFileSizeEx(m_file, &size);
+        m_mapping = ::CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* data = m_mapping ? ::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!data)
+            throw std::runtime_error("Failed to map " + path.string());
+        m_data = {static_cast<const std::byte*>(data), size_t(size.QuadPart)};
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw std::runtime_error("Failed to open " + path.string());
+        struct stat info{};
+        ::fstat(fd, &info);
+        void* data = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Failed to map " + path.string());
+        m_data = {static_cast<const std::byte*>(data), size_t(info.st_size)};
+#endif
+    }
+    mapped_view(const mapped_view&) = delete;
+    mapped_view& operator=(const mapped_view&) = delete;
+    ~mapped_view() {
+#if defined(_WIN32)
+        ::UnmapViewOfFile(m_data.data());
+        ::CloseHandle(m_mapping);
+        ::CloseHandle(m_file);
+#else
+        ::munmap(const_cast<std::byte*>(m_data.data()), m_data.size());
+#endif
+    }
+
+    const RootHeader* root() const {
+        auto* root = reinterpret_cast<const RootHeader*>(m_data.data());
+        if (m_data.size() < sizeof(RootHeader) || !root->magicValid() ||
+            !root->binaryCompatible())
+            throw std::runtime_error("Not a valid decodeless file");
+        return root;
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+    std::span<const std::byte> m_data;
+};
+
+// Evicts the file from the page cache. Returns false if unsupported.
+bool dropCache(const std::filesystem::path& path) {
+#if defined(__linux__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    bool dropped = ::fdatasync(fd) == 0 && ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return dropped;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+struct Timing {
+    double   firstAccess = std::numeric_limits<double>::max(); // seconds
+    double   total = std::numeric_limits<double>::max();       // open and full scan
+    uint32_t first = 0; // first vertex's color, read before firstAccess is taken
+    uint64_t sum = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double seconds(Clock::time_point begin, Clock::time_point end) {
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+// Opens the file and reads the first vertex of the first app header, then
+// scans every vertex
+Timing runDecodeless(const std::filesystem::path& path) {
+    Timing            timing;
+    Clock::time_point begin = Clock::now();
+    mapped_view       file(path);
+    const RootHeader* root = file.root();
+    auto*             first = static_cast<const AppHeader*>(root->find(chunkIdentifier(0)));
+    if (!first || first->vertices.empty())
+        throw std::runtime_error("Missing first app header");
+    timing.first = first->vertices[0].color;
+    timing.firstAccess = seconds(begin, Clock::now());
+    for (const offset_ptr<Header>& header : root->headers)
+        timing.sum += checksum(static_cast<const AppHeader*>(header.get())->vertices);
+    timing.total = seconds(begin, Clock::now());
+    return timing;
+}
+
+// The whole file must be deserialized before the first access
+Timing runConventional(const std::filesystem::path& path) {
+    Timing                timing;
+    Clock::time_point     begin = Clock::now();
+    std::vector<AppChunk> chunks = deserialize(path);
+    if (chunks.empty() || chunks[0].vertices.empty())
+        throw std::runtime_error("Missing first app chunk");
+    timing.first = chunks[0].vertices[0].color;
+    timing.firstAccess = seconds(begin, Clock::now());
+    for (const AppChunk& chunk : chunks)
+        timing.sum += checksum(chunk.vertices);
+    timing.total = seconds(begin, Clock::now());
+    return timing;
+}
+
+template <class Run>
+std::optional<Timing> measure(const std::filesystem::path& path, bool cold, int repeat,
+                              Run run) {
+    Timing best;
+    if (!cold)
+        run(path); // populate the page cache
+    for (int i = 0; i < repeat; ++i) {
+        if (cold && !dropCache(path))
+            return std::nullopt;
+        Timing timing = run(path);
+        best.firstAccess = std::min(best.firstAccess, timing.firstAccess);
+        best.total = std::min(best.total, timing.total);
+        best.first = timing.first;
+        best.sum = timing.sum;
+    }
+    return best;
+}
+
+uint64_t parseScale(const std::string& text) {
+    size_t   suffix = 0;
+    uint64_t value = std::stoull(text, &suffix);
+    switch (suffix < text.size() ? text[suffix] : ' ') {
+    case 'G': return value << 30;
+    case 'M': return value << 20;
+    case 'K': return value << 10;
+    default: return value;
+    }
+}
+
+void report(const char* format, const char* cache, const std::optional<Timing>& timing,
+            uint64_t bytes) {
+    if (!timing) {
+        std::printf("  %-12s %-5s %14s\n", format, cache, "unsupported");
+        return;
+    }
+    std::printf("  %-12s %-5s %12.3f ms %12.3f ms %10.2f GB/s\n", format, cache,
+                timing->firstAccess * 1e3, timing->total * 1e3,
+                double(bytes) / timing->total / 1e9);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> scales{"1M", "100M"};
+    std::filesystem::path    directory = std::filesystem::temp_directory_path();
+    int                      repeat = 3;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--scales") {
+            scales.clear();
+            for (std::string list = argv[i + 1]; !list.empty();) {
+                size_t comma = std::min(list.find(','), list.size());
+                scales.push_back(list.substr(0, comma));
+                list.erase(0, comma + 1);
+            }
+        } else if (arg == "--dir") {
+            directory = argv[i + 1];
+        } else if (arg == "--repeat") {
+            repeat = std::max(1, std::stoi(argv[i + 1]));
+        } else {
+            std::fprintf(stderr, "Unknown argument %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    try {
+        for (const std::string& scale : scales) {
+            size_t chunks = std::max<uint64_t>(
+                1, parseScale(scale) / (ChunkVertices * sizeof(Vertex)));
+            uint64_t              bytes = chunks * ChunkVertices * sizeof(Vertex);
+            std::filesystem::path decodelessPath = directory / "decodeless_baseline.bin";
+            std::filesystem::path conventionalPath = directory / "decodeless_baseline.dat";
+            writeDecodeless(decodelessPath, chunks);
+            writeConventional(conventionalPath, chunks);
+
+            std::printf("%s: %zu app headers, %.1f MiB of vertices\n", scale.c_str(), chunks,
+                        double(bytes) / (1 << 20));
+            std::printf("  %-12s %-5s %15s %15s %15s\n", "format", "cache", "first access",
+                        "open + scan", "throughput");
+            int failed = 0;
+            for (bool cold : {false, true}) {
+                const char* cache = cold ? "cold" : "warm";
+                auto        decodeless = measure(decodelessPath, cold, repeat, runDecodeless);
+                auto conventional = measure(conventionalPath, cold, repeat, runConventional);
+                report("decodeless", cache, decodeless, bytes);
+                report("fread", cache, conventional, bytes);
+                if (decodeless && conventional &&
+                    (decodeless->first != conventional->first ||
+                     decodeless->sum != conventional->sum))
+                    ++failed;
+            }
+            std::filesystem::remove(decodelessPath);
+            std::filesystem::remove(conventionalPath);
+            if (failed) {
+                std::fprintf(stderr, "Checksum mismatch between formats\n");
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/direct_writer.hpp>
+#include <decodeless/header.hpp>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+struct batched_writer_options {
+    size_t bufferSize = direct_writer::DefaultBufferSize;
+    size_t bufferCount = 4;
+    size_t scratchSize = 16 << 20; // largest sub-header and payload
+    bool   ioUring = true;         // see direct_writer
+};
+
+// Writes a file header by header straight to disk, for bakes that emit far
+// more sub-headers than fit in memory at once. Like streaming_writer, each
+// sub-header and its payload are built in turn, here in a reused scratch
+// arena that is appended to a direct_writer when the next sub-header is
+// created. Many small sub-headers are batched into each staging buffer
+// write. The root header and header list are reserved at the start as zeros
+// and written, sorted, by finish() only after all payload has been written,
+// so a failed bake never leaves a valid root header behind. Payloads must only
+// point within their own sub-header's allocations.
+template <class RootType>
+class batched_writer {
+public:
+    template <class... Args>
+    batched_writer(const std::filesystem::path& path, size_t headerCount,
+                   const batched_writer_options& options, Args&&... rootArgs)
+        : m_writer(path, options.bufferSize, options.bufferCount, options.ioUring)
+        , m_scratch(options.scratchSize) {
+        // The root header is followed by the header list, padded to whole
+        // blocks so it can be rewritten in place
+        m_listOffset = alignUp(sizeof(RootType), alignof(offset_ptr<Header>));
+        m_prefixSize = alignUp(m_listOffset + headerCount * sizeof(offset_ptr<Header>),
+                               direct_writer::BlockSize);
+        m_prefix = Buffer(static_cast<std::byte*>(
+            ::operator new(m_prefixSize, std::align_val_t(direct_writer::BlockSize))));
+        std::memset(m_prefix.get(), 0, m_prefixSize);
+        m_writer.write(std::span(m_prefix.get(), m_prefixSize));
+        m_root = new (m_prefix.get()) RootType(std::forward<Args>(rootArgs)...);
+        m_root->headers = std::span(
+            reinterpret_cast<offset_ptr<Header>*>(m_prefix.get() + m_listOffset), headerCount);
+        m_entries.reserve(headerCount);
+    }
+    batched_writer(const batched_writer&) = delete;
+    batched_writer& operator=(const batched_writer&) = delete;
+
+    // Truncates the output to zero bytes if finish() did not complete, e.g.
+    // during exception unwinding, so an incomplete bake with an unpatched
+    // header list is never mistaken for a decodeless file
+    ~batched_writer() {
+        if (m_finished)
+            return;
+        try {
+            m_writer.discard();
+        } catch (...) {
+        }
+    }
+
+    // Root header fields may be set any time before finish(). Its header
+    // list is written by finish().
+    RootType* root() { return m_root; }
+
+    // Writes the previous sub-header and creates the next one. Allocate all of
+    // its payload from memory() before creating the next one.
+    template <SubHeader HeaderType, class... Args>
+    HeaderType* create(Args&&... args) {
+        if (m_entries.size() + (m_header ? 1 : 0) == m_root->headers.size())
+            throw std::length_error("More sub-headers created than reserved");
+        flush();
+        auto* header = detail::allocateObject<HeaderType>(m_scratch, std::forward<Args>(args)...);
+        m_header = header;
+        return header;
+    }
+
+    // Allocates the current sub-header's payload
+    auto& memory() { return m_scratch; }
+
+    // Bytes written so far, including the reserved root header and list
+    uint64_t size() const { return m_writer.size(); }
+
+    // True if writes bypass the page cache
+    bool direct() const { return m_writer.direct(); }
+
+    // Writes the last sub-header, waits for all payload writes to complete and
+    // then writes the root header and sorted header list. The output is
+    // discarded if any write fails.
+    void finish() {
+        flush();
+        if (m_entries.size() != m_root->headers.size())
+            throw std::logic_error("Fewer sub-headers created than reserved");
+        std::ranges::sort(m_entries, {}, &Entry::identifier);
+        static_assert(sizeof(offset_ptr<Header>) == sizeof(int64_t));
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            uint64_t site = m_listOffset + i * sizeof(offset_ptr<Header>);
+            int64_t  value = int64_t(m_entries[i].offset) - int64_t(site);
+            std::memcpy(m_prefix.get() + site, &value, sizeof(value));
+        }
+        m_writer.finish(std::span(m_prefix.get(), m_prefixSize));
+        m_finished = true;
+    }
+
+private:
+    struct AlignedDelete {
+        void operator()(std::byte* p) const {
+            ::operator delete(p, std::align_val_t(direct_writer::BlockSize));
+        }
+    };
+    using Buffer = std::unique_ptr<std::byte[], AlignedDelete>;
+
+    // Bump allocator reset after each sub-header. Its base is block aligned
+    // so the file offset can be chosen to preserve every allocation's
+    // alignment.
+    class scratch_resource {
+    public:
+        explicit scratch_resource(size_t capacity)
+            : m_data(static_cast<std::byte*>(
+                  ::operator new(capacity, std::align_val_t(direct_writer::BlockSize))))
+            , m_capacity(capacity) {}
+
+        void* allocate(size_t bytes, size_t align) {
+            if (align > direct_writer::BlockSize)
+                throw std::bad_alloc();
+            size_t begin = alignUp(m_size, align);
+            if (begin > m_capacity || m_capacity - begin < bytes)
+                throw std::length_error("Sub-header exceeds the batched_writer scratch size");
+            m_size = begin + bytes;
+            m_alignment = std::max(m_alignment, align);
+            return m_data.get() + begin;
+        }
+        void deallocate(void*, size_t) {}
+
+        std::span<const std::byte> used() const { return {m_data.get(), m_size}; }
+        size_t                     alignment() const { return m_alignment; }
+        void                       reset() {
+            m_size = 0;
+            m_alignment = 1;
+        }
+
+    private:
+        Buffer m_data;
+        size_t m_capacity;
+        size_t m_size = 0;
+        size_t m_alignment = 1;
+    };
+
+    struct Entry {
+        Magic    identifier;
+        uint64_t offset;
+    };
+
+    static constexpr uint64_t alignUp(uint64_t value, uint64_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Appends the current sub-header at an offset matching its alignment
+    void flush() {
+        if (!m_header)
+            return;
+        static constexpr std::byte zeros[direct_writer::BlockSize]{};
+        uint64_t                   offset = alignUp(m_writer.size(), m_scratch.alignment());
+        m_writer.write(std::span(zeros, size_t(offset - m_writer.size())));
+        m_writer.write(m_scratch.used());
+        m_entries.push_back(Entry{m_header->identifier, offset});
+        m_header = nullptr;
+        m_scratch.reset();
+    }
+
+    direct_writer      m_writer;
+    scratch_resource   m_scratch;
+    Buffer             m_prefix;
+    uint64_t           m_listOffset = 0;
+    uint64_t           m_prefixSize = 0;
+    RootType*          m_root = nullptr;
+    Header*            m_header = nullptr;
+    std::vector<Entry> m_entries;
+    bool               m_finished = false;
+};
+
+} // namespace decodeless
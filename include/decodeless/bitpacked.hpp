@@ -0,0 +1,211 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/offset_span.hpp>
+#include <span>
+#include <utility>
+
+namespace decodeless {
+
+namespace detail {
+
+// Reads width bits starting at bit. May read the following word.
+inline uint64_t extractBits(const uint64_t* words, uint64_t bit, unsigned width) {
+    const uint64_t* word = words + bit / 64;
+    unsigned        shift = unsigned(bit % 64);
+    uint64_t        value = word[0] >> shift;
+    if (shift + width > 64)
+        value |= word[1] << (64 - shift);
+    return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+}
+
+// ORs width bits of value in starting at bit. The destination must be zeroed.
+inline void depositBits(uint64_t* words, uint64_t bit, unsigned width, uint64_t value) {
+    uint64_t* word = words + bit / 64;
+    unsigned  shift = unsigned(bit % 64);
+    word[0] |= value << shift;
+    if (shift + width > 64)
+        word[1] |= value >> (64 - shift);
+}
+
+// Unpacks Count values of constant width Width. The fixed width and trip count
+// let the compiler unroll the loop into straight line shifts and masks and
+// vectorize it for whatever instruction set is enabled, e.g. with -mavx2.
+template <unsigned Width, size_t Count>
+void unpackFixed(const uint64_t* words, uint64_t* out) {
+    if constexpr (Width == 0) {
+        std::fill_n(out, Count, uint64_t(0));
+    } else {
+        for (size_t i = 0; i < Count; ++i)
+            out[i] = extractBits(words, uint64_t(i) * Width, Width);
+    }
+}
+
+// unpackFixed() for a runtime width in [0, 64], dispatched through a table
+template <size_t Count>
+void unpackBits(const uint64_t* words, unsigned width, uint64_t* out) {
+    using Fn = void (*)(const uint64_t*, uint64_t*);
+    static constexpr auto table = []<unsigned... W>(std::integer_sequence<unsigned, W...>) {
+        return std::array<Fn, sizeof...(W)>{&unpackFixed<W, Count>...};
+    }(std::make_integer_sequence<unsigned, 65>());
+    assert(width <= 64);
+    table[width](words, out);
+}
+
+// Bits needed to store values up to maxValue
+inline unsigned bitWidth(uint64_t maxValue) { return unsigned(std::bit_width(maxValue)); }
+
+} // namespace detail
+
+// Per block frame of reference: the block's minimum value and, packed
+// together, its bit width and the offset of its words
+struct BitPackedBlock {
+    uint64_t reference = 0; // bits of the minimum value, sign extended
+    uint64_t packed = 0;
+
+    unsigned width() const { return unsigned(packed >> 56); }
+    uint64_t wordOffset() const { return packed & ((uint64_t(1) << 56) - 1); }
+};
+
+// Frame of reference bit-packed integer array, embeddable in a Header
+// subclass. Values are split into blocks of BlockSize, each storing its
+// minimum and the differences from it in the fewest bits that fit the block,
+// so columns of small or clustered values take a fraction of their in-memory
+// size. Supports random access, bulk unpacking and range predicates evaluated
+// on the packed differences with whole blocks skipped using their minimum and
+// width. Build with buildBitPackedArray().
+template <std::integral T>
+struct BitPackedArray {
+    static constexpr size_t BlockSize = 128;
+
+    uint64_t                    size = 0;
+    offset_span<BitPackedBlock> blocks;
+    offset_span<uint64_t>       words; // BlockSize * width / 64 per block
+
+    T operator[](uint64_t i) const {
+        assert(i < size);
+        const BitPackedBlock& block = blocks[i / BlockSize];
+        uint64_t              delta =
+            block.width() ? detail::extractBits(words.data() + block.wordOffset(),
+                                                (i % BlockSize) * block.width(), block.width())
+                          : 0;
+        return T(block.reference + delta);
+    }
+
+    // Writes out.size() values starting at index first
+    void unpack(uint64_t first, std::span<T> out) const {
+        assert(first + out.size() <= size);
+        std::array<uint64_t, BlockSize> deltas;
+        for (uint64_t i = first, end = first + out.size(); i < end;) {
+            uint64_t block = i / BlockSize;
+            uint64_t begin = i % BlockSize;
+            uint64_t count = std::min<uint64_t>(BlockSize - begin, end - i);
+            unpackDeltas(block, deltas.data());
+            uint64_t reference = blocks[block].reference;
+            T*       dst = out.data() + (i - first);
+            for (uint64_t j = 0; j < count; ++j)
+                dst[j] = T(reference + deltas[begin + j]);
+            i += count;
+        }
+    }
+
+    // Calls fn(index, value) for each value in [lo, hi]
+    template <class Fn>
+    void forEachInRange(T lo, T hi, Fn&& fn) const {
+        scanRange(lo, hi, [&](uint64_t block, const uint64_t* deltas, uint64_t count,
+                              uint64_t deltaLo, uint64_t deltaHi) {
+            uint64_t reference = blocks[block].reference;
+            for (uint64_t j = 0; j < count; ++j)
+                if (deltas[j] >= deltaLo && deltas[j] <= deltaHi)
+                    fn(block * BlockSize + j, T(reference + deltas[j]));
+        });
+    }
+
+    // Number of values in [lo, hi]
+    uint64_t countInRange(T lo, T hi) const {
+        uint64_t result = 0;
+        scanRange(lo, hi, [&](uint64_t, const uint64_t* deltas, uint64_t count, uint64_t deltaLo,
+                              uint64_t deltaHi) {
+            for (uint64_t j = 0; j < count; ++j)
+                result += deltas[j] >= deltaLo && deltas[j] <= deltaHi;
+        });
+        return result;
+    }
+
+private:
+    void unpackDeltas(uint64_t block, uint64_t* out) const {
+        const BitPackedBlock& b = blocks[block];
+        detail::unpackBits<BlockSize>(words.data() + b.wordOffset(), b.width(), out);
+    }
+
+    // Calls fn(block, deltas, count, deltaLo, deltaHi) for each block that may
+    // hold values in [lo, hi], with the bounds translated to differences from
+    // the block's reference
+    template <class Fn>
+    void scanRange(T lo, T hi, Fn&& fn) const {
+        if (lo > hi)
+            return;
+        std::array<uint64_t, BlockSize> deltas;
+        for (uint64_t block = 0; block < blocks.size(); ++block) {
+            const BitPackedBlock& b = blocks[block];
+            T                     reference = T(b.reference);
+            if (hi < reference)
+                continue;
+            uint64_t deltaLo = lo <= reference ? 0 : uint64_t(lo) - b.reference;
+            uint64_t deltaHi = uint64_t(hi) - b.reference;
+            uint64_t maxDelta = b.width() == 64 ? ~uint64_t(0) : (uint64_t(1) << b.width()) - 1;
+            if (deltaLo > maxDelta)
+                continue;
+            uint64_t count = std::min<uint64_t>(BlockSize, size - block * BlockSize);
+            unpackDeltas(block, deltas.data());
+            fn(block, deltas.data(), count, deltaLo, deltaHi);
+        }
+    }
+};
+
+// Builds a bit-packed copy of values, choosing each block's bit width from its
+// range of values
+template <std::integral T, class MemoryResource>
+void buildBitPackedArray(BitPackedArray<T>& result, MemoryResource& memory,
+                         std::span<const T> values) {
+    constexpr size_t B = BitPackedArray<T>::BlockSize;
+    size_t           blockCount = (values.size() + B - 1) / B;
+    std::span<BitPackedBlock> blocks = detail::allocateArray<BitPackedBlock>(memory, blockCount);
+
+    // Every block is stored with all B slots so bulk unpacking can always
+    // read whole blocks
+    uint64_t totalWords = 0;
+    for (size_t block = 0; block < blockCount; ++block) {
+        std::span<const T> v = values.subspan(block * B, std::min(B, values.size() - block * B));
+        auto [min, max] = std::ranges::minmax(v);
+        unsigned width = detail::bitWidth(uint64_t(max) - uint64_t(min));
+        blocks[block].reference = uint64_t(min);
+        blocks[block].packed = (uint64_t(width) << 56) | totalWords;
+        totalWords += B * width / 64;
+    }
+
+    std::span<uint64_t> words = detail::allocateArray<uint64_t>(memory, totalWords);
+    for (size_t block = 0; block < blockCount; ++block) {
+        const BitPackedBlock& b = blocks[block];
+        if (b.width() == 0)
+            continue;
+        for (size_t j = 0; j < B && block * B + j < values.size(); ++j)
+            detail::depositBits(words.data() + b.wordOffset(), j * b.width(), b.width(),
+                                uint64_t(values[block * B + j]) - b.reference);
+    }
+
+    result.size = values.size();
+    result.blocks = blocks;
+    result.words = words;
+}
+
+} // namespace decodeless
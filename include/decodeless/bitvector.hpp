@@ -0,0 +1,157 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/offset_span.hpp>
+#include <span>
+
+#if defined(__BMI2__)
+    #include <immintrin.h>
+#endif
+
+namespace decodeless {
+
+// Returns the position of the k-th (zero based) set bit in word. k must be
+// less than std::popcount(word).
+inline uint32_t selectInWord(uint64_t word, uint32_t k) {
+#if defined(__BMI2__)
+    return uint32_t(std::countr_zero(_pdep_u64(uint64_t(1) << k, word)));
+#else
+    uint32_t offset = 0;
+    for (;; offset += 8) {
+        uint32_t count = uint32_t(std::popcount((word >> offset) & 0xff));
+        if (k < count)
+            break;
+        k -= count;
+    }
+    word >>= offset;
+    for (; k; --k)
+        word &= word - 1;
+    return offset + uint32_t(std::countr_zero(word));
+#endif
+}
+
+// Rank index entry for 512 bits. Stores the number of set bits before the
+// superblock and, packed in 9 bits each, the counts before each of its 2nd to
+// 8th words.
+struct RankSuperblock {
+    uint64_t rank = 0;
+    uint64_t blocks = 0;
+
+    uint64_t blockRank(size_t word) const {
+        return word == 0 ? 0 : (blocks >> (9 * (word - 1))) & 0x1ff;
+    }
+};
+
+// Succinct rank/select structure over a bitmap, embeddable in a Header
+// subclass. rank1() is O(1) with two memory accesses. select1() uses sampled
+// superblock positions followed by a short binary search. The index adds
+// about 25% of the bitmap size. Build with buildRankSelect().
+struct RankSelectBitVector {
+    static constexpr size_t WordsPerSuperblock = 8;
+    static constexpr size_t BitsPerSuperblock = WordsPerSuperblock * 64;
+
+    // Every SelectSampleRate-th set bit records its superblock
+    static constexpr size_t SelectSampleRate = 4096;
+
+    uint64_t                    size = 0;
+    uint64_t                    ones = 0;
+    offset_span<uint64_t>       words;
+    offset_span<RankSuperblock> superblocks; // one extra at the end holding ones
+    offset_span<uint64_t>       selectSamples;
+
+    bool operator[](uint64_t i) const { return (words[i / 64] >> (i % 64)) & 1; }
+
+    // Number of set bits in [0, i), for i <= size
+    uint64_t rank1(uint64_t i) const {
+        assert(i <= size);
+        const RankSuperblock& superblock = superblocks[i / BitsPerSuperblock];
+        uint64_t              word = i / 64;
+
+        uint64_t result = superblock.rank + superblock.blockRank(word % WordsPerSuperblock);
+        if (i % 64)
+            result += std::popcount(words[word] & (~uint64_t(0) >> (64 - i % 64)));
+        return result;
+    }
+
+    uint64_t rank0(uint64_t i) const { return i - rank1(i); }
+
+    // Position of the k-th (zero based) set bit, for k < ones
+    uint64_t select1(uint64_t k) const {
+        assert(k < ones);
+        size_t sample = k / SelectSampleRate;
+        size_t lo = selectSamples[sample];
+        size_t hi = sample + 1 < selectSamples.size() ? selectSamples[sample + 1] + 1
+                                                      : superblocks.size() - 1;
+
+        // Last superblock in [lo, hi) with rank <= k
+        auto rankLess = [](uint64_t value, const RankSuperblock& s) { return value < s.rank; };
+        const RankSuperblock* begin = superblocks.data() + lo;
+        const RankSuperblock* end = superblocks.data() + hi;
+        const RankSuperblock* found = std::upper_bound(begin, end, k, rankLess) - 1;
+        uint64_t              remaining = k - found->rank;
+
+        // Last word in the superblock with block rank <= remaining
+        size_t word = 0;
+        while (word + 1 < WordsPerSuperblock && found->blockRank(word + 1) <= remaining)
+            ++word;
+        remaining -= found->blockRank(word);
+        size_t wordIndex = size_t(found - superblocks.data()) * WordsPerSuperblock + word;
+        return wordIndex * 64 + selectInWord(words[wordIndex], uint32_t(remaining));
+    }
+};
+
+// Builds the rank and select index for a bitmap of sizeBits bits already
+// allocated in the file, storing the index in memory. Bits past sizeBits in
+// the last word are cleared.
+template <class MemoryResource>
+void buildRankSelect(RankSelectBitVector& result, MemoryResource& memory,
+                     std::span<uint64_t> words, uint64_t sizeBits) {
+    using BV = RankSelectBitVector;
+    assert(words.size() == (sizeBits + 63) / 64);
+    if (sizeBits % 64)
+        words.back() &= ~uint64_t(0) >> (64 - sizeBits % 64);
+
+    size_t superblockCount = (words.size() + BV::WordsPerSuperblock - 1) / BV::WordsPerSuperblock;
+    std::span<RankSuperblock> superblocks =
+        detail::allocateArray<RankSuperblock>(memory, superblockCount + 1);
+    uint64_t                  ones = 0;
+    for (size_t s = 0; s < superblockCount; ++s) {
+        superblocks[s].rank = ones;
+        uint64_t blockRank = 0;
+        for (size_t w = 0; w < BV::WordsPerSuperblock; ++w) {
+            if (w)
+                superblocks[s].blocks |= blockRank << (9 * (w - 1));
+            size_t index = s * BV::WordsPerSuperblock + w;
+            if (index < words.size())
+                blockRank += std::popcount(words[index]);
+        }
+        ones += blockRank;
+    }
+    superblocks[superblockCount].rank = ones;
+
+    // Superblock containing every SelectSampleRate-th set bit
+    std::span<uint64_t> samples = detail::allocateArray<uint64_t>(
+        memory, std::max<size_t>(1, (ones + BV::SelectSampleRate - 1) / BV::SelectSampleRate));
+    size_t s = 0;
+    for (size_t sample = 0; sample * BV::SelectSampleRate < ones; ++sample) {
+        uint64_t k = sample * BV::SelectSampleRate;
+        while (superblocks[s + 1].rank <= k)
+            ++s;
+        samples[sample] = s;
+    }
+
+    result.size = sizeBits;
+    result.ones = ones;
+    result.words = words;
+    result.superblocks = superblocks;
+    result.selectSamples = samples;
+}
+
+} // namespace decodeless
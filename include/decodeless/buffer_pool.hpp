@@ -0,0 +1,284 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/unbuffered_file.hpp>
+#include <decodeless/header.hpp>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+class buffer_pool_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class buffer_pool_reader;
+
+// A sub-header kept resident in a buffer_pool_reader until the handle is
+// destroyed or reset. Move only. The reader must outlive its handles.
+template <class T>
+class pinned {
+public:
+    pinned() = default;
+    pinned(pinned&& other) noexcept
+        : m_reader(std::exchange(other.m_reader, nullptr))
+        , m_extent(other.m_extent)
+        , m_ptr(std::exchange(other.m_ptr, nullptr)) {}
+    pinned& operator=(pinned&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_reader = std::exchange(other.m_reader, nullptr);
+            m_extent = other.m_extent;
+            m_ptr = std::exchange(other.m_ptr, nullptr);
+        }
+        return *this;
+    }
+    ~pinned() { reset(); }
+
+    T*       get() const { return m_ptr; }
+    T*       operator->() const { return m_ptr; }
+    T&       operator*() const { return *m_ptr; }
+    explicit operator bool() const { return m_ptr != nullptr; }
+
+    // Unpins the extent, allowing it to be evicted
+    void reset();
+
+private:
+    friend class buffer_pool_reader;
+    pinned(buffer_pool_reader* reader, size_t extent, T* ptr)
+        : m_reader(reader)
+        , m_extent(extent)
+        , m_ptr(ptr) {}
+
+    buffer_pool_reader* m_reader = nullptr;
+    size_t              m_extent = 0;
+    T*                  m_ptr = nullptr;
+};
+
+// Reads a decodeless file through a fixed budget of user space memory instead
+// of mapping it, so memory use is deterministic and independent of the page
+// cache. Each sub-header and its payload, the extent up to the next sub-header
+// in file order as written by streaming_writer, is loaded on demand with
+// unbuffered reads. find() returns a pinned handle that keeps the extent
+// resident. Unpinned extents are evicted with the CLOCK algorithm when a load
+// would exceed the budget. Sub-header payloads must not reference data outside
+// their own extent. Safe to use from multiple threads; loads are serialized.
+class buffer_pool_reader {
+public:
+    static constexpr size_t BlockSize = 4096;
+
+    // capacity is the budget in bytes for sub-header extents. The root header
+    // and header list are held separately for the reader's lifetime.
+    buffer_pool_reader(const std::filesystem::path& path, size_t capacity)
+        : m_file(path, detail::unbuffered_file::Mode::Read)
+        , m_fileSize(m_file.size())
+        , m_capacity(capacity) {
+        if (m_fileSize < sizeof(RootHeader))
+            throw buffer_pool_error("Not a decodeless file");
+        Buffer rootBlock = read(0, sizeof(RootHeader));
+        auto*  root = reinterpret_cast<const RootHeader*>(rootBlock.get());
+        if (!root->magicValid())
+            throw buffer_pool_error("Not a decodeless file");
+        if (!root->binaryCompatible())
+            throw buffer_pool_error("Incompatible decodeless file");
+
+        // Load everything up to the end of the header list so the root's
+        // offset_span remains valid in the prefix buffer
+        const RootHeader::HeaderList& headers = root->headers;
+        uint64_t                      listEnd = sizeof(RootHeader);
+        if (!headers.empty()) {
+            // Bound the size before multiplying so a corrupt count cannot wrap
+            uint64_t listBegin = fileOffset(rootBlock.get(), headers.data());
+            if (listBegin < sizeof(RootHeader) || listBegin > m_fileSize ||
+                headers.size() > (m_fileSize - listBegin) / sizeof(offset_ptr<Header>))
+                throw buffer_pool_error("Header list outside of the file");
+            listEnd = listBegin + headers.size() * sizeof(offset_ptr<Header>);
+        }
+        m_prefix = read(0, listEnd);
+
+        // Read each sub-header's identifier and derive extents from the
+        // sorted sub-header offsets
+        std::vector<std::pair<uint64_t, size_t>> offsets;
+        for (size_t i = 0; i < headers.size(); ++i)
+            offsets.emplace_back(fileOffset(m_prefix.get(), this->root().headers[i].get()), i);
+        std::ranges::sort(offsets);
+        for (size_t i = 0; i < offsets.size(); ++i) {
+            uint64_t begin = offsets[i].first;
+            uint64_t end = i + 1 < offsets.size() ? offsets[i + 1].first : m_fileSize;
+            if (begin < listEnd || end > m_fileSize || end - begin < sizeof(Header))
+                throw buffer_pool_error("Sub-header outside of the file");
+            Buffer headerBlock = read(begin, sizeof(Header));
+            Magic  identifier =
+                reinterpret_cast<const Header*>(headerBlock.get() + begin % BlockSize)->identifier;
+            if (!m_index.emplace(identifier, m_extents.size()).second)
+                throw buffer_pool_error("Duplicate sub-header");
+            m_extents.emplace_back().begin = begin;
+            m_extents.back().end = end;
+        }
+    }
+
+    // The root header. Its header list is valid but sub-header pointers must
+    // not be dereferenced; use find() instead.
+    const RootHeader& root() const { return *reinterpret_cast<const RootHeader*>(m_prefix.get()); }
+
+    // Loads and pins the sub-header with the given identifier, or returns an
+    // empty handle if there is none. Throws buffer_pool_error if the extent
+    // does not fit in the budget with all currently pinned extents.
+    pinned<const Header> find(const Magic& identifier) {
+        auto it = m_index.find(identifier);
+        if (it == m_index.end())
+            return {};
+        std::lock_guard lock(m_mutex);
+        Extent&         extent = m_extents[it->second];
+        if (!extent.buffer)
+            load(extent);
+        ++extent.pins;
+        extent.referenced = true;
+        auto*           header =
+            reinterpret_cast<const Header*>(extent.buffer.get() + extent.begin % BlockSize);
+        return pinned<const Header>(this, it->second, header);
+    }
+
+    template <SubHeader HeaderType>
+    pinned<const HeaderType> find() {
+        constexpr Magic      headerIdentifier = HeaderType::HeaderIdentifier;
+        pinned<const Header> header = find(headerIdentifier);
+        return cast<HeaderType>(std::move(header));
+    }
+
+    template <VersionedSubHeader HeaderType>
+    pinned<const HeaderType> findSupported() {
+        pinned<const HeaderType> result = find<HeaderType>();
+        constexpr Version        versionSupported = HeaderType::VersionSupported;
+        if (result && !Version::binaryCompatible(versionSupported, result->version))
+            result.reset();
+        return result;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    // Bytes of extents currently loaded
+    size_t residentBytes() const {
+        std::lock_guard lock(m_mutex);
+        return m_resident;
+    }
+
+    // True if reads bypass the page cache
+    bool direct() const { return m_file.direct(); }
+
+private:
+    template <class T>
+    friend class pinned;
+
+    struct AlignedDelete {
+        void operator()(std::byte* p) const { ::operator delete(p, std::align_val_t(BlockSize)); }
+    };
+    using Buffer = std::unique_ptr<std::byte[], AlignedDelete>;
+
+    struct Extent {
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        Buffer   buffer;
+        size_t   pins = 0;
+        bool     referenced = false;
+
+        // Whole blocks covering the extent, keeping its offset within a block
+        // so alignment is preserved
+        size_t loadedSize() const {
+            return size_t((end + BlockSize - 1) / BlockSize * BlockSize -
+                          begin / BlockSize * BlockSize);
+        }
+    };
+
+    static uint64_t fileOffset(const std::byte* fileStart, const void* ptr) {
+        return uint64_t(reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(fileStart));
+    }
+
+    // Reads the whole blocks covering [begin, begin + size), zero filling
+    // past the end of the file. Byte begin is at begin % BlockSize.
+    Buffer read(uint64_t begin, uint64_t size) const {
+        uint64_t alignedBegin = begin / BlockSize * BlockSize;
+        size_t   alignedSize = size_t((begin + size + BlockSize - 1) / BlockSize * BlockSize -
+                                    alignedBegin);
+        Buffer   buffer(
+            static_cast<std::byte*>(::operator new(alignedSize, std::align_val_t(BlockSize))));
+        size_t read = m_file.readAt(alignedBegin, buffer.get(), alignedSize);
+        if (read < std::min<uint64_t>(alignedSize, m_fileSize - alignedBegin))
+            throw buffer_pool_error("Unexpected end of file");
+        std::memset(buffer.get() + read, 0, alignedSize - read);
+        return buffer;
+    }
+
+    template <class T>
+    pinned<const T> cast(pinned<const Header>&& header) {
+        pinned<const T> result(header.m_reader, header.m_extent,
+                               reinterpret_cast<const T*>(header.m_ptr));
+        header.m_reader = nullptr;
+        header.m_ptr = nullptr;
+        return result;
+    }
+
+    // Called with m_mutex held
+    void load(Extent& extent) {
+        size_t size = extent.loadedSize();
+        if (size > m_capacity)
+            throw buffer_pool_error("Sub-header extent exceeds the buffer pool capacity");
+
+        // CLOCK: sweep unpinned resident extents, giving recently referenced
+        // ones a second chance
+        for (size_t steps = 0; m_resident + size > m_capacity && steps < 2 * m_extents.size();
+             ++steps) {
+            Extent& candidate = m_extents[m_hand];
+            m_hand = (m_hand + 1) % m_extents.size();
+            if (!candidate.buffer || candidate.pins)
+                continue;
+            if (candidate.referenced) {
+                candidate.referenced = false;
+                continue;
+            }
+            candidate.buffer.reset();
+            m_resident -= candidate.loadedSize();
+        }
+        if (m_resident + size > m_capacity)
+            throw buffer_pool_error("Buffer pool exhausted by pinned sub-headers");
+        extent.buffer = read(extent.begin, extent.end - extent.begin);
+        m_resident += size;
+    }
+
+    void unpin(size_t extent) {
+        std::lock_guard lock(m_mutex);
+        --m_extents[extent].pins;
+    }
+
+    detail::unbuffered_file m_file;
+    uint64_t                m_fileSize;
+    size_t                  m_capacity;
+    Buffer                  m_prefix;
+    std::map<Magic, size_t> m_index;
+    mutable std::mutex      m_mutex;
+    std::vector<Extent>     m_extents;
+    size_t                  m_resident = 0;
+    size_t                  m_hand = 0;
+};
+
+template <class T>
+void pinned<T>::reset() {
+    if (m_reader)
+        m_reader->unpin(m_extent);
+    m_reader = nullptr;
+    m_ptr = nullptr;
+}
+
+} // namespace decodeless
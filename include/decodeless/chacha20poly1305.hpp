@@ -0,0 +1,283 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Portable ChaCha20-Poly1305 AEAD as specified in RFC 8439. Used to encrypt
+// individual sub-headers at rest. No platform specific intrinsics so it builds
+// everywhere the rest of decodeless does.
+namespace decodeless::chacha20poly1305 {
+
+using Key = std::array<uint8_t, 32>;
+using Nonce = std::array<uint8_t, 12>;
+using Tag = std::array<uint8_t, 16>;
+
+// ChaCha20 keystream is generated in 64 byte blocks
+inline constexpr size_t BlockSize = 64;
+
+namespace detail {
+
+inline uint32_t load32(const uint8_t* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+           (uint32_t(p[3]) << 24);
+}
+
+inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = uint8_t(v);
+    p[1] = uint8_t(v >> 8);
+    p[2] = uint8_t(v >> 16);
+    p[3] = uint8_t(v >> 24);
+}
+
+inline uint32_t rotl(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+inline void quarterRound(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    a += b;
+    d = rotl(d ^ a, 16);
+    c += d;
+    b = rotl(b ^ c, 12);
+    a += b;
+    d = rotl(d ^ a, 8);
+    c += d;
+    b = rotl(b ^ c, 7);
+}
+
+inline void block(const Key& key, const Nonce& nonce, uint32_t counter,
+                  std::array<uint8_t, BlockSize>& out) {
+    std::array<uint32_t, 16> state{0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    for (int i = 0; i < 8; ++i)
+        state[4 + i] = load32(key.data() + i * 4);
+    state[12] = counter;
+    for (int i = 0; i < 3; ++i)
+        state[13 + i] = load32(nonce.data() + i * 4);
+    std::array<uint32_t, 16> x = state;
+    for (int i = 0; i < 10; ++i) {
+        quarterRound(x[0], x[4], x[8], x[12]);
+        quarterRound(x[1], x[5], x[9], x[13]);
+        quarterRound(x[2], x[6], x[10], x[14]);
+        quarterRound(x[3], x[7], x[11], x[15]);
+        quarterRound(x[0], x[5], x[10], x[15]);
+        quarterRound(x[1], x[6], x[11], x[12]);
+        quarterRound(x[2], x[7], x[8], x[13]);
+        quarterRound(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i)
+        store32(out.data() + i * 4, x[i] + state[i]);
+}
+
+} // namespace detail
+
+// XORs the ChaCha20 keystream starting at block counter with in, writing to
+// out. in and out may alias. Blocks are independent so large buffers can be
+// split at multiples of BlockSize and processed in parallel by advancing
+// counter by offset / BlockSize.
+inline void xorKeystream(const Key& key, const Nonce& nonce, uint32_t counter,
+                         std::span<const std::byte> in, std::span<std::byte> out) {
+    std::array<uint8_t, BlockSize> keystream;
+    for (size_t offset = 0; offset < in.size(); offset += BlockSize, ++counter) {
+        detail::block(key, nonce, counter, keystream);
+        size_t n = std::min(BlockSize, in.size() - offset);
+        for (size_t i = 0; i < n; ++i)
+            out[offset + i] = in[offset + i] ^ std::byte(keystream[i]);
+    }
+}
+
+// Incremental Poly1305 one-time authenticator using 26 bit limbs
+class Poly1305 {
+public:
+    explicit Poly1305(std::span<const uint8_t, 32> key) {
+        using detail::load32;
+        m_r[0] = load32(&key[0]) & 0x3ffffff;
+        m_r[1] = (load32(&key[3]) >> 2) & 0x3ffff03;
+        m_r[2] = (load32(&key[6]) >> 4) & 0x3ffc0ff;
+        m_r[3] = (load32(&key[9]) >> 6) & 0x3f03fff;
+        m_r[4] = (load32(&key[12]) >> 8) & 0x00fffff;
+        for (int i = 0; i < 4; ++i)
+            m_pad[i] = load32(&key[16 + i * 4]);
+    }
+
+    void update(std::span<const uint8_t> data) {
+        if (m_buffered) {
+            size_t n = std::min(data.size(), 16 - m_buffered);
+            std::copy_n(data.begin(), n, m_buffer.begin() + m_buffered);
+            m_buffered += n;
+            data = data.subspan(n);
+            if (m_buffered < 16)
+                return;
+            blocks(m_buffer.data(), 16, 1u << 24);
+            m_buffered = 0;
+        }
+        size_t full = data.size() & ~size_t(15);
+        blocks(data.data(), full, 1u << 24);
+        std::copy(data.begin() + full, data.end(), m_buffer.begin());
+        m_buffered = data.size() - full;
+    }
+
+    Tag finish() {
+        if (m_buffered) {
+            m_buffer[m_buffered] = 1;
+            std::fill(m_buffer.begin() + m_buffered + 1, m_buffer.end(), uint8_t(0));
+            blocks(m_buffer.data(), 16, 0);
+        }
+        uint32_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4];
+
+        // Fully carry h
+        uint32_t c = h1 >> 26;
+        h1 &= 0x3ffffff;
+        h2 += c;
+        c = h2 >> 26;
+        h2 &= 0x3ffffff;
+        h3 += c;
+        c = h3 >> 26;
+        h3 &= 0x3ffffff;
+        h4 += c;
+        c = h4 >> 26;
+        h4 &= 0x3ffffff;
+        h0 += c * 5;
+        c = h0 >> 26;
+        h0 &= 0x3ffffff;
+        h1 += c;
+
+        // Compute h - p and select it if h >= p
+        uint32_t g0 = h0 + 5;
+        c = g0 >> 26;
+        g0 &= 0x3ffffff;
+        uint32_t g1 = h1 + c;
+        c = g1 >> 26;
+        g1 &= 0x3ffffff;
+        uint32_t g2 = h2 + c;
+        c = g2 >> 26;
+        g2 &= 0x3ffffff;
+        uint32_t g3 = h3 + c;
+        c = g3 >> 26;
+        g3 &= 0x3ffffff;
+        uint32_t g4 = h4 + c - (1u << 26);
+        uint32_t mask = (g4 >> 31) - 1;
+        h0 = (h0 & ~mask) | (g0 & mask);
+        h1 = (h1 & ~mask) | (g1 & mask);
+        h2 = (h2 & ~mask) | (g2 & mask);
+        h3 = (h3 & ~mask) | (g3 & mask);
+        h4 = (h4 & ~mask) | (g4 & mask);
+
+        // h = (h + pad) % 2^128
+        uint32_t words[4] = {
+            h0 | (h1 << 26),
+            (h1 >> 6) | (h2 << 20),
+            (h2 >> 12) | (h3 << 14),
+            (h3 >> 18) | (h4 << 8),
+        };
+        Tag      tag;
+        uint64_t f = 0;
+        for (int i = 0; i < 4; ++i) {
+            f = uint64_t(words[i]) + m_pad[i] + (f >> 32);
+            detail::store32(tag.data() + i * 4, uint32_t(f));
+        }
+        return tag;
+    }
+
+private:
+    void blocks(const uint8_t* m, size_t bytes, uint32_t hibit) {
+        using detail::load32;
+        const uint32_t r0 = m_r[0], r1 = m_r[1], r2 = m_r[2], r3 = m_r[3], r4 = m_r[4];
+        const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+        uint32_t       h0 = m_h[0], h1 = m_h[1], h2 = m_h[2], h3 = m_h[3], h4 = m_h[4];
+        for (; bytes >= 16; m += 16, bytes -= 16) {
+            h0 += load32(m + 0) & 0x3ffffff;
+            h1 += (load32(m + 3) >> 2) & 0x3ffffff;
+            h2 += (load32(m + 6) >> 4) & 0x3ffffff;
+            h3 += (load32(m + 9) >> 6) & 0x3ffffff;
+            h4 += (load32(m + 12) >> 8) | hibit;
+
+            uint64_t d0 = uint64_t(h0) * r0 + uint64_t(h1) * s4 + uint64_t(h2) * s3 +
+                          uint64_t(h3) * s2 + uint64_t(h4) * s1;
+            uint64_t d1 = uint64_t(h0) * r1 + uint64_t(h1) * r0 + uint64_t(h2) * s4 +
+                          uint64_t(h3) * s3 + uint64_t(h4) * s2;
+            uint64_t d2 = uint64_t(h0) * r2 + uint64_t(h1) * r1 + uint64_t(h2) * r0 +
+                          uint64_t(h3) * s4 + uint64_t(h4) * s3;
+            uint64_t d3 = uint64_t(h0) * r3 + uint64_t(h1) * r2 + uint64_t(h2) * r1 +
+                          uint64_t(h3) * r0 + uint64_t(h4) * s4;
+            uint64_t d4 = uint64_t(h0) * r4 + uint64_t(h1) * r3 + uint64_t(h2) * r2 +
+                          uint64_t(h3) * r1 + uint64_t(h4) * r0;
+
+            uint32_t c = uint32_t(d0 >> 26);
+            h0 = uint32_t(d0) & 0x3ffffff;
+            d1 += c;
+            c = uint32_t(d1 >> 26);
+            h1 = uint32_t(d1) & 0x3ffffff;
+            d2 += c;
+            c = uint32_t(d2 >> 26);
+            h2 = uint32_t(d2) & 0x3ffffff;
+            d3 += c;
+            c = uint32_t(d3 >> 26);
+            h3 = uint32_t(d3) & 0x3ffffff;
+            d4 += c;
+            c = uint32_t(d4 >> 26);
+            h4 = uint32_t(d4) & 0x3ffffff;
+            h0 += c * 5;
+            c = h0 >> 26;
+            h0 &= 0x3ffffff;
+            h1 += c;
+        }
+        m_h = {h0, h1, h2, h3, h4};
+    }
+
+    std::array<uint32_t, 5> m_r{};
+    std::array<uint32_t, 5> m_h{};
+    std::array<uint32_t, 4> m_pad{};
+    std::array<uint8_t, 16> m_buffer{};
+    size_t                  m_buffered = 0;
+};
+
+// Computes the AEAD tag for ciphertext that has already been encrypted, or is
+// about to be decrypted, with the given key and nonce
+inline Tag computeTag(const Key& key, const Nonce& nonce, std::span<const uint8_t> aad,
+                      std::span<const std::byte> ciphertext) {
+    std::array<uint8_t, BlockSize> otk;
+    detail::block(key, nonce, 0, otk);
+    Poly1305                       mac(std::span<const uint8_t, 32>(otk.data(), 32));
+    static constexpr uint8_t       zeros[16] = {};
+    mac.update(aad);
+    mac.update(std::span(zeros, (16 - aad.size() % 16) % 16));
+    mac.update(std::span(reinterpret_cast<const uint8_t*>(ciphertext.data()), ciphertext.size()));
+    mac.update(std::span(zeros, (16 - ciphertext.size() % 16) % 16));
+    std::array<uint8_t, 16> lengths;
+    detail::store32(&lengths[0], uint32_t(aad.size()));
+    detail::store32(&lengths[4], uint32_t(uint64_t(aad.size()) >> 32));
+    detail::store32(&lengths[8], uint32_t(ciphertext.size()));
+    detail::store32(&lengths[12], uint32_t(uint64_t(ciphertext.size()) >> 32));
+    mac.update(lengths);
+    return mac.finish();
+}
+
+// Constant time tag comparison
+inline bool tagEqual(const Tag& a, const Tag& b) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+// Encrypts data in place and returns the authentication tag. The nonce must
+// never be reused with the same key.
+inline Tag encrypt(const Key& key, const Nonce& nonce, std::span<const uint8_t> aad,
+                   std::span<std::byte> data) {
+    xorKeystream(key, nonce, 1, data, data);
+    return computeTag(key, nonce, aad, data);
+}
+
+// Verifies the tag and decrypts data in place. Returns false and leaves data
+// untouched if authentication fails.
+inline bool decrypt(const Key& key, const Nonce& nonce, std::span<const uint8_t> aad,
+                    std::span<std::byte> data, const Tag& tag) {
+    if (!tagEqual(computeTag(key, nonce, aad, data), tag))
+        return false;
+    xorKeystream(key, nonce, 1, data, data);
+    return true;
+}
+
+} // namespace decodeless::chacha20poly1305
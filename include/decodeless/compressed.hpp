@@ -0,0 +1,498 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/detail/varint.hpp>
+#include <decodeless/header.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace decodeless {
+
+class decompression_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+// LZ77 parameters. Compressed data is a sequence of a varint literal count,
+// the literals, then, unless the output is complete, a varint match distance
+// and a varint match length minus LzMinMatch. Distances reach back through the
+// output into the end of the dictionary. Match lengths are capped at
+// LzMaxMatch so the output size a given input can produce is bounded.
+inline constexpr size_t LzMinMatch = 4;
+inline constexpr size_t LzMaxMatch = LzMinMatch + 0x3fff; // two byte varint
+inline constexpr int    LzHashBits = 15;
+inline constexpr int    LzMaxChain = 16;
+
+inline uint32_t lzHash(const std::byte* p, int bits) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - bits);
+}
+
+// Largest output compressed data of the given size can decode to. Each match
+// takes at least three bytes and each literal one.
+inline uint64_t lzMaxOutput(uint64_t compressedSize) {
+    return compressedSize + compressedSize / 3 * LzMaxMatch;
+}
+
+inline void appendVarint(std::vector<std::byte>& out, uint64_t value) {
+    char buffer[10];
+    char* end = writeVarint(buffer, value);
+    for (const char* c = buffer; c != end; ++c)
+        out.push_back(std::byte(*c));
+}
+
+} // namespace detail
+
+// Content shared by many small compressed regions, which are too short to
+// compress well on their own. Indexed once on construction so compress() only
+// hashes its input. Decompression needs just the content.
+class compression_dictionary {
+public:
+    compression_dictionary() = default;
+    explicit compression_dictionary(std::vector<std::byte> content)
+        : m_content(std::move(content)) {
+        if (m_content.size() > size_t(INT32_MAX))
+            throw std::length_error("Compression dictionary too large");
+        m_head.assign(size_t(1) << detail::LzHashBits, -1);
+        m_prev.assign(m_content.size(), -1);
+        for (size_t i = 0; i + detail::LzMinMatch <= m_content.size(); ++i) {
+            int32_t& head = m_head[detail::lzHash(m_content.data() + i, detail::LzHashBits)];
+            m_prev[i] = head;
+            head = int32_t(i);
+        }
+    }
+
+    std::span<const std::byte> content() const { return m_content; }
+
+    // Compresses region against the dictionary. Thread safe.
+    std::vector<std::byte> compress(std::span<const std::byte> region) const {
+        const std::byte* in = region.data();
+        size_t           size = region.size();
+        size_t           dictionarySize = m_content.size();
+        std::vector<std::byte> out;
+        out.reserve(size / 2 + 16);
+
+        // Matches within the region use a table sized to it
+        int bits = std::clamp(int(std::bit_width(size)), 8, detail::LzHashBits);
+        std::vector<int32_t> table(size_t(1) << bits, -1);
+
+        size_t literals = 0, i = 0;
+        while (i + detail::LzMinMatch <= size) {
+            uint32_t hash = detail::lzHash(in + i, detail::LzHashBits);
+            size_t   bestLength = 0, bestDistance = 0;
+
+            int32_t& slot = table[hash >> (detail::LzHashBits - bits)];
+            if (slot >= 0) {
+                size_t length = 0;
+                while (i + length < size && in[size_t(slot) + length] == in[i + length])
+                    ++length;
+                bestLength = length;
+                bestDistance = i - size_t(slot);
+            }
+            slot = int32_t(i);
+
+            int32_t candidate = m_head.empty() ? -1 : m_head[hash];
+            for (int depth = 0; candidate >= 0 && depth < detail::LzMaxChain; ++depth) {
+                size_t limit = std::min(dictionarySize - size_t(candidate), size - i);
+                size_t length = 0;
+                while (length < limit && m_content[size_t(candidate) + length] == in[i + length])
+                    ++length;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = dictionarySize - size_t(candidate) + i;
+                }
+                candidate = m_prev[size_t(candidate)];
+            }
+
+            if (bestLength < detail::LzMinMatch) {
+                ++i;
+                continue;
+            }
+            bestLength = std::min(bestLength, detail::LzMaxMatch);
+            detail::appendVarint(out, i - literals);
+            out.insert(out.end(), in + literals, in + i);
+            detail::appendVarint(out, bestDistance);
+            detail::appendVarint(out, bestLength - detail::LzMinMatch);
+            for (size_t j = i + 1; j < i + bestLength && j + detail::LzMinMatch <= size; ++j)
+                table[detail::lzHash(in + j, bits)] = int32_t(j);
+            i += bestLength;
+            literals = i;
+        }
+        detail::appendVarint(out, size - literals);
+        out.insert(out.end(), in + literals, in + size);
+        return out;
+    }
+
+private:
+    std::vector<std::byte> m_content;
+    std::vector<int32_t>   m_head; // latest content position for each hash
+    std::vector<int32_t>   m_prev; // previous position with the same hash
+};
+
+// Decompresses the output of compression_dictionary::compress() into out,
+// which must be exactly the original size. Throws decompression_error if the
+// data is corrupt.
+inline void decompress(std::span<const std::byte> dictionary, std::span<const std::byte> data,
+                       std::span<std::byte> out) {
+    auto*  in = reinterpret_cast<const char*>(data.data());
+    auto*  end = in + data.size();
+    size_t position = 0;
+    auto   read = [&](uint64_t& value) {
+        in = detail::readVarint(in, end, value);
+        if (!in)
+            throw decompression_error("Truncated compressed data");
+    };
+    for (;;) {
+        uint64_t literals;
+        read(literals);
+        if (literals > out.size() - position || literals > uint64_t(end - in))
+            throw decompression_error("Compressed literals out of range");
+        std::memcpy(out.data() + position, in, size_t(literals));
+        in += literals;
+        position += size_t(literals);
+        if (position == out.size()) {
+            if (in != end)
+                throw decompression_error("Trailing compressed data");
+            return;
+        }
+
+        uint64_t distance, extra;
+        read(distance);
+        read(extra);
+        if (distance == 0 || distance > dictionary.size() + position ||
+            out.size() - position < detail::LzMinMatch ||
+            extra > out.size() - position - detail::LzMinMatch ||
+            extra > detail::LzMaxMatch - detail::LzMinMatch)
+            throw decompression_error("Compressed match out of range");
+        size_t length = size_t(extra) + detail::LzMinMatch;
+        size_t source = dictionary.size() + position - size_t(distance);
+        for (; length && source < dictionary.size(); --length)
+            out[position++] = dictionary[source++];
+        if (!length)
+            continue;
+        source -= dictionary.size();
+        if (position - source >= length) {
+            std::memcpy(out.data() + position, out.data() + source, length);
+            position += length;
+        } else {
+            // Overlapping copy repeats the recent output
+            for (; length; --length)
+                out[position++] = out[source++];
+        }
+    }
+}
+
+// Builds a dictionary from sample regions, e.g. sub-headers of the same type,
+// by greedily choosing the segments whose 8 byte substrings are most common
+// across all samples, in the style of zstd's COVER trainer
+inline std::vector<std::byte> trainDictionary(std::span<const std::span<const std::byte>> samples,
+                                              size_t capacity = 16 << 10) {
+    constexpr size_t K = 8, SegmentSize = 64, Stride = 16;
+    auto             kmer = [](const std::byte* p) {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    };
+
+    std::unordered_map<uint64_t, uint32_t> frequency;
+    for (std::span<const std::byte> sample : samples)
+        for (size_t i = 0; i + K <= sample.size(); ++i)
+            ++frequency[kmer(sample.data() + i)];
+
+    struct Segment {
+        std::span<const std::byte> bytes;
+    };
+    std::vector<Segment> segments;
+    for (std::span<const std::byte> sample : samples) {
+        if (sample.size() < K)
+            continue;
+        if (sample.size() <= SegmentSize) {
+            segments.push_back({sample});
+            continue;
+        }
+        for (size_t offset = 0; offset + SegmentSize <= sample.size(); offset += Stride)
+            segments.push_back({sample.subspan(offset, SegmentSize)});
+        if ((sample.size() - SegmentSize) % Stride)
+            segments.push_back({sample.last(SegmentSize)});
+    }
+
+    // Pick the best segment of each epoch, then discount its substrings so
+    // later picks cover different content
+    std::vector<std::byte> result;
+    size_t epochs = std::max<size_t>(1, capacity / SegmentSize);
+    size_t epochSize = (segments.size() + epochs - 1) / std::max<size_t>(1, epochs);
+    for (size_t begin = 0; begin < segments.size() && result.size() < capacity;
+         begin += epochSize) {
+        size_t   end = std::min(segments.size(), begin + epochSize);
+        uint64_t bestScore = 0;
+        size_t   best = end;
+        for (size_t s = begin; s < end; ++s) {
+            std::span<const std::byte> bytes = segments[s].bytes;
+            uint64_t                   score = 0;
+            for (size_t i = 0; i + K <= bytes.size(); ++i)
+                score += frequency[kmer(bytes.data() + i)] - 1;
+            if (score > bestScore) {
+                bestScore = score;
+                best = s;
+            }
+        }
+        if (best == end)
+            continue;
+        std::span<const std::byte> bytes = segments[best].bytes;
+        for (size_t i = 0; i + K <= bytes.size(); ++i)
+            frequency[kmer(bytes.data() + i)] = 1;
+        bytes = bytes.first(std::min(bytes.size(), capacity - result.size()));
+        result.insert(result.end(), bytes.begin(), bytes.end());
+    }
+    return result;
+}
+
+// Format of CompressedHeaderEntry::data. Readers reject codecs they do not
+// know, so others, e.g. zstd, can be added without breaking existing files.
+enum class CompressionCodec : uint32_t {
+    Lz77 = 0, // compression_dictionary::compress()
+};
+
+// One compressed sub-header. The compressed region covers the sub-header,
+// starting with its Header base, and all payload it references. The region
+// must be contiguous and only reference itself via offset_ptr/offset_span so
+// it remains valid when decompressed to a different address.
+struct CompressedHeaderEntry {
+    Magic                  identifier;
+    CompressionCodec       codec = CompressionCodec::Lz77;
+    uint32_t               dictionary = 0; // index into CompressedHeaders::dictionaries
+    uint32_t               alignment = 1;  // of the region's start, at most 4096
+    uint32_t               reserved = 0; // zero, explicit padding before size
+    uint64_t               size = 0; // decompressed
+    offset_span<std::byte> data;
+};
+
+// Sub-header holding shared compression dictionaries and the compressed
+// sub-headers that use them, sorted by identifier. Compressed sub-headers must
+// not also be added to RootHeader::headers. Use decompressed_headers to access
+// them.
+struct CompressedHeaders : Header {
+    static constexpr Magic   HeaderIdentifier{"DL:COMPRESSED"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    CompressedHeaders()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+
+    offset_span<offset_span<std::byte>> dictionaries;
+    offset_span<CompressedHeaderEntry>  entries;
+
+    const CompressedHeaderEntry* find(const Magic& identifier) const {
+        auto it = std::ranges::lower_bound(entries, identifier, {},
+                                           &CompressedHeaderEntry::identifier);
+        return it != entries.end() && it->identifier == identifier ? &*it : nullptr;
+    }
+};
+
+// Collects compressed sub-headers and writes them as a CompressedHeaders
+// sub-header. Typically one dictionary is trained per group of similar
+// sub-headers, e.g. of the same type, from a sample of their regions. Grouping
+// is up to the caller, which picks the dictionary for each add().
+class compressed_headers_builder {
+public:
+    // Adds a dictionary, e.g. from trainDictionary(), and returns its index
+    uint32_t addDictionary(std::vector<std::byte> content) {
+        m_dictionaries.emplace_back(std::move(content));
+        return uint32_t(m_dictionaries.size() - 1);
+    }
+
+    // Compresses region, which must begin with the sub-header's Header base,
+    // with the given dictionary
+    void add(uint32_t dictionary, std::span<const std::byte> region) {
+        if (dictionary >= m_dictionaries.size())
+            throw std::out_of_range("No such compression dictionary");
+        if (region.size() < sizeof(Header))
+            throw std::invalid_argument("Compressed region smaller than a Header");
+        auto address = reinterpret_cast<uintptr_t>(region.data());
+        m_entries.push_back(Pending{
+            .identifier = reinterpret_cast<const Header*>(region.data())->identifier,
+            .codec = CompressionCodec::Lz77,
+            .dictionary = dictionary,
+            .alignment = uint32_t(std::min<uintptr_t>(4096, address & (~address + 1))),
+            .size = region.size(),
+            .data = m_dictionaries[dictionary].compress(region)});
+    }
+
+    // Total compressed bytes of the regions added so far
+    size_t compressedSize() const {
+        size_t result = 0;
+        for (const Pending& entry : m_entries)
+            result += entry.data.size();
+        return result;
+    }
+
+    // Allocates the CompressedHeaders sub-header and its data from memory.
+    // Add it to RootHeader::headers.
+    template <class MemoryResource>
+    CompressedHeaders* create(MemoryResource& memory) {
+        std::ranges::sort(m_entries, {}, &Pending::identifier);
+        auto duplicate = std::ranges::adjacent_find(m_entries, {}, &Pending::identifier);
+        if (duplicate != m_entries.end())
+            throw std::invalid_argument("Duplicate compressed sub-header");
+
+        auto* result = detail::allocateObject<CompressedHeaders>(memory);
+        auto  dictionaries =
+            detail::allocateArray<offset_span<std::byte>>(memory, m_dictionaries.size());
+        for (size_t i = 0; i < m_dictionaries.size(); ++i) {
+            std::span<const std::byte> content = m_dictionaries[i].content();
+            auto copy = detail::allocateArray<std::byte>(memory, content.size());
+            std::ranges::copy(content, copy.begin());
+            dictionaries[i] = copy;
+        }
+        result->dictionaries = dictionaries;
+        auto entries = detail::allocateArray<CompressedHeaderEntry>(memory, m_entries.size());
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            const Pending& pending = m_entries[i];
+            auto           data = detail::allocateArray<std::byte>(memory, pending.data.size());
+            std::ranges::copy(pending.data, data.begin());
+            entries[i].identifier = pending.identifier;
+            entries[i].codec = pending.codec;
+            entries[i].dictionary = pending.dictionary;
+            entries[i].alignment = pending.alignment;
+            entries[i].size = pending.size;
+            entries[i].data = data;
+        }
+        result->entries = entries;
+        return result;
+    }
+
+private:
+    struct Pending {
+        Magic                  identifier;
+        CompressionCodec       codec;
+        uint32_t               dictionary;
+        uint32_t               alignment;
+        uint64_t               size;
+        std::vector<std::byte> data;
+    };
+
+    std::vector<compression_dictionary> m_dictionaries;
+    std::vector<Pending>                m_entries;
+};
+
+// Reader side cache of decompressed sub-headers for one mapped file.
+// Uncompressed sub-headers are returned directly from the mapping. Compressed
+// ones are decompressed on first access into an arena, packed rather than one
+// allocation each since they are typically tiny. Dictionaries are used in
+// place from the mapping, so there is no setup cost. Keep this alongside the
+// mapping; pointers it returns are invalid after either is destroyed.
+class decompressed_headers {
+public:
+    explicit decompressed_headers(const RootHeader& root)
+        : m_root(root) {}
+
+    // Returns the header with the given identifier, decompressing it if
+    // needed. Throws decompression_error if the compressed data is corrupt.
+    Header* find(const Magic& identifier) {
+        if (Header* plain = m_root.find(identifier))
+            return plain;
+        const CompressedHeaders* compressed = m_root.findSupported<CompressedHeaders>();
+        if (!compressed)
+            return nullptr;
+        const CompressedHeaderEntry* entry = compressed->find(identifier);
+        if (!entry)
+            return nullptr;
+
+        std::lock_guard lock(m_mutex);
+        auto [it, inserted] = m_decompressed.try_emplace(identifier, nullptr);
+        if (inserted) {
+            try {
+                it->second = decompressEntry(*compressed, *entry);
+            } catch (...) {
+                m_decompressed.erase(it);
+                throw;
+            }
+        }
+        return it->second;
+    }
+
+    template <SubHeader HeaderType>
+    HeaderType* find() {
+        constexpr Magic headerIdentifier = HeaderType::HeaderIdentifier;
+        return reinterpret_cast<HeaderType*>(find(headerIdentifier));
+    }
+
+    template <VersionedSubHeader HeaderType>
+    HeaderType* findSupported() {
+        HeaderType*       result = find<HeaderType>();
+        constexpr Version versionSupported = HeaderType::VersionSupported;
+        return result && Version::binaryCompatible(versionSupported, result->version) ? result
+                                                                                      : nullptr;
+    }
+
+private:
+    static constexpr size_t MaxAlignment = 4096;
+    static constexpr size_t ChunkSize = 64 << 10;
+
+    struct AlignedDelete {
+        void operator()(std::byte* p) const {
+            ::operator delete(p, std::align_val_t(MaxAlignment));
+        }
+    };
+    using Buffer = std::unique_ptr<std::byte[], AlignedDelete>;
+
+    Header* decompressEntry(const CompressedHeaders& compressed,
+                            const CompressedHeaderEntry& entry) {
+        if (entry.dictionary >= compressed.dictionaries.size() || entry.size < sizeof(Header) ||
+            !std::has_single_bit(entry.alignment) || entry.alignment > MaxAlignment)
+            throw decompression_error("Corrupt compressed sub-header entry");
+        if (entry.codec != CompressionCodec::Lz77)
+            throw decompression_error("Unknown compression codec");
+        if (entry.size > detail::lzMaxOutput(entry.data.size()))
+            throw decompression_error("Compressed sub-header size out of range");
+        const offset_span<std::byte>& dictionary = compressed.dictionaries[entry.dictionary];
+        std::span<std::byte>          out = allocate(size_t(entry.size), entry.alignment);
+        decompress(std::span(dictionary.data(), dictionary.size()),
+                   std::span(entry.data.data(), entry.data.size()), out);
+        auto* header = reinterpret_cast<Header*>(out.data());
+        if (header->identifier != entry.identifier)
+            throw decompression_error("Compressed sub-header identifier mismatch");
+        return header;
+    }
+
+    // Bump allocates from chunks. Large regions get their own buffer.
+    std::span<std::byte> allocate(size_t size, size_t alignment) {
+        auto newBuffer = [this](size_t bytes) {
+            m_buffers.emplace_back(
+                static_cast<std::byte*>(::operator new(bytes, std::align_val_t(MaxAlignment))));
+            return m_buffers.back().get();
+        };
+        if (size > ChunkSize / 4)
+            return {newBuffer(size), size};
+        size_t begin = (m_used + alignment - 1) / alignment * alignment;
+        if (!m_chunk || begin + size > ChunkSize) {
+            m_chunk = newBuffer(ChunkSize);
+            begin = 0;
+        }
+        m_used = begin + size;
+        return {m_chunk + begin, size};
+    }
+
+    const RootHeader&        m_root;
+    std::mutex               m_mutex;
+    std::map<Magic, Header*> m_decompressed;
+    std::vector<Buffer>      m_buffers;
+    std::byte*               m_chunk = nullptr; // current chunk
+    size_t                   m_used = 0;        // bytes used in m_chunk
+};
+
+} // namespace decodeless
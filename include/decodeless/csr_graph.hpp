@@ -0,0 +1,196 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/detail/parallel.hpp>
+#include <decodeless/offset_span.hpp>
+#include <decodeless/prefetch.hpp>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+struct CsrEdge {
+    uint32_t source = 0;
+    uint32_t target = 0;
+};
+
+// Half-open range of vertex ids
+struct CsrVertexRange {
+    uint32_t begin = 0;
+    uint32_t end = 0;
+};
+
+// Compressed sparse row graph, embeddable in a Header subclass. The outgoing
+// edges of vertex v are neighbors[offsets[v]..offsets[v + 1]], with matching
+// weights if the graph is weighted, i.e. weights is non-empty. Build with
+// buildCsrGraph().
+template <class Weight = float>
+struct CsrGraph {
+    static_assert(std::is_trivially_copyable_v<Weight>);
+
+    offset_span<uint64_t> offsets; // vertexCount() + 1 entries
+    offset_span<uint32_t> neighbors;
+    offset_span<Weight>   weights;
+
+    uint32_t vertexCount() const { return offsets.empty() ? 0 : uint32_t(offsets.size() - 1); }
+    uint64_t edgeCount() const { return neighbors.size(); }
+    bool     weighted() const { return !weights.empty(); }
+    uint64_t degree(uint32_t v) const { return offsets[v + 1] - offsets[v]; }
+
+    std::span<const uint32_t> neighborsOf(uint32_t v) const {
+        return {neighbors.data() + offsets[v], size_t(degree(v))};
+    }
+
+    std::span<const Weight> weightsOf(uint32_t v) const {
+        assert(weighted());
+        return {weights.data() + offsets[v], size_t(degree(v))};
+    }
+
+    // Calls fn(neighbor) or, for a weighted graph, fn(neighbor, weight) for
+    // each outgoing edge of v. The weighted form is used only if the graph
+    // has weights. Throws std::invalid_argument if fn only accepts the
+    // weighted form and the graph has none. Traversals
+    // usually visit the neighbor's own edge list next, so its offsets entry
+    // is prefetched Distance edges ahead.
+    template <size_t Distance = DefaultPrefetchDistance, class Fn>
+    void forEachNeighbor(uint32_t v, Fn&& fn) const {
+        constexpr bool takesWeight = std::is_invocable_v<Fn&, uint32_t, const Weight&>;
+        constexpr bool takesNeighbor = std::is_invocable_v<Fn&, uint32_t>;
+        static_assert(takesWeight || takesNeighbor);
+        const uint32_t* begin = neighbors.data() + offsets[v];
+        const uint32_t* end = neighbors.data() + offsets[v + 1];
+        const uint64_t* vertexOffsets = offsets.data();
+        const Weight*   edgeWeights = nullptr;
+        if constexpr (takesWeight) {
+            if (weighted())
+                edgeWeights = weights.data() + offsets[v];
+            else if constexpr (!takesNeighbor)
+                throw std::invalid_argument("Weighted callback on an unweighted graph");
+        }
+        for (const uint32_t* p = begin; p != std::min(end, begin + Distance); ++p)
+            prefetch(vertexOffsets + *p);
+        for (const uint32_t* p = begin; p != end; ++p) {
+            if (end - p > std::ptrdiff_t(Distance))
+                prefetch(vertexOffsets + p[Distance]);
+            if constexpr (takesWeight) {
+                if (edgeWeights) {
+                    fn(*p, edgeWeights[p - begin]);
+                    continue;
+                }
+            }
+            if constexpr (takesNeighbor)
+                fn(*p);
+        }
+    }
+
+    // Splits the vertices into up to parts contiguous ranges with roughly
+    // equal numbers of edges, for handing to worker threads
+    std::vector<CsrVertexRange> partition(size_t parts) const {
+        std::vector<CsrVertexRange> result;
+        uint32_t                    vertices = vertexCount();
+        parts = std::max<size_t>(1, parts);
+        uint32_t begin = 0;
+        for (size_t i = 1; i <= parts && begin < vertices; ++i) {
+            uint32_t end = vertices;
+            if (i < parts) {
+                uint64_t target = edgeCount() * i / parts;
+                end = uint32_t(std::lower_bound(offsets.begin() + begin, offsets.end() - 1, target) -
+                               offsets.begin());
+                if (end == begin)
+                    continue;
+            }
+            result.push_back({begin, end});
+            begin = end;
+        }
+        return result;
+    }
+};
+
+// Builds a CSR graph from an edge list with a parallel counting sort. Each
+// thread counts the sources of a chunk of edges, a parallel prefix sum over
+// vertex ranges turns the per-thread counts into write cursors and then each
+// thread scatters its chunk. The result is deterministic: each edge list keeps
+// the input order. weights must be empty or match edges. Temporary memory is
+// a vertexCount counter histogram per thread, so threads are limited to one
+// per vertexCount edges to keep it within about one counter per edge. A
+// threadCount of zero uses all cores.
+template <class Weight, class MemoryResource>
+void buildCsrGraph(CsrGraph<Weight>& result, MemoryResource& memory, uint32_t vertexCount,
+                   std::span<const CsrEdge> edges,
+                   std::type_identity_t<std::span<const Weight>> weights = {},
+                   size_t threadCount = 0) {
+    if (!weights.empty() && weights.size() != edges.size())
+        throw std::invalid_argument("Edge weights must match the edges");
+    size_t threads = detail::threadsFor(edges.size(), threadCount,
+                                        std::max<size_t>(4096, vertexCount));
+
+    std::span<uint64_t> offsets = detail::allocateArray<uint64_t>(memory, size_t(vertexCount) + 1);
+    std::span<uint32_t> neighbors = detail::allocateArray<uint32_t>(memory, edges.size());
+    std::span<Weight>   edgeWeights = detail::allocateArray<Weight>(memory, weights.size());
+
+    auto edgeChunk = [&](size_t t) { return detail::chunkRange(edges.size(), threads, t); };
+    auto vertexChunk = [&](size_t t) { return detail::chunkRange(vertexCount, threads, t); };
+
+    // Per-thread source histograms
+    std::vector<std::vector<uint64_t>> counts(threads);
+    detail::parallelFor(threads, [&](size_t t) {
+        counts[t].assign(vertexCount, 0);
+        auto [begin, end] = edgeChunk(t);
+        for (size_t e = begin; e < end; ++e) {
+            if (edges[e].source >= vertexCount || edges[e].target >= vertexCount)
+                throw std::out_of_range("Edge vertex out of range");
+            ++counts[t][edges[e].source];
+        }
+    });
+
+    // Parallel exclusive prefix sum: per vertex range totals, a short serial
+    // scan of the totals, then each range writes its offsets and converts the
+    // histograms into per-thread write cursors
+    std::vector<uint64_t> rangeTotals(threads + 1, 0);
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = vertexChunk(t);
+        uint64_t total = 0;
+        for (size_t v = begin; v < end; ++v)
+            for (size_t i = 0; i < threads; ++i)
+                total += counts[i][v];
+        rangeTotals[t + 1] = total;
+    });
+    std::partial_sum(rangeTotals.begin(), rangeTotals.end(), rangeTotals.begin());
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = vertexChunk(t);
+        uint64_t cursor = rangeTotals[t];
+        for (size_t v = begin; v < end; ++v) {
+            offsets[v] = cursor;
+            for (size_t i = 0; i < threads; ++i)
+                cursor += std::exchange(counts[i][v], cursor);
+        }
+    });
+    offsets[vertexCount] = edges.size();
+
+    // Scatter
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = edgeChunk(t);
+        for (size_t e = begin; e < end; ++e) {
+            uint64_t position = counts[t][edges[e].source]++;
+            neighbors[position] = edges[e].target;
+            if (!weights.empty())
+                edgeWeights[position] = weights[e];
+        }
+    });
+
+    result.offsets = offsets;
+    result.neighbors = neighbors;
+    result.weights = edgeWeights;
+}
+
+} // namespace decodeless
@@ -0,0 +1,96 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <decodeless/header.hpp>
+#include <decodeless/header_ref.hpp>
+#include <functional>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <type_traits>
+#include <typeindex>
+#include <utility>
+
+namespace decodeless {
+
+// Runtime-only structures derived from the sub-headers of one mapping, e.g. a
+// hash map over a mapped array, built on first use and destroyed with the
+// cache. Keep it alongside the mapping and replace both together on reload so
+// derived structures never outlive the data they were built from. Safe to use
+// from multiple threads.
+class derived_cache {
+public:
+    explicit derived_cache(const RootHeader& root)
+        : m_headers(root) {}
+    derived_cache(const derived_cache&) = delete;
+    derived_cache& operator=(const derived_cache&) = delete;
+
+    const RootHeader& root() const { return m_headers.root(); }
+
+    // Returns the Derived for sub-header HeaderType, calling
+    // build(const HeaderType&, std::pmr::memory_resource&) exactly once per
+    // cache to create it. build may allocate from the memory resource, e.g.
+    // for std::pmr containers, which is freed when the cache is destroyed.
+    // Returns nullptr if the sub-header is missing. If build throws, the
+    // exception propagates and the next call retries.
+    template <SubHeader HeaderType, class Derived, class Build>
+    const Derived* get_or_build(Build&& build) {
+        constexpr Magic   identifier = HeaderType::HeaderIdentifier;
+        const HeaderType* header = m_headers.find<HeaderType>();
+        if (!header)
+            return nullptr;
+        Entry& entry = this->entry(Key{identifier, typeid(Derived)});
+        std::call_once(entry.once, [&] {
+            void* memory = entry.arena.allocate(sizeof(Derived), alignof(Derived));
+            entry.object = new (memory) Derived(std::invoke(build, *header, entry.arena));
+            entry.destroy = [](void* object) { static_cast<Derived*>(object)->~Derived(); };
+        });
+        return static_cast<const Derived*>(entry.object);
+    }
+
+private:
+    struct Key {
+        Magic           identifier;
+        std::type_index derived;
+        bool            operator<(const Key& other) const {
+            if (identifier != other.identifier)
+                return identifier < other.identifier;
+            return derived < other.derived;
+        }
+    };
+
+    struct Entry {
+        std::once_flag                      once;
+        std::pmr::monotonic_buffer_resource arena;
+        void*                               object = nullptr;
+        void (*destroy)(void*) = nullptr;
+        ~Entry() {
+            if (destroy)
+                destroy(object);
+        }
+    };
+
+    Entry& entry(const Key& key) {
+        {
+            std::shared_lock lock(m_mutex);
+            auto             it = m_entries.find(key);
+            if (it != m_entries.end())
+                return *it->second;
+        }
+        std::unique_lock lock(m_mutex);
+        auto [it, inserted] = m_entries.try_emplace(key);
+        if (inserted)
+            it->second = std::make_unique<Entry>();
+        return *it->second;
+    }
+
+    header_cache                          m_headers;
+    std::shared_mutex                     m_mutex;
+    std::map<Key, std::unique_ptr<Entry>> m_entries;
+};
+
+} // namespace decodeless
@@ -0,0 +1,29 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility>
+
+// Helpers for builders that write into a decodeless memory resource, i.e.
+// anything with allocate(bytes, alignment) such as linear_memory_resource
+namespace decodeless::detail {
+
+template <class T, class MemoryResource, class... Args>
+T* allocateObject(MemoryResource& memory, Args&&... args) {
+    return new (memory.allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+// Allocates a value initialized array. alignment may be larger than alignof(T),
+// e.g. to start a column on a cache line.
+template <class T, class MemoryResource>
+std::span<T> allocateArray(MemoryResource& memory, size_t count, size_t alignment = alignof(T)) {
+    T* data = static_cast<T*>(memory.allocate(sizeof(T) * count, std::max(alignment, alignof(T))));
+    std::uninitialized_value_construct_n(data, count);
+    return {data, count};
+}
+
+} // namespace decodeless::detail
@@ -0,0 +1,179 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+// Minimal io_uring submission and completion queue using the raw system calls,
+// so there is no liburing dependency. Linux only; DECODELESS_HAS_IO_URING is
+// defined when available.
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #include <sys/syscall.h>
+    #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && \
+        defined(__NR_io_uring_register)
+        #define DECODELESS_HAS_IO_URING 1
+    #endif
+#endif
+
+#if defined(DECODELESS_HAS_IO_URING)
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cerrno>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstring>
+    #include <decodeless/detail/system_error.hpp>
+    #include <span>
+
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+
+namespace decodeless::detail {
+
+// One ring for a single submitting thread and a single completing thread.
+// The caller must never have more operations in flight than entries.
+class io_uring_queue {
+public:
+    explicit io_uring_queue(unsigned entries) {
+        io_uring_params params{};
+        m_fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd == -1)
+            throwErrno("io_uring setup failed");
+        try {
+            map(params);
+        } catch (...) {
+            unmap();
+            ::close(m_fd);
+            throw;
+        }
+    }
+    io_uring_queue(const io_uring_queue&) = delete;
+    io_uring_queue& operator=(const io_uring_queue&) = delete;
+    ~io_uring_queue() {
+        unmap();
+        ::close(m_fd);
+    }
+
+    // Pins buffers for IORING_OP_WRITE_FIXED, indexed in order
+    void registerBuffers(std::span<const iovec> buffers) {
+        reg(IORING_REGISTER_BUFFERS, buffers.data(), unsigned(buffers.size()),
+            "io_uring buffer registration failed");
+    }
+
+    // Registers fd as fixed file index 0, for IOSQE_FIXED_FILE
+    void registerFile(int fd) {
+        reg(IORING_REGISTER_FILES, &fd, 1, "io_uring file registration failed");
+    }
+
+    // Queues an operation without submitting it. Submitting thread only.
+    void push(const io_uring_sqe& sqe) {
+        unsigned tail = *m_sqTail;
+        unsigned index = tail & *m_sqMask;
+        m_sqes[index] = sqe;
+        m_sqArray[index] = index;
+        std::atomic_ref(*m_sqTail).store(tail + 1, std::memory_order_release);
+        ++m_unsubmitted;
+    }
+
+    // Operations pushed but not yet submitted
+    unsigned unsubmitted() const { return m_unsubmitted; }
+
+    // Submits all pushed operations with one system call. Submitting thread
+    // only.
+    void submit() {
+        while (m_unsubmitted) {
+            int submitted = enter(m_unsubmitted, 0, 0);
+            if (submitted == -1) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                throwErrno("io_uring submit failed");
+            }
+            m_unsubmitted -= unsigned(submitted);
+        }
+    }
+
+    // Waits for and removes the next completion. Completing thread only.
+    io_uring_cqe wait() {
+        for (;;) {
+            unsigned head = *m_cqHead;
+            if (head != std::atomic_ref(*m_cqTail).load(std::memory_order_acquire)) {
+                io_uring_cqe cqe = m_cqes[head & *m_cqMask];
+                std::atomic_ref(*m_cqHead).store(head + 1, std::memory_order_release);
+                return cqe;
+            }
+            if (enter(0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR)
+                throwErrno("io_uring wait failed");
+        }
+    }
+
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return int(::syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr,
+                             size_t(0)));
+    }
+
+    void reg(unsigned opcode, const void* args, unsigned count, const char* what) {
+        if (::syscall(__NR_io_uring_register, m_fd, opcode, args, count) == -1)
+            throwErrno(what);
+    }
+
+    void map(const io_uring_params& params) {
+        m_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+        m_sq = mapRegion(m_sqSize, IORING_OFF_SQ_RING);
+        m_cq = single ? m_sq : mapRegion(m_cqSize, IORING_OFF_CQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(mapRegion(m_sqesSize, IORING_OFF_SQES));
+
+        auto* sq = static_cast<std::byte*>(m_sq);
+        auto* cq = static_cast<std::byte*>(m_cq);
+        m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    void* mapRegion(size_t size, off_t offset) {
+        void* result =
+            ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+        if (result == MAP_FAILED)
+            throwErrno("io_uring map failed");
+        return result;
+    }
+
+    void unmap() {
+        if (m_sqes)
+            ::munmap(m_sqes, m_sqesSize);
+        if (m_cq && m_cq != m_sq)
+            ::munmap(m_cq, m_cqSize);
+        if (m_sq)
+            ::munmap(m_sq, m_sqSize);
+    }
+
+    int           m_fd = -1;
+    void*         m_sq = nullptr;
+    void*         m_cq = nullptr;
+    size_t        m_sqSize = 0;
+    size_t        m_cqSize = 0;
+    size_t        m_sqesSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    unsigned*     m_sqTail = nullptr;
+    unsigned*     m_sqMask = nullptr;
+    unsigned*     m_sqArray = nullptr;
+    unsigned*     m_cqHead = nullptr;
+    unsigned*     m_cqTail = nullptr;
+    unsigned*     m_cqMask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+    unsigned      m_unsubmitted = 0;
+};
+
+} // namespace decodeless::detail
+
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Minimal fork-join helpers for parallel builders
+namespace decodeless::detail {
+
+// Calls fn(i) for i in [0, count) on count threads, the last on the calling
+// thread. Rethrows the first exception after all threads finish.
+template <class Fn>
+void parallelFor(size_t count, Fn&& fn) {
+    std::vector<std::exception_ptr> errors(count);
+    auto                            run = [&](size_t i) {
+        try {
+            fn(i);
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+    {
+        std::vector<std::jthread> workers;
+        for (size_t i = 0; i + 1 < count; ++i)
+            workers.emplace_back(run, i);
+        if (count)
+            run(count - 1);
+    }
+    for (const std::exception_ptr& error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+// Index range [begin, end) of chunk i when splitting size items into count
+// near equal chunks
+inline std::pair<size_t, size_t> chunkRange(size_t size, size_t count, size_t i) {
+    size_t per = (size + count - 1) / count;
+    size_t begin = std::min(size, i * per);
+    return {begin, std::min(size, begin + per)};
+}
+
+// Threads worth using for size items given a minimum amount of work per
+// thread. A threadCount of zero means std::thread::hardware_concurrency().
+inline size_t threadsFor(size_t size, size_t threadCount, size_t minPerThread) {
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    return std::clamp<size_t>(threadCount, 1, std::max<size_t>(1, size / minPerThread));
+}
+
+} // namespace decodeless::detail
@@ -0,0 +1,98 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if !defined(_WIN32)
+    #include <sys/types.h>
+    #include <unistd.h>
+#endif
+
+namespace decodeless::detail {
+
+[[noreturn]] inline void throwErrno(int error, const std::string& what) {
+    throw std::system_error(error, std::generic_category(), what);
+}
+
+// Throws std::system_error for the current errno, e.g. after a failed POSIX
+// call
+[[noreturn]] inline void throwErrno(const char* what) {
+    throwErrno(errno, what);
+}
+
+#if !defined(_WIN32)
+
+// Writes all of data at offset, retrying interrupted and short writes. A
+// write that makes no progress is reported as EIO rather than retried forever.
+inline void pwriteAll(int fd, const void* data, size_t size, uint64_t offset,
+                      const char* what = "File write failed") {
+    auto* bytes = static_cast<const std::byte*>(data);
+    while (size) {
+        ssize_t written = ::pwrite(fd, bytes, size, off_t(offset));
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            throwErrno(what);
+        }
+        if (written == 0)
+            throwErrno(EIO, what);
+        bytes += written;
+        size -= size_t(written);
+        offset += uint64_t(written);
+    }
+}
+
+// Copies between files in the kernel with copy_file_range() where supported,
+// otherwise through a bounce buffer. Returns the bytes copied, which is less
+// than size only if in ends first.
+inline uint64_t copyFileRange(int in, uint64_t inOffset, int out, uint64_t outOffset,
+                              uint64_t size, const char* what = "File copy failed") {
+    uint64_t remaining = size;
+    #if defined(__linux__)
+    while (remaining) {
+        loff_t  inPos = loff_t(inOffset), outPos = loff_t(outOffset);
+        ssize_t copied = ::copy_file_range(in, &inPos, out, &outPos, size_t(remaining), 0);
+        if (copied == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)
+                break;
+            throwErrno(what);
+        }
+        if (copied == 0)
+            return size - remaining;
+        inOffset += uint64_t(copied);
+        outOffset += uint64_t(copied);
+        remaining -= uint64_t(copied);
+    }
+    #endif
+    std::vector<std::byte> buffer(size_t(std::min<uint64_t>(remaining, 1 << 20)));
+    while (remaining) {
+        ssize_t read =
+            ::pread(in, buffer.data(), size_t(std::min<uint64_t>(remaining, buffer.size())),
+                    off_t(inOffset));
+        if (read == -1) {
+            if (errno == EINTR)
+                continue;
+            throwErrno(what);
+        }
+        if (read == 0)
+            break;
+        pwriteAll(out, buffer.data(), size_t(read), outOffset, what);
+        inOffset += uint64_t(read);
+        outOffset += uint64_t(read);
+        remaining -= uint64_t(read);
+    }
+    return size - remaining;
+}
+
+#endif
+
+} // namespace decodeless::detail
@@ -0,0 +1,182 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/system_error.hpp>
+#include <filesystem>
+#include <system_error>
+
+#if defined(_WIN32)
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <unistd.h>
+#endif
+
+namespace decodeless::detail {
+
+// File opened to bypass the page cache where the OS and file system allow it:
+// O_DIRECT on Linux, F_NOCACHE on macOS and FILE_FLAG_NO_BUFFERING on Windows.
+// Otherwise falls back to buffered I/O; direct() reports which. Direct I/O
+// must be block aligned in offset, size and memory. Write mode creates or
+// truncates the file.
+class unbuffered_file {
+public:
+    enum class Mode { Read, Write };
+
+    unbuffered_file(const std::filesystem::path& path, Mode mode) {
+#if defined(_WIN32)
+        DWORD access = mode == Mode::Read ? GENERIC_READ : GENERIC_WRITE;
+        DWORD share = mode == Mode::Read ? FILE_SHARE_READ : 0;
+        DWORD disposition = mode == Mode::Read ? OPEN_EXISTING : CREATE_ALWAYS;
+        m_handle = CreateFileW(path.c_str(), access, share, nullptr, disposition,
+                               FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr);
+        m_direct = m_handle != INVALID_HANDLE_VALUE;
+        if (!m_direct)
+            m_handle = CreateFileW(path.c_str(), access, share, nullptr, disposition,
+                                   FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_handle == INVALID_HANDLE_VALUE)
+            throw std::system_error(int(GetLastError()), std::system_category(),
+                                    "Failed to open " + path.string());
+#else
+        int flags = mode == Mode::Read ? O_RDONLY : O_WRONLY | O_CREAT | O_TRUNC;
+    #if defined(O_DIRECT)
+        // Some file systems, e.g. tmpfs, reject O_DIRECT
+        m_fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        m_direct = m_fd != -1;
+        if (!m_direct && errno != EINVAL)
+            throwErrno(errno, "Failed to open " + path.string());
+    #endif
+        if (m_fd == -1)
+            m_fd = ::open(path.c_str(), flags, 0644);
+        if (m_fd == -1)
+            throwErrno(errno, "Failed to open " + path.string());
+    #if defined(__APPLE__)
+        m_direct = ::fcntl(m_fd, F_NOCACHE, 1) != -1;
+    #endif
+#endif
+    }
+    unbuffered_file(const unbuffered_file&) = delete;
+    unbuffered_file& operator=(const unbuffered_file&) = delete;
+    ~unbuffered_file() {
+#if defined(_WIN32)
+        CloseHandle(m_handle);
+#else
+        ::close(m_fd);
+#endif
+    }
+
+    bool direct() const { return m_direct; }
+
+#if !defined(_WIN32)
+    int fd() const { return m_fd; }
+#endif
+
+    uint64_t size() const {
+#if defined(_WIN32)
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(m_handle, &size))
+            throw std::system_error(int(GetLastError()), std::system_category(),
+                                    "File size query failed");
+        return uint64_t(size.QuadPart);
+#else
+        struct stat info{};
+        if (::fstat(m_fd, &info) == -1)
+            throwErrno("File size query failed");
+        return uint64_t(info.st_size);
+#endif
+    }
+
+    void writeAt(uint64_t offset, const std::byte* data, size_t size) {
+#if defined(_WIN32)
+        while (size) {
+            OVERLAPPED overlapped{};
+            overlapped.Offset = DWORD(offset);
+            overlapped.OffsetHigh = DWORD(offset >> 32);
+            DWORD written = 0;
+            DWORD request = DWORD(std::min<size_t>(size, size_t(1) << 30));
+            if (!WriteFile(m_handle, data, request, &written, &overlapped))
+                throw std::system_error(int(GetLastError()), std::system_category(),
+                                        "File write failed");
+            offset += uint64_t(written);
+            data += written;
+            size -= size_t(written);
+        }
+#else
+        pwriteAll(m_fd, data, size, offset);
+#endif
+    }
+
+    // Reads up to size bytes, stopping early only at the end of the file.
+    // Returns the number of bytes read.
+    size_t readAt(uint64_t offset, std::byte* data, size_t size) const {
+        size_t total = 0;
+        while (total < size) {
+#if defined(_WIN32)
+            OVERLAPPED overlapped{};
+            overlapped.Offset = DWORD(offset);
+            overlapped.OffsetHigh = DWORD(offset >> 32);
+            DWORD read = 0;
+            DWORD request = DWORD(std::min<size_t>(size - total, size_t(1) << 30));
+            if (!ReadFile(m_handle, data + total, request, &read, &overlapped)) {
+                if (GetLastError() == ERROR_HANDLE_EOF)
+                    break;
+                throw std::system_error(int(GetLastError()), std::system_category(),
+                                        "File read failed");
+            }
+#else
+            size_t  request = size - total;
+            ssize_t read = ::pread(m_fd, data + total, request, off_t(offset));
+            if (read == -1) {
+                if (errno == EINTR)
+                    continue;
+                throwErrno("File read failed");
+            }
+#endif
+            offset += uint64_t(read);
+            total += size_t(read);
+
+            // Regular files only return short reads at the end. Retrying
+            // would also be an unaligned direct read.
+            if (size_t(read) < request)
+                break;
+        }
+        return total;
+    }
+
+    // Sets the file size, e.g. to drop padding after the last direct write
+    void truncate(uint64_t size) {
+#if defined(_WIN32)
+        FILE_END_OF_FILE_INFO info{};
+        info.EndOfFile.QuadPart = LONGLONG(size);
+        if (!SetFileInformationByHandle(m_handle, FileEndOfFileInfo, &info, sizeof(info)))
+            throw std::system_error(int(GetLastError()), std::system_category(),
+                                    "File truncate failed");
+#else
+        if (::ftruncate(m_fd, off_t(size)) == -1)
+            throwErrno("File truncate failed");
+#endif
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_handle = INVALID_HANDLE_VALUE;
+#else
+    int m_fd = -1;
+#endif
+    bool m_direct = false;
+};
+
+} // namespace decodeless::detail
@@ -0,0 +1,49 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace decodeless::detail {
+
+// LEB128 unsigned integers, 7 bits per byte, low bits first
+
+inline size_t varintSize(uint64_t value) {
+    size_t size = 1;
+    for (; value >= 0x80; value >>= 7)
+        ++size;
+    return size;
+}
+
+inline char* writeVarint(char* out, uint64_t value) {
+    for (; value >= 0x80; value >>= 7)
+        *out++ = char(uint8_t(value) | 0x80);
+    *out++ = char(value);
+    return out;
+}
+
+inline const char* readVarint(const char* in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = uint8_t(*in++);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return in;
+    }
+}
+
+// Bounds checked readVarint() for untrusted input. Returns nullptr if the
+// value is truncated or longer than 64 bits.
+inline const char* readVarint(const char* in, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; in != end && shift < 64; shift += 7) {
+        uint8_t byte = uint8_t(*in++);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return in;
+    }
+    return nullptr;
+}
+
+} // namespace decodeless::detail
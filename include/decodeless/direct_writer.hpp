@@ -0,0 +1,442 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/io_uring.hpp>
+#include <decodeless/detail/unbuffered_file.hpp>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+// Writes a file, e.g. a RootHeader image, sequentially without going through
+// the page cache so large bakes do not evict other processes' working sets.
+// Data is copied into a ring of block aligned staging buffers, batching many
+// small writes into one per buffer. On Linux, full buffers are written with
+// io_uring, using the staging buffers as registered buffers and the file as a
+// fixed file. Submissions are batched and a completion thread returns written
+// buffers to the ring. Elsewhere, or if the kernel does not allow io_uring, a
+// background thread writes queued buffers instead. Either way the caller's
+// work overlaps with I/O. The final partial block is written zero padded and
+// the file is then truncated, so the result is byte identical to a buffered
+// write.
+class direct_writer {
+public:
+    static constexpr size_t BlockSize = 4096;
+    static constexpr size_t DefaultBufferSize = 8 << 20;
+    static constexpr size_t DefaultBufferCount = 2;
+
+    // useIoUring = false always uses the background write thread
+    explicit direct_writer(const std::filesystem::path& path,
+                           size_t bufferSize = DefaultBufferSize,
+                           size_t bufferCount = DefaultBufferCount, bool useIoUring = true)
+        : m_file(path, detail::unbuffered_file::Mode::Write)
+        , m_bufferSize(std::max(BlockSize, bufferSize / BlockSize * BlockSize)) {
+        for (size_t i = 0; i < std::max<size_t>(bufferCount, 2); ++i) {
+            m_buffers.push_back(allocate(m_bufferSize));
+            if (i)
+                m_free.push_back(m_buffers.back().get());
+        }
+        m_current = m_buffers.front().get();
+#if defined(DECODELESS_HAS_IO_URING)
+        if (useIoUring)
+            m_ring = openRing();
+        if (m_ring) {
+            m_worker = std::jthread([this] { complete(); });
+            return;
+        }
+#else
+        (void)useIoUring;
+#endif
+        m_worker = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+
+    direct_writer(const direct_writer&) = delete;
+    direct_writer& operator=(const direct_writer&) = delete;
+
+    // Discards the output unless finish() succeeded, e.g. when unwinding, so
+    // a partial file is never published looking complete. Call finish() to
+    // keep the output.
+    ~direct_writer() {
+        try {
+            discard();
+        } catch (...) {
+        }
+    }
+
+    // True if writes bypass the page cache
+    bool direct() const { return m_file.direct(); }
+
+    // True if writes are submitted with io_uring
+    bool ioUring() const {
+#if defined(DECODELESS_HAS_IO_URING)
+        return m_ring != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    // Bytes written so far
+    uint64_t size() const { return m_written + m_fill; }
+
+    // Appends data, blocking only while every staging buffer is in use
+    void write(std::span<const std::byte> data) {
+        while (!data.empty()) {
+            size_t take = std::min(data.size(), m_bufferSize - m_fill);
+            std::memcpy(m_current + m_fill, data.data(), take);
+            m_fill += take;
+            data = data.subspan(take);
+            if (m_fill == m_bufferSize)
+                submit(m_fill);
+        }
+    }
+
+    // Overwrites bytes already written, e.g. to back-patch a header list.
+    // offset and data.size() must be multiples of BlockSize unless the range
+    // ends at size().
+    void rewrite(uint64_t offset, std::span<const std::byte> data) {
+        uint64_t end = offset + data.size();
+        if (m_finished || end > size() || offset % BlockSize ||
+            (data.size() % BlockSize && end != size()))
+            throw std::invalid_argument("Unaligned or out of range rewrite");
+
+        // Bytes still in the current staging buffer
+        if (end > m_written) {
+            uint64_t begin = std::max(offset, m_written);
+            std::memcpy(m_current + (begin - m_written), data.data() + (begin - offset),
+                        size_t(end - begin));
+            data = data.first(size_t(begin - offset));
+        }
+
+        // Whole blocks already submitted, written once queued writes finish
+        if (!data.empty()) {
+            waitIdle();
+            Buffer staging = allocate(data.size());
+            std::memcpy(staging.get(), data.data(), data.size());
+            m_file.writeAt(offset, staging.get(), data.size());
+        }
+    }
+
+    // Writes the tail and waits for all I/O to complete. If any write fails,
+    // the output is discarded before the error is rethrown. A non-empty header
+    // then overwrites the start of the file, e.g. a root header and header
+    // list, so it only lands once all the data it describes has been written.
+    // header.size() must be a multiple of BlockSize unless it is size().
+    void finish(std::span<const std::byte> header = {}) {
+        if (m_finished)
+            return;
+        if (header.size() > size() || (header.size() % BlockSize && header.size() != size()))
+            throw std::invalid_argument("Unaligned or out of range finish header");
+        try {
+            uint64_t logicalSize = size();
+            if (m_fill) {
+                size_t padded = (m_fill + BlockSize - 1) / BlockSize * BlockSize;
+                std::memset(m_current + m_fill, 0, padded - m_fill);
+                submit(padded);
+            }
+            waitIdle();
+            stopWorker();
+            if (!header.empty()) {
+                size_t padded = (header.size() + BlockSize - 1) / BlockSize * BlockSize;
+                Buffer staging = allocate(padded);
+                std::memcpy(staging.get(), header.data(), header.size());
+                std::memset(staging.get() + header.size(), 0, padded - header.size());
+                m_file.writeAt(0, staging.get(), padded);
+            }
+            if (m_written != logicalSize)
+                m_file.truncate(logicalSize);
+            m_written = logicalSize;
+        } catch (...) {
+            try {
+                discard();
+            } catch (...) {
+            }
+            throw;
+        }
+        m_finished = true;
+    }
+
+    // Abandons the output, e.g. when unwinding before it is complete. Waits
+    // for queued writes, ignoring their errors, and truncates the file to
+    // zero bytes so no partial file is left behind.
+    void discard() {
+        if (m_finished)
+            return;
+        m_finished = true;
+        stopWorker();
+        m_file.truncate(0);
+        m_written = 0;
+        m_fill = 0;
+    }
+
+private:
+    struct AlignedDelete {
+        void operator()(std::byte* p) const { ::operator delete(p, std::align_val_t(BlockSize)); }
+    };
+    using Buffer = std::unique_ptr<std::byte[], AlignedDelete>;
+
+    static Buffer allocate(size_t size) {
+        return Buffer(static_cast<std::byte*>(::operator new(size, std::align_val_t(BlockSize))));
+    }
+
+    struct Job {
+        std::byte* data;
+        uint64_t   offset;
+        size_t     size;
+    };
+
+    // Queues the current buffer and continues in the next free one
+    void submit(size_t size) {
+        Job              job{m_current, m_written, size};
+        std::unique_lock lock(m_mutex);
+        throwError();
+#if defined(DECODELESS_HAS_IO_URING)
+        if (m_ring) {
+            pushRing(job);
+            // Batch submissions unless the caller would otherwise wait
+            if (m_free.empty() || m_ring->unsubmitted() >= m_submitBatch) {
+                lock.unlock();
+                flushRing();
+                lock.lock();
+            }
+        } else
+#endif
+        {
+            m_queue.push_back(job);
+            m_ready.notify_all();
+        }
+        m_done.wait(lock, [this] { return !m_free.empty() || m_error; });
+        throwError();
+        m_current = m_free.front();
+        m_free.pop_front();
+        lock.unlock();
+        m_written += size;
+        m_fill = 0;
+    }
+
+    // Called with m_mutex held
+    bool idle() const { return m_queue.empty() && !m_busy && m_inFlight == 0; }
+
+    void waitIdle() {
+#if defined(DECODELESS_HAS_IO_URING)
+        if (m_ring)
+            flushRing();
+#endif
+        std::unique_lock lock(m_mutex);
+        m_done.wait(lock, [this] { return idle() || m_error; });
+        throwError();
+    }
+
+    // Waits for all queued writes, ignoring errors, and stops the worker
+    void stopWorker() {
+        if (!m_worker.joinable())
+            return;
+#if defined(DECODELESS_HAS_IO_URING)
+        if (m_ring) {
+            flushRing();
+            {
+                std::unique_lock lock(m_mutex);
+                m_done.wait(lock, [this] { return idle(); });
+            }
+            io_uring_sqe stop{};
+            stop.opcode = IORING_OP_NOP;
+            stop.user_data = StopRing;
+            m_ring->push(stop);
+            flushRing();
+        }
+#endif
+        m_worker.request_stop();
+        m_worker.join();
+    }
+
+    // Called with m_mutex held
+    void throwError() {
+        if (m_error)
+            std::rethrow_exception(m_error);
+    }
+
+    // Writes queued buffers in order and returns them to the free list
+    void run(std::stop_token stop) {
+        std::unique_lock lock(m_mutex);
+        for (;;) {
+            if (!m_ready.wait(lock, stop, [this] { return !m_queue.empty(); }))
+                return;
+            Job job = m_queue.front();
+            m_queue.pop_front();
+            m_busy = true;
+            lock.unlock();
+            std::exception_ptr error;
+            try {
+                if (!m_error)
+                    m_file.writeAt(job.offset, job.data, job.size);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            lock.lock();
+            if (error && !m_error)
+                m_error = error;
+            m_busy = false;
+            m_free.push_back(job.data);
+            m_done.notify_all();
+        }
+    }
+
+#if defined(DECODELESS_HAS_IO_URING)
+    static constexpr uint64_t StopRing = ~uint64_t(0);
+
+    // Returns null if the kernel does not allow io_uring, e.g. in some
+    // containers. Writes still use io_uring, just without registered
+    // buffers, if pinning them fails, e.g. due to RLIMIT_MEMLOCK.
+    std::unique_ptr<detail::io_uring_queue> openRing() {
+        if (m_bufferSize > UINT32_MAX)
+            return nullptr;
+        std::unique_ptr<detail::io_uring_queue> ring;
+        try {
+            ring = std::make_unique<detail::io_uring_queue>(unsigned(m_buffers.size() + 1));
+            ring->registerFile(m_file.fd());
+        } catch (const std::system_error&) {
+            return nullptr;
+        }
+        std::vector<iovec> buffers;
+        for (const Buffer& buffer : m_buffers)
+            buffers.push_back({.iov_base = buffer.get(), .iov_len = m_bufferSize});
+        try {
+            ring->registerBuffers(buffers);
+            m_registered = true;
+        } catch (const std::system_error&) {
+        }
+        m_ringJobs.resize(m_buffers.size());
+        m_submitBatch = std::max<size_t>(1, m_buffers.size() / 2);
+        return ring;
+    }
+
+    // Queues a write of a staging buffer without submitting it. Caller thread
+    // only.
+    void pushRing(const Job& job) {
+        size_t index = size_t(std::ranges::find(m_buffers, job.data, &Buffer::get) -
+                              m_buffers.begin());
+        m_ringJobs[index] = job;
+        io_uring_sqe sqe{};
+        sqe.opcode = m_registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe.flags = IOSQE_FIXED_FILE;
+        sqe.fd = 0; // fixed file index
+        sqe.addr = reinterpret_cast<uintptr_t>(job.data);
+        sqe.len = uint32_t(job.size);
+        sqe.off = job.offset;
+        sqe.buf_index = uint16_t(index);
+        sqe.user_data = index;
+        m_ring->push(sqe);
+    }
+
+    // Submits queued writes with one system call. Caller thread only, without
+    // m_mutex held.
+    void flushRing() {
+        unsigned count = m_ring->unsubmitted();
+        if (!count)
+            return;
+        {
+            std::lock_guard lock(m_mutex);
+            m_inFlight += count; // before any can complete
+        }
+        try {
+            m_ring->submit();
+        } catch (...) {
+            std::lock_guard lock(m_mutex);
+            m_inFlight -= m_ring->unsubmitted();
+            if (!m_error)
+                m_error = std::current_exception();
+            m_done.notify_all();
+        }
+    }
+
+    // Completion thread. Returns written buffers to the free list. Short
+    // writes end on a block boundary and are finished synchronously.
+    void complete() {
+        for (;;) {
+            io_uring_cqe       cqe;
+            std::exception_ptr error;
+            try {
+                cqe = m_ring->wait();
+            } catch (...) {
+                // Nothing more can be reaped, so stop waiting for it
+                std::lock_guard lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+                m_inFlight = 0;
+                m_done.notify_all();
+                return;
+            }
+            if (cqe.user_data == StopRing)
+                return;
+            Job job = m_ringJobs[size_t(cqe.user_data)];
+            try {
+                if (cqe.res < 0)
+                    detail::throwErrno(-cqe.res, "File write failed");
+                if (cqe.res == 0)
+                    detail::throwErrno(EIO, "File write failed");
+                size_t written = size_t(cqe.res);
+                if (written < job.size)
+                    m_file.writeAt(job.offset + written, job.data + written, job.size - written);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard lock(m_mutex);
+            if (error && !m_error)
+                m_error = error;
+            --m_inFlight;
+            m_free.push_back(job.data);
+            m_done.notify_all();
+        }
+    }
+#endif
+
+    detail::unbuffered_file m_file;
+    size_t                  m_bufferSize;
+    std::vector<Buffer>     m_buffers;
+    std::byte*              m_current = nullptr;
+    size_t                  m_fill = 0;
+    uint64_t                m_written = 0; // bytes handed to the worker
+    bool                    m_finished = false;
+
+    std::mutex                  m_mutex;
+    std::condition_variable_any m_ready;
+    std::condition_variable     m_done;
+    std::deque<Job>             m_queue;
+    std::deque<std::byte*>      m_free;
+    bool                        m_busy = false;
+    size_t                      m_inFlight = 0; // io_uring writes submitted, not completed
+    std::exception_ptr          m_error;
+#if defined(DECODELESS_HAS_IO_URING)
+    std::unique_ptr<detail::io_uring_queue> m_ring;
+    std::vector<Job>                        m_ringJobs; // by staging buffer index
+    size_t                                  m_submitBatch = 1;
+    bool                                    m_registered = false;
+#endif
+    std::jthread m_worker; // last, so it stops before the rest
+};
+
+// Writes a complete in-memory image, e.g. a linear_memory_resource holding a
+// RootHeader and its sub-headers, with direct_writer
+inline void writeDirect(const std::filesystem::path& path, std::span<const std::byte> image,
+                        size_t bufferSize = direct_writer::DefaultBufferSize) {
+    direct_writer writer(path, bufferSize);
+    writer.write(image);
+    writer.finish();
+}
+
+} // namespace decodeless
@@ -0,0 +1,217 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <decodeless/chacha20poly1305.hpp>
+#include <decodeless/header.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+#endif
+
+namespace decodeless {
+
+// One encrypted sub-header. The ciphertext covers the sub-header, starting with
+// its Header base, and all payload it references. The region must be
+// contiguous and only reference itself via offset_ptr/offset_span so it remains
+// valid when decrypted to a different address.
+struct EncryptedHeaderEntry {
+    Magic                   identifier;
+    chacha20poly1305::Nonce nonce;
+    chacha20poly1305::Tag   tag;
+    offset_span<std::byte>  ciphertext;
+};
+
+// Sub-header listing encrypted sub-headers, sorted by identifier. Encrypted
+// sub-headers must not also be added to RootHeader::headers, so
+// RootHeader::find() never returns ciphertext. Use decrypted_headers to access
+// them.
+struct EncryptedHeaders : Header {
+    static constexpr Magic   HeaderIdentifier{"DL:ENCRYPTED"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    EncryptedHeaders()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+
+    offset_span<EncryptedHeaderEntry> entries;
+
+    const EncryptedHeaderEntry* find(const Magic& identifier) const {
+        auto result = std::lower_bound(entries.begin(), entries.end(), identifier, EntryComp());
+        return result != entries.end() && result->identifier == identifier ? &*result : nullptr;
+    }
+
+    // Comparison functor to facilitate find() and sorting entries
+    struct EntryComp {
+        inline bool operator()(const EncryptedHeaderEntry& a, const EncryptedHeaderEntry& b) {
+            return a.identifier < b.identifier;
+        }
+        inline bool operator()(const EncryptedHeaderEntry& a, const Magic& identifier) {
+            return a.identifier < identifier;
+        }
+    };
+};
+
+// The identifier is authenticated along with the ciphertext so entries cannot
+// be swapped
+inline std::span<const uint8_t> encryptedHeaderAad(const Magic& identifier) {
+    return {reinterpret_cast<const uint8_t*>(identifier.data()), identifier.size()};
+}
+
+// Encrypts region in place and fills entry to describe it. region must begin
+// with the sub-header's Header base. The nonce must be unique for each region
+// encrypted with the same key. Remember to sort EncryptedHeaders::entries.
+inline void encryptHeader(EncryptedHeaderEntry& entry, std::span<std::byte> region,
+                          const chacha20poly1305::Key& key, const chacha20poly1305::Nonce& nonce) {
+    assert(region.size() >= sizeof(Header));
+    if (region.size() / chacha20poly1305::BlockSize >= 0xffffffffull)
+        throw std::length_error("Encrypted header region too large");
+    entry.identifier = reinterpret_cast<const Header*>(region.data())->identifier;
+    entry.nonce = nonce;
+    entry.tag = chacha20poly1305::encrypt(key, nonce, encryptedHeaderAad(entry.identifier), region);
+    entry.ciphertext = region;
+}
+
+class decryption_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Reader side cache of decrypted sub-headers for one mapped file. Unencrypted
+// sub-headers are returned directly from the mapping. Encrypted ones are
+// authenticated and decrypted on first access into page aligned memory that is
+// locked where supported and wiped on destruction, as is the copy of the key.
+// Large regions are decrypted by multiple threads. Keep this alongside the
+// mapping; pointers it returns are invalid after either is destroyed.
+class decrypted_headers {
+public:
+    // Regions smaller than this are decrypted on the calling thread
+    static constexpr size_t ParallelThreshold = 1 << 20;
+
+    decrypted_headers(const RootHeader& root, const chacha20poly1305::Key& key)
+        : m_root(root)
+        , m_key(key) {}
+    ~decrypted_headers() { wipe(m_key.data(), m_key.size()); }
+
+    // Returns the header with the given identifier, decrypting it if needed.
+    // Throws decryption_error if an encrypted header fails authentication.
+    Header* find(const Magic& identifier) {
+        if (Header* plain = m_root.find(identifier))
+            return plain;
+        const EncryptedHeaders* encrypted = m_root.find<EncryptedHeaders>();
+        if (!encrypted)
+            return nullptr;
+        const EncryptedHeaderEntry* entry = encrypted->find(identifier);
+        if (!entry)
+            return nullptr;
+
+        std::lock_guard lock(m_mutex);
+        auto [it, inserted] = m_decrypted.try_emplace(identifier);
+        if (inserted) {
+            try {
+                it->second = decrypt(*entry);
+            } catch (...) {
+                m_decrypted.erase(it);
+                throw;
+            }
+        }
+        return reinterpret_cast<Header*>(it->second.get());
+    }
+
+    template <SubHeader HeaderType>
+    HeaderType* find() {
+        constexpr Magic headerIdentifier = HeaderType::HeaderIdentifier;
+        return reinterpret_cast<HeaderType*>(find(headerIdentifier));
+    }
+
+    template <VersionedSubHeader HeaderType>
+    HeaderType* findSupported() {
+        HeaderType*       result = find<HeaderType>();
+        constexpr Version versionSupported = HeaderType::VersionSupported;
+        return result && Version::binaryCompatible(versionSupported, result->version) ? result
+                                                                                      : nullptr;
+    }
+
+private:
+    static constexpr size_t PageSize = 4096;
+
+    // Volatile stores so the compiler cannot drop them as dead
+    static void wipe(void* p, size_t size) {
+        volatile auto* v = static_cast<std::byte*>(p);
+        for (size_t i = 0; i < size; ++i)
+            v[i] = std::byte(0);
+    }
+
+    struct SecureDelete {
+        size_t size = 0;
+        bool   locked = false; // mlock() succeeded
+        void   operator()(std::byte* p) const {
+            wipe(p, size);
+#if defined(__unix__) || defined(__APPLE__)
+            if (locked)
+                munlock(p, size);
+#endif
+            ::operator delete(p, std::align_val_t(PageSize));
+        }
+    };
+    using Buffer = std::unique_ptr<std::byte[], SecureDelete>;
+
+    Buffer decrypt(const EncryptedHeaderEntry& entry) const {
+        std::span<const std::byte> ciphertext(entry.ciphertext.data(), entry.ciphertext.size());
+        if (!chacha20poly1305::tagEqual(
+                chacha20poly1305::computeTag(m_key, entry.nonce,
+                                             encryptedHeaderAad(entry.identifier), ciphertext),
+                entry.tag))
+            throw decryption_error("Encrypted header failed authentication");
+
+        size_t size = ciphertext.size();
+        Buffer buffer(static_cast<std::byte*>(::operator new(size, std::align_val_t(PageSize))),
+                      SecureDelete{size});
+#if defined(__unix__) || defined(__APPLE__)
+        // Best effort; may fail due to RLIMIT_MEMLOCK
+        buffer.get_deleter().locked = mlock(buffer.get(), size) == 0;
+#endif
+        std::span<std::byte> plaintext(buffer.get(), size);
+
+        // Split into whole ChaCha20 blocks so each thread can compute its own
+        // starting counter
+        size_t threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                          size / ParallelThreshold);
+        if (threads <= 1) {
+            chacha20poly1305::xorKeystream(m_key, entry.nonce, 1, ciphertext, plaintext);
+            return buffer;
+        }
+        size_t blocks = (size + chacha20poly1305::BlockSize - 1) / chacha20poly1305::BlockSize;
+        size_t blocksPerThread = (blocks + threads - 1) / threads;
+        {
+            std::vector<std::jthread> workers;
+            for (size_t i = 0; i < threads; ++i) {
+                size_t begin = std::min(size, i * blocksPerThread * chacha20poly1305::BlockSize);
+                size_t end = std::min(size, begin + blocksPerThread * chacha20poly1305::BlockSize);
+                auto   counter = uint32_t(1 + i * blocksPerThread);
+                workers.emplace_back([&, begin, end, counter] {
+                    chacha20poly1305::xorKeystream(m_key, entry.nonce, counter,
+                                                   ciphertext.subspan(begin, end - begin),
+                                                   plaintext.subspan(begin, end - begin));
+                });
+            }
+        }
+        return buffer;
+    }
+
+    const RootHeader&       m_root;
+    chacha20poly1305::Key   m_key;
+    std::mutex              m_mutex;
+    std::map<Magic, Buffer> m_decrypted;
+};
+
+} // namespace decodeless
@@ -0,0 +1,310 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/header.hpp>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+// 128-bit digest of the inputs a sub-header was generated from
+struct Fingerprint : std::array<uint8_t, 16> {};
+
+// Incremental MurmurHash3 x64 128-bit. Fast and well distributed for change
+// detection but not cryptographic; use a cryptographic digest of the inputs if
+// they may be adversarial.
+class fingerprint_hasher {
+public:
+    explicit fingerprint_hasher(uint64_t seed = 0)
+        : m_h1(seed)
+        , m_h2(seed) {}
+
+    fingerprint_hasher& update(std::span<const std::byte> data) {
+        m_length += data.size();
+        if (m_pending) {
+            size_t take = std::min(data.size(), BlockSize - m_pending);
+            std::memcpy(m_buffer.data() + m_pending, data.data(), take);
+            m_pending += take;
+            data = data.subspan(take);
+            if (m_pending < BlockSize)
+                return *this;
+            block(m_buffer.data());
+            m_pending = 0;
+        }
+        for (; data.size() >= BlockSize; data = data.subspan(BlockSize))
+            block(data.data());
+        std::memcpy(m_buffer.data(), data.data(), data.size());
+        m_pending = data.size();
+        return *this;
+    }
+
+    fingerprint_hasher& update(std::string_view text) {
+        return update(std::as_bytes(std::span(text.data(), text.size())));
+    }
+
+    // Hashes the bytes of a trivially copyable value, e.g. a file timestamp
+    template <class T>
+        requires std::is_trivially_copyable_v<T>
+    fingerprint_hasher& updateValue(const T& value) {
+        return update(std::as_bytes(std::span(&value, 1)));
+    }
+
+    Fingerprint finish() const {
+        uint64_t h1 = m_h1, h2 = m_h2;
+        uint64_t k1 = 0, k2 = 0;
+        for (size_t i = m_pending; i-- > 8;)
+            k2 = (k2 << 8) | uint64_t(m_buffer[i]);
+        for (size_t i = std::min<size_t>(m_pending, 8); i-- > 0;)
+            k1 = (k1 << 8) | uint64_t(m_buffer[i]);
+        if (m_pending > 8)
+            h2 ^= std::rotl(k2 * C2, 33) * C1;
+        if (m_pending)
+            h1 ^= std::rotl(k1 * C1, 31) * C2;
+        h1 ^= m_length;
+        h2 ^= m_length;
+        h1 += h2;
+        h2 += h1;
+        h1 = mix(h1);
+        h2 = mix(h2);
+        h1 += h2;
+        h2 += h1;
+
+        Fingerprint result;
+        for (size_t i = 0; i < 8; ++i) {
+            result[i] = uint8_t(h1 >> (8 * i));
+            result[i + 8] = uint8_t(h2 >> (8 * i));
+        }
+        return result;
+    }
+
+private:
+    static constexpr size_t   BlockSize = 16;
+    static constexpr uint64_t C1 = 0x87c37b91114253d5ull;
+    static constexpr uint64_t C2 = 0x4cf5ad432745937full;
+
+    static uint64_t load64(const std::byte* p) {
+        uint64_t result = 0;
+        for (size_t i = 8; i-- > 0;)
+            result = (result << 8) | uint64_t(p[i]);
+        return result;
+    }
+
+    static uint64_t mix(uint64_t k) {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void block(const std::byte* p) {
+        uint64_t k1 = load64(p), k2 = load64(p + 8);
+        m_h1 ^= std::rotl(k1 * C1, 31) * C2;
+        m_h1 = (std::rotl(m_h1, 27) + m_h2) * 5 + 0x52dce729;
+        m_h2 ^= std::rotl(k2 * C2, 33) * C1;
+        m_h2 = (std::rotl(m_h2, 31) + m_h1) * 5 + 0x38495ab5;
+    }
+
+    uint64_t                         m_h1;
+    uint64_t                         m_h2;
+    uint64_t                         m_length = 0;
+    std::array<std::byte, BlockSize> m_buffer{};
+    size_t                           m_pending = 0;
+};
+
+// Fingerprint and location of one sub-header and its payload. Offsets are in
+// bytes from the start of the file.
+struct FingerprintEntry {
+    Magic       identifier;
+    Fingerprint fingerprint;
+    uint64_t    extentOffset = 0;
+    uint64_t    extentSize = 0;
+    uint64_t    extentAlignment = 1; // largest alignment of any allocation in the extent
+    uint64_t    headerOffset = 0;    // of the sub-header within the extent
+};
+
+// Sub-header recording the input fingerprint of each sub-header written by an
+// incremental_builder, sorted by identifier. It sits alongside the other
+// sub-headers so Header itself and existing files are unchanged.
+struct Fingerprints : Header {
+    static constexpr Magic   HeaderIdentifier{"DL:FINGERPRINTS"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    Fingerprints()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+
+    offset_span<FingerprintEntry> entries;
+
+    const FingerprintEntry* find(const Magic& identifier) const {
+        auto it = std::ranges::lower_bound(entries, identifier, {}, &FingerprintEntry::identifier);
+        return it != entries.end() && it->identifier == identifier ? &*it : nullptr;
+    }
+};
+
+// Builds a file like streaming_writer, but each sub-header is given the
+// fingerprint of its inputs. If the previous build of the file has a matching
+// fingerprint, the sub-header and its payload are cloned with a single copy
+// instead of being regenerated. Each sub-header's payload must be allocated
+// contiguously right after it and must not point outside its own extent;
+// use header_ref for references to other sub-headers.
+template <class RootType, class MemoryResource>
+class incremental_builder {
+public:
+    // previous is the last build of the file, e.g. mapped, or empty. Throws
+    // std::runtime_error if its header list or fingerprints lie outside it.
+    template <class... Args>
+    incremental_builder(MemoryResource& memory, size_t headerCount,
+                        std::span<const std::byte> previous, Args&&... rootArgs)
+        : m_memory(memory)
+        , m_previous(previous) {
+        m_root = detail::allocateObject<RootType>(memory, std::forward<Args>(rootArgs)...);
+        m_root->headers = detail::allocateArray<offset_ptr<Header>>(memory, headerCount + 1);
+        m_previousFingerprints = previousFingerprints();
+    }
+
+    // Returns the sub-header HeaderType, either cloned from the previous file
+    // or default constructed and passed to generate(header, memory) to fill
+    // in. generate must allocate the payload from the memory it is given.
+    template <SubHeader HeaderType, class Generate>
+    HeaderType* build(const Fingerprint& fingerprint, Generate&& generate) {
+        constexpr Magic identifier = HeaderType::HeaderIdentifier;
+        if (m_next + 1 == m_root->headers.size())
+            throw std::length_error("More sub-headers created than reserved");
+
+        HeaderType* header = nullptr;
+        if (const FingerprintEntry* entry = previousEntry(identifier, fingerprint)) {
+            // Keep the extent's offset modulo its largest alignment so every
+            // allocation inside it stays aligned
+            uint64_t   skew = entry->extentOffset % entry->extentAlignment;
+            void*      region = m_memory.allocate(size_t(skew + entry->extentSize),
+                                                  size_t(entry->extentAlignment));
+            std::byte* dst = static_cast<std::byte*>(region) + skew;
+            std::memcpy(dst, m_previous.data() + entry->extentOffset, size_t(entry->extentSize));
+            header = reinterpret_cast<HeaderType*>(dst + entry->headerOffset);
+            record(identifier, fingerprint, dst, dst + entry->extentSize, entry->extentAlignment,
+                   entry->headerOffset);
+            ++m_cloned;
+        } else {
+            tracking_resource tracking{m_memory};
+            header = detail::allocateObject<HeaderType>(tracking);
+            auto* begin = reinterpret_cast<std::byte*>(header);
+            generate(*header, tracking);
+            record(identifier, fingerprint, begin, tracking.end, tracking.alignment, 0);
+            ++m_generated;
+        }
+        m_root->headers[m_next++] = header;
+        return header;
+    }
+
+    // Sub-headers cloned from the previous file and regenerated so far
+    size_t clonedCount() const { return m_cloned; }
+    size_t generatedCount() const { return m_generated; }
+
+    // Writes the Fingerprints sub-header and sorts the header list
+    RootType* finish() {
+        if (m_next + 1 != m_root->headers.size())
+            throw std::logic_error("Fewer sub-headers created than reserved");
+        auto* fingerprints = detail::allocateObject<Fingerprints>(m_memory);
+        std::ranges::sort(m_entries, {}, &FingerprintEntry::identifier);
+        auto entries = detail::allocateArray<FingerprintEntry>(m_memory, m_entries.size());
+        std::ranges::copy(m_entries, entries.begin());
+        fingerprints->entries = entries;
+        m_root->headers[m_next++] = fingerprints;
+        std::ranges::sort(m_root->headers, RootHeader::HeaderPtrComp());
+        return m_root;
+    }
+
+private:
+    // Forwards allocations, recording the end of the extent and the largest
+    // alignment used
+    struct tracking_resource {
+        MemoryResource& memory;
+        std::byte*      end = nullptr;
+        size_t          alignment = 1;
+
+        void* allocate(size_t bytes, size_t align) {
+            auto* result = static_cast<std::byte*>(memory.allocate(bytes, align));
+            end = std::max(end, result + bytes);
+            alignment = std::max(alignment, align);
+            return result;
+        }
+        void deallocate(void* p, size_t bytes) { memory.deallocate(p, bytes); }
+    };
+
+    // Throws if the previous file's header list or fingerprints point outside
+    // of it, e.g. when it is truncated
+    const Fingerprints* previousFingerprints() const {
+        if (m_previous.size() < sizeof(RootHeader))
+            return nullptr;
+        auto* root = reinterpret_cast<const RootHeader*>(m_previous.data());
+        if (!root->magicValid() || !root->binaryCompatible())
+            return nullptr;
+        auto check = [&](const void* ptr, uint64_t count, size_t size) {
+            auto offset = uint64_t(reinterpret_cast<uintptr_t>(ptr) -
+                                   reinterpret_cast<uintptr_t>(m_previous.data()));
+            if (offset > m_previous.size() || (m_previous.size() - offset) / size < count)
+                throw std::runtime_error("Corrupt previous file");
+        };
+        if (!root->headers.empty())
+            check(root->headers.data(), root->headers.size(), sizeof(offset_ptr<Header>));
+        for (const offset_ptr<Header>& header : root->headers)
+            check(header.get(), 1, sizeof(Header));
+        const Fingerprints* fingerprints = root->findSupported<Fingerprints>();
+        if (fingerprints) {
+            check(fingerprints, 1, sizeof(Fingerprints));
+            if (!fingerprints->entries.empty())
+                check(fingerprints->entries.data(), fingerprints->entries.size(),
+                      sizeof(FingerprintEntry));
+        }
+        return fingerprints;
+    }
+
+    const FingerprintEntry* previousEntry(const Magic& identifier, const Fingerprint& fingerprint) {
+        if (!m_previousFingerprints)
+            return nullptr;
+        const FingerprintEntry* entry = m_previousFingerprints->find(identifier);
+        if (!entry || entry->fingerprint != fingerprint)
+            return nullptr;
+        if (entry->extentOffset > m_previous.size() ||
+            m_previous.size() - entry->extentOffset < entry->extentSize ||
+            entry->headerOffset > entry->extentSize ||
+            entry->extentSize - entry->headerOffset < sizeof(Header) ||
+            !std::has_single_bit(entry->extentAlignment))
+            throw std::runtime_error("Corrupt fingerprint entry in previous file");
+        return entry;
+    }
+
+    void record(const Magic& identifier, const Fingerprint& fingerprint, std::byte* begin,
+                std::byte* end, uint64_t alignment, uint64_t headerOffset) {
+        auto* base = reinterpret_cast<std::byte*>(m_root);
+        m_entries.push_back(FingerprintEntry{.identifier = identifier,
+                                             .fingerprint = fingerprint,
+                                             .extentOffset = uint64_t(begin - base),
+                                             .extentSize = uint64_t(end - begin),
+                                             .extentAlignment = alignment,
+                                             .headerOffset = headerOffset});
+    }
+
+    MemoryResource&               m_memory;
+    std::span<const std::byte>    m_previous;
+    const Fingerprints*           m_previousFingerprints = nullptr;
+    RootType*                     m_root = nullptr;
+    size_t                        m_next = 0;
+    size_t                        m_cloned = 0;
+    size_t                        m_generated = 0;
+    std::vector<FingerprintEntry> m_entries;
+};
+
+} // namespace decodeless
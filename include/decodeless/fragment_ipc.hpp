@@ -0,0 +1,322 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+// Multi-process linking: child processes build fragments in anonymous shared
+// files and pass the file descriptors to the parent over a Unix domain socket.
+// POSIX only.
+#if !defined(_WIN32)
+
+    #include <algorithm>
+    #include <cerrno>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstdlib>
+    #include <cstring>
+    #include <decodeless/detail/system_error.hpp>
+    #include <decodeless/linker.hpp>
+    #include <filesystem>
+    #include <memory>
+    #include <span>
+    #include <string>
+    #include <system_error>
+    #include <utility>
+    #include <vector>
+
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+
+namespace decodeless {
+
+namespace detail {
+
+// Sends data on a stream socket, with fd attached via SCM_RIGHTS unless it is
+// -1
+inline void sendMessage(int socket, std::span<const std::byte> data, int fd = -1) {
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    int                   flags = 0;
+    #if defined(MSG_NOSIGNAL)
+    flags = MSG_NOSIGNAL; // report a closed peer as EPIPE
+    #endif
+    while (!data.empty()) {
+        iovec  vector{.iov_base = const_cast<std::byte*>(data.data()), .iov_len = data.size()};
+        msghdr message{};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        if (fd != -1) {
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fd, sizeof(fd));
+        }
+        ssize_t sent = ::sendmsg(socket, &message, flags);
+        if (sent == -1) {
+            if (errno == EINTR)
+                continue;
+            throwErrno("Socket send failed");
+        }
+        data = data.subspan(size_t(sent));
+        fd = -1; // attached to the first byte only
+    }
+}
+
+// Receives up to data.size() bytes with a single recvmsg(). The first file
+// descriptor attached via SCM_RIGHTS is stored in fd if it is still -1; any
+// others, e.g. several in one message or one per call, are closed so an
+// untrusted peer cannot leak descriptors into this process. Truncated control
+// data is an error. Returns the bytes received, 0 if the peer closed the
+// socket or -1 if a non-blocking socket has nothing to read.
+inline ssize_t receivePart(int socket, std::span<std::byte> data, int& fd) {
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    int                   flags = 0;
+    #if defined(MSG_CMSG_CLOEXEC)
+    flags = MSG_CMSG_CLOEXEC;
+    #endif
+    iovec  vector{.iov_base = data.data(), .iov_len = data.size()};
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = ::recvmsg(socket, &message, flags);
+    } while (received == -1 && errno == EINTR);
+    if (received == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        throwErrno("Socket receive failed");
+    }
+    bool truncated = (message.msg_flags & MSG_CTRUNC) != 0;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header;
+         header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int receivedFd;
+            std::memcpy(&receivedFd, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (fd == -1 && !truncated)
+                fd = receivedFd;
+            else
+                ::close(receivedFd);
+        }
+    }
+    if (truncated)
+        throwErrno(EMSGSIZE, "Truncated socket control message");
+    return received;
+}
+
+// Receives exactly data.size() bytes and any attached file descriptor, which
+// the caller then owns. Returns false if the peer closed the socket before
+// sending anything. fd is -1 after an exception.
+inline bool receiveMessage(int socket, std::span<std::byte> data, int& fd) {
+    fd = -1;
+    size_t total = 0;
+    try {
+        while (total < data.size()) {
+            ssize_t received = receivePart(socket, data.subspan(total), fd);
+            if (received == -1)
+                throwErrno(EAGAIN, "Socket receive timed out");
+            if (received == 0) {
+                if (total == 0)
+                    return false;
+                throwErrno(ECONNRESET, "Truncated message");
+            }
+            total += size_t(received);
+        }
+    } catch (...) {
+        if (fd != -1)
+            ::close(fd);
+        fd = -1;
+        throw;
+    }
+    return true;
+}
+
+} // namespace detail
+
+// An anonymous, file descriptor backed fragment: a memfd on Linux, otherwise
+// an unlinked temporary file. A child process writes a complete decodeless
+// file into it and sends it with sendFragment(), which seals it. The parent
+// maps it read only to plan the link, and the payload is copied to the output
+// in the kernel. On Linux, receiveFragment() only accepts sealed memfds, so
+// the bytes copied are the ones planLink() validated. Elsewhere there are no
+// seals and the parent must trust children not to modify a fragment after
+// sending it.
+class shared_fragment {
+public:
+    shared_fragment() = default;
+
+    // Takes ownership of an open file descriptor
+    explicit shared_fragment(int fd)
+        : m_fd(fd) {}
+
+    static shared_fragment create(const char* name = "decodeless-fragment") {
+    #if defined(__linux__)
+        int fd = ::memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    #else
+        std::string path =
+            (std::filesystem::temp_directory_path() / (std::string(name) + "-XXXXXX")).string();
+        int fd = ::mkstemp(path.data());
+        if (fd != -1)
+            ::unlink(path.c_str());
+    #endif
+        if (fd == -1)
+            detail::throwErrno("Failed to create fragment file");
+        return shared_fragment(fd);
+    }
+
+    shared_fragment(shared_fragment&& other) noexcept
+        : m_fd(std::exchange(other.m_fd, -1))
+        , m_mapping(std::exchange(other.m_mapping, {})) {}
+    shared_fragment& operator=(shared_fragment&& other) noexcept {
+        if (this != &other) {
+            close();
+            m_fd = std::exchange(other.m_fd, -1);
+            m_mapping = std::exchange(other.m_mapping, {});
+        }
+        return *this;
+    }
+    ~shared_fragment() { close(); }
+
+    int  fd() const { return m_fd; }
+    explicit operator bool() const { return m_fd != -1; }
+
+    uint64_t size() const {
+        struct stat info{};
+        if (::fstat(m_fd, &info) == -1)
+            detail::throwErrno("Fragment size query failed");
+        return uint64_t(info.st_size);
+    }
+
+    // Replaces the contents, e.g. with a linear_memory_resource image
+    void assign(std::span<const std::byte> image) {
+        unmap();
+        if (::ftruncate(m_fd, off_t(image.size())) == -1)
+            detail::throwErrno("Fragment resize failed");
+        detail::pwriteAll(m_fd, image.data(), image.size(), 0, "Fragment write failed");
+    }
+
+    // Makes the contents immutable: no process holding the file descriptor
+    // can write, grow or shrink it afterwards. A no-op without memfd seals.
+    void seal() const {
+    #if defined(__linux__)
+        if (::fcntl(m_fd, F_ADD_SEALS, RequiredSeals) == -1)
+            detail::throwErrno("Fragment seal failed");
+    #endif
+    }
+
+    // True if seal() has been called, by this or another process
+    bool sealed() const {
+    #if defined(__linux__)
+        int seals = ::fcntl(m_fd, F_GET_SEALS);
+        return seals != -1 && (seals & RequiredSeals) == RequiredSeals;
+    #else
+        return true;
+    #endif
+    }
+
+    // Maps the contents read only, e.g. for planLink(). Only the pages that
+    // are read, such as headers and link tables, are touched.
+    std::span<const std::byte> map() {
+        if (m_mapping.empty()) {
+            uint64_t bytes = size();
+            if (bytes == 0)
+                return {};
+            void* data = ::mmap(nullptr, size_t(bytes), PROT_READ, MAP_SHARED, m_fd, 0);
+            if (data == MAP_FAILED)
+                detail::throwErrno("Fragment map failed");
+            m_mapping = {static_cast<const std::byte*>(data), size_t(bytes)};
+        }
+        return m_mapping;
+    }
+
+private:
+    #if defined(__linux__)
+    static constexpr int RequiredSeals = F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK;
+    #endif
+
+    void unmap() {
+        if (!m_mapping.empty())
+            ::munmap(const_cast<std::byte*>(m_mapping.data()), m_mapping.size());
+        m_mapping = {};
+    }
+    void close() {
+        unmap();
+        if (m_fd != -1)
+            ::close(m_fd);
+        m_fd = -1;
+    }
+
+    int                        m_fd = -1;
+    std::span<const std::byte> m_mapping;
+};
+
+// Seals a fragment and sends its file descriptor over a connected Unix domain
+// socket with SCM_RIGHTS. The sender may close its copy afterwards.
+inline void sendFragment(int socket, const shared_fragment& fragment) {
+    fragment.seal();
+    char tag = 'F';
+    detail::sendMessage(socket, std::as_bytes(std::span(&tag, 1)), fragment.fd());
+}
+
+// Receives a fragment sent with sendFragment(). Returns an empty fragment if
+// the peer closed the socket.
+inline shared_fragment receiveFragment(int socket) {
+    char tag = 0;
+    int  fd = -1;
+    if (!detail::receiveMessage(socket, std::as_writable_bytes(std::span(&tag, 1)), fd))
+        return {};
+    shared_fragment result(fd);
+    if (tag != 'F' || !result)
+        throw link_error("Unexpected message instead of a fragment");
+    if (!result.sealed())
+        throw link_error("Fragment is not sealed");
+    return result;
+}
+
+// Writes a linked file to the file descriptor out, like the ostream
+// writeLinked(), but copies each fragment with copy_file_range() so payloads
+// never pass through user space. Relocation sites are patched in place
+// afterwards.
+inline void writeLinked(const LinkPlan& plan, std::span<const shared_fragment> fragments,
+                        const Magic& identifier, int out) {
+    if (fragments.size() != plan.fragments.size())
+        throw link_error("Fragment count does not match the plan");
+
+    // Sizing first leaves the padding between fragments as zeros
+    if (::ftruncate(out, off_t(plan.size)) == -1)
+        detail::throwErrno("Output resize failed");
+    std::vector<std::byte> prefix = linkedPrefix(plan, identifier);
+    detail::pwriteAll(out, prefix.data(), prefix.size(), 0, "Output write failed");
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        const LinkPlan::Fragment& placed = plan.fragments[i];
+        if (detail::copyFileRange(fragments[i].fd(), 0, out, placed.offset, placed.size,
+                                  "Fragment copy failed") != placed.size)
+            throw link_error("Fragment shorter than planned");
+        for (const LinkPlan::Patch& patch : placed.patches)
+            detail::pwriteAll(out, &patch.value, sizeof(patch.value), placed.offset + patch.site,
+                              "Output write failed");
+    }
+}
+
+// Links fragments received from child processes into out
+inline void link(std::span<shared_fragment> fragments, const Magic& identifier, int out) {
+    std::vector<std::span<const std::byte>> images;
+    for (shared_fragment& fragment : fragments)
+        images.push_back(fragment.map());
+    writeLinked(planLink(images), fragments, identifier, out);
+}
+
+} // namespace decodeless
+
+#endif
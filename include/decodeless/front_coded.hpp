@@ -0,0 +1,212 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/detail/varint.hpp>
+#include <decodeless/offset_span.hpp>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace decodeless {
+
+namespace detail {
+
+// First 8 bytes of s, big endian and zero padded, so integer order matches
+// lexicographic byte order for differing prefixes
+inline uint64_t stringPrefix(std::string_view s) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < 8; ++i)
+        result = (result << 8) | (i < s.size() ? uint8_t(s[i]) : 0);
+    return result;
+}
+
+} // namespace detail
+
+// Sorted string set stored with front coding, embeddable in a Header subclass.
+// Keys are grouped in blocks of BlockSize. Each block stores its first key in
+// full and the rest as the length shared with the previous key plus the
+// remaining suffix, which shares the redundancy a trie would on sorted keys
+// at a fraction of the size of separate strings and offsets. Lookups binary
+// search an inline 8 byte prefix of each block's first key, then decode one
+// block sequentially. Build with buildFrontCodedDictionary().
+struct FrontCodedDictionary {
+    static constexpr size_t BlockSize = 16;
+
+    uint64_t              size = 0;
+    offset_span<uint64_t> headPrefixes; // detail::stringPrefix() of each block's first key
+    offset_span<uint64_t> blockOffsets; // byte offset of each block in data, plus the end
+    offset_span<char>     data;
+
+    // Decodes keys in order from a starting ordinal, reusing one buffer
+    class cursor {
+    public:
+        cursor(const FrontCodedDictionary& dictionary, uint64_t ordinal)
+            : m_dictionary(dictionary)
+            , m_ordinal(ordinal - ordinal % BlockSize) {
+            if (m_ordinal < dictionary.size) {
+                loadBlock();
+                while (m_ordinal < ordinal)
+                    next();
+            }
+        }
+
+        bool             valid() const { return m_ordinal < m_dictionary.size; }
+        uint64_t         ordinal() const { return m_ordinal; }
+        std::string_view key() const { return m_key; }
+
+        void next() {
+            if (++m_ordinal >= m_dictionary.size)
+                return;
+            if (m_ordinal % BlockSize == 0) {
+                loadBlock();
+                return;
+            }
+            uint64_t shared, suffix;
+            m_pos = detail::readVarint(m_pos, shared);
+            m_pos = detail::readVarint(m_pos, suffix);
+            m_key.resize(size_t(shared));
+            m_key.append(m_pos, size_t(suffix));
+            m_pos += suffix;
+        }
+
+    private:
+        void loadBlock() {
+            uint64_t length;
+            m_pos = m_dictionary.data.data() + m_dictionary.blockOffsets[m_ordinal / BlockSize];
+            m_pos = detail::readVarint(m_pos, length);
+            m_key.assign(m_pos, size_t(length));
+            m_pos += length;
+        }
+
+        const FrontCodedDictionary& m_dictionary;
+        uint64_t                    m_ordinal;
+        const char*                 m_pos = nullptr;
+        std::string                 m_key;
+    };
+
+    // Key with the given ordinal, for ordinal < size
+    std::string key(uint64_t ordinal) const { return std::string(cursor(*this, ordinal).key()); }
+
+    // Ordinal of the first key not less than key, or size
+    uint64_t lower_bound(std::string_view key) const {
+        if (size == 0)
+            return 0;
+
+        // Last block whose first key is <= key. The inline prefixes resolve
+        // most comparisons without touching data.
+        uint64_t prefix = detail::stringPrefix(key);
+        size_t   lo = 0, hi = headPrefixes.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            bool   headLessEqual = headPrefixes[mid] != prefix ? headPrefixes[mid] < prefix
+                                                               : blockHead(mid) <= key;
+            if (headLessEqual)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == 0)
+            return 0;
+        for (cursor c(*this, (lo - 1) * BlockSize); c.valid(); c.next())
+            if (c.key() >= key || c.ordinal() == lo * BlockSize)
+                return c.ordinal();
+        return size;
+    }
+
+    // Ordinal of key, if present
+    std::optional<uint64_t> find(std::string_view key) const {
+        uint64_t ordinal = lower_bound(key);
+        if (ordinal < size && cursor(*this, ordinal).key() == key)
+            return ordinal;
+        return std::nullopt;
+    }
+
+    bool contains(std::string_view key) const { return find(key).has_value(); }
+
+    // Calls fn(ordinal, key) in order for each key starting with prefix. The
+    // key view is only valid during the call.
+    template <class Fn>
+    void forEachPrefix(std::string_view prefix, Fn&& fn) const {
+        for (cursor c(*this, lower_bound(prefix)); c.valid() && c.key().starts_with(prefix);
+             c.next())
+            fn(c.ordinal(), c.key());
+    }
+
+private:
+    std::string_view blockHead(size_t block) const {
+        uint64_t    length;
+        const char* pos = detail::readVarint(data.data() + blockOffsets[block], length);
+        return {pos, size_t(length)};
+    }
+};
+
+// Builds a dictionary from a forward range of strictly increasing keys
+// convertible to std::string_view. Makes two passes, the first to size the
+// output, so memory use beyond the output is a single key.
+template <class MemoryResource, std::ranges::forward_range Keys>
+void buildFrontCodedDictionary(FrontCodedDictionary& result, MemoryResource& memory,
+                               const Keys& sortedKeys) {
+    constexpr size_t B = FrontCodedDictionary::BlockSize;
+
+    // Calls fn(ordinal, key, shared) with the length shared with the previous
+    // key, or SIZE_MAX for the first key of a block
+    auto encode = [&](auto&& fn) {
+        uint64_t    ordinal = 0;
+        std::string previous;
+        for (const auto& element : sortedKeys) {
+            std::string_view key(element);
+            if (ordinal && key <= previous)
+                throw std::invalid_argument("Keys must be sorted and unique");
+            size_t shared = SIZE_MAX;
+            if (ordinal % B)
+                shared = size_t(std::ranges::mismatch(key, previous).in1 - key.begin());
+            fn(ordinal++, key, shared);
+            previous.assign(key);
+        }
+        return ordinal;
+    };
+
+    size_t   bytes = 0;
+    uint64_t size = encode([&](uint64_t, std::string_view key, size_t shared) {
+        if (shared == SIZE_MAX)
+            bytes += detail::varintSize(key.size()) + key.size();
+        else
+            bytes += detail::varintSize(shared) + detail::varintSize(key.size() - shared) +
+                     key.size() - shared;
+    });
+
+    size_t              blocks = (size + B - 1) / B;
+    std::span<uint64_t> headPrefixes = detail::allocateArray<uint64_t>(memory, blocks);
+    std::span<uint64_t> blockOffsets = detail::allocateArray<uint64_t>(memory, blocks + 1);
+    std::span<char>     data = detail::allocateArray<char>(memory, bytes);
+    char*               out = data.data();
+    encode([&](uint64_t ordinal, std::string_view key, size_t shared) {
+        if (shared == SIZE_MAX) {
+            headPrefixes[ordinal / B] = detail::stringPrefix(key);
+            blockOffsets[ordinal / B] = uint64_t(out - data.data());
+            out = detail::writeVarint(out, key.size());
+            out = std::ranges::copy(key, out).out;
+        } else {
+            out = detail::writeVarint(out, shared);
+            out = detail::writeVarint(out, key.size() - shared);
+            out = std::ranges::copy(key.substr(shared), out).out;
+        }
+    });
+    blockOffsets[blocks] = bytes;
+
+    result.size = size;
+    result.headPrefixes = headPrefixes;
+    result.blockOffsets = blockOffsets;
+    result.data = data;
+}
+
+} // namespace decodeless
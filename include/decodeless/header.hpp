@@ -9,6 +9,8 @@
 #include <cstdint>
 #include <decodeless/offset_ptr.hpp>
 #include <decodeless/offset_span.hpp>
+#include <stdexcept>
+#include <string>
 #include <string_view>
 
 namespace decodeless {
@@ -52,6 +54,16 @@ struct Magic : public std::array<char, 16> {
         static_assert(N - 1 <= 16, "Magic must be at most 16 bytes");
         std::copy_n(str, N - 1, this->begin());
     }
+
+    // For identifiers built at runtime, e.g. one per generated sub-header.
+    // Throws std::length_error if str is longer than 16 bytes.
+    explicit constexpr Magic(std::string_view str)
+        : std::array<char, 16>() {
+        if (str.size() > 16)
+            throw std::length_error("Magic must be at most 16 bytes: " + std::string(str));
+        std::fill(this->begin(), this->end(), 0);
+        std::copy_n(str.begin(), str.size(), this->begin());
+    }
 };
 
 enum PlatformFlags {
@@ -98,10 +110,8 @@ struct RootHeader {
     RootHeader(Magic identifier)
         : identifier(identifier){};
 
-    // Find and cast a specific header
-    template <SubHeader HeaderType>
-    inline HeaderType* find() const {
-        constexpr Magic      headerIdentifier = HeaderType::HeaderIdentifier;
+    // Find a header by its identifier
+    inline Header* find(const Magic& headerIdentifier) const {
         HeaderList::iterator result;
         if (headers.size() < 16) {
             result = std::find_if(headers.begin(), headers.end(),
@@ -115,7 +125,14 @@ struct RootHeader {
                 result = headers.end();
             }
         }
-        return result == headers.end() ? nullptr : reinterpret_cast<HeaderType*>(result->get());
+        return result == headers.end() ? nullptr : result->get();
+    }
+
+    // Find and cast a specific header
+    template <SubHeader HeaderType>
+    inline HeaderType* find() const {
+        constexpr Magic headerIdentifier = HeaderType::HeaderIdentifier;
+        return reinterpret_cast<HeaderType*>(find(headerIdentifier));
     }
 
     template <VersionedSubHeader HeaderType>
@@ -0,0 +1,105 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/header.hpp>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+namespace decodeless {
+
+// Caches RootHeader::find() results for one mapping. Lookups are resolved on
+// first use and are then a hash lookup under a shared lock. Safe to use from
+// multiple threads. Create one per mapping and keep it alongside it.
+class header_cache {
+public:
+    explicit header_cache(const RootHeader& root)
+        : m_root(root) {}
+    header_cache(const header_cache&) = delete;
+    header_cache& operator=(const header_cache&) = delete;
+
+    const RootHeader& root() const { return m_root; }
+
+    Header* find(const Magic& identifier) const {
+        {
+            std::shared_lock lock(m_mutex);
+            auto             it = m_headers.find(identifier);
+            if (it != m_headers.end())
+                return it->second;
+        }
+        Header*          result = m_root.find(identifier);
+        std::unique_lock lock(m_mutex);
+        m_headers.emplace(identifier, result);
+        return result;
+    }
+
+    template <SubHeader HeaderType>
+    HeaderType* find() const {
+        constexpr Magic headerIdentifier = HeaderType::HeaderIdentifier;
+        return reinterpret_cast<HeaderType*>(find(headerIdentifier));
+    }
+
+private:
+    struct MagicHash {
+        size_t operator()(const Magic& magic) const {
+            return std::hash<std::string_view>()(std::string_view(magic.data(), magic.size()));
+        }
+    };
+
+    const RootHeader&                                     m_root;
+    mutable std::shared_mutex                             m_mutex;
+    mutable std::unordered_map<Magic, Header*, MagicHash> m_headers;
+};
+
+// Symbolic reference to a T inside another sub-header, stored as the target
+// sub-header's identifier and the byte offset of the T from its start. Unlike
+// an offset_ptr, the reference stays valid when the target sub-header is
+// rewritten or moved, e.g. by an append update, as long as its layout is
+// unchanged. A default constructed reference is null.
+template <class T>
+struct header_ref {
+    Magic    target;
+    uint64_t offset = 0;
+
+    header_ref() = default;
+
+    // Reference to a sub-header itself
+    template <SubHeader HeaderType>
+        requires std::is_convertible_v<HeaderType*, T*>
+    header_ref(const HeaderType& header)
+        : target(header.identifier)
+        , offset(uint64_t(reinterpret_cast<const std::byte*>(static_cast<const T*>(&header)) -
+                          reinterpret_cast<const std::byte*>(&header))) {}
+
+    // Reference to an object owned by the sub-header header
+    header_ref(const Header& header, const T* object)
+        : target(header.identifier)
+        , offset(uint64_t(reinterpret_cast<const std::byte*>(object) -
+                          reinterpret_cast<const std::byte*>(&header))) {}
+
+    explicit operator bool() const { return target != Magic(); }
+
+    // Resolves with a linear or binary search of the header list. Returns
+    // nullptr if the reference is null or the target is missing.
+    T* resolve(const RootHeader& root) const { return *this ? at(root.find(target)) : nullptr; }
+
+    // Resolves through a per-mapping cache, O(1) after the target's first
+    // lookup
+    T* resolve(const header_cache& cache) const {
+        return *this ? at(cache.find(target)) : nullptr;
+    }
+
+private:
+    T* at(Header* header) const {
+        return header ? reinterpret_cast<T*>(reinterpret_cast<std::byte*>(header) + offset)
+                      : nullptr;
+    }
+};
+
+} // namespace decodeless
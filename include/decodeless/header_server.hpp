@@ -0,0 +1,352 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+// Serves sub-headers of mapped, validated files to other local processes over
+// a Unix domain socket. POSIX only.
+#if !defined(_WIN32)
+
+    #include <chrono>
+    #include <cstddef>
+    #include <cstdint>
+    #include <cstring>
+    #include <decodeless/fragment_ipc.hpp>
+    #include <decodeless/header.hpp>
+    #include <filesystem>
+    #include <map>
+    #include <memory>
+    #include <mutex>
+    #include <shared_mutex>
+    #include <span>
+    #include <stdexcept>
+    #include <stop_token>
+    #include <string>
+    #include <thread>
+    #include <vector>
+
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+
+namespace decodeless {
+
+class header_server_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+struct HeaderRequest {
+    char     file[256] = {}; // null terminated name given to header_server::add()
+    Magic    identifier;
+    uint64_t generation = 0; // of the client's mapping of the file, 0 if none
+};
+
+struct HeaderResponse {
+    enum Status : uint32_t { Ok, UnknownFile, UnknownHeader };
+    uint32_t status = Ok;
+    uint64_t generation = 0; // changes each time a name is added
+    uint64_t fileSize = 0;
+    uint64_t headerOffset = 0;
+};
+
+inline sockaddr_un socketAddress(const std::filesystem::path& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::string name = path.string();
+    if (name.size() >= sizeof(address.sun_path))
+        throw header_server_error("Socket path too long: " + name);
+    std::memcpy(address.sun_path, name.c_str(), name.size() + 1);
+    return address;
+}
+
+// Closes a socket file descriptor on scope exit
+struct socket_handle {
+    int fd = -1;
+    explicit socket_handle(int handle)
+        : fd(handle) {
+        if (fd == -1)
+            throwErrno("Socket creation failed");
+    }
+    socket_handle(const socket_handle&) = delete;
+    socket_handle& operator=(const socket_handle&) = delete;
+    ~socket_handle() { ::close(fd); }
+};
+
+} // namespace detail
+
+// Keeps decodeless files open, mapped and validated, and answers requests for
+// their sub-headers from header_client. Replies carry the file descriptor and
+// the sub-header's offset, so clients map the file themselves and share its
+// page cache pages without opening or validating it. Requests are answered
+// by a single background thread; each is a lookup, so this is not a
+// bottleneck for local clients. Client sockets are non-blocking and partial
+// requests are buffered per client, so a slow client never holds up the
+// others. Clients that take longer than ClientTimeout to send a whole request
+// or that stop reading replies are disconnected.
+class header_server {
+public:
+    explicit header_server(const std::filesystem::path& socketPath)
+        : m_path(socketPath)
+        , m_listen(::socket(AF_UNIX, SOCK_STREAM, 0)) {
+        sockaddr_un address = detail::socketAddress(socketPath);
+        std::filesystem::remove(socketPath);
+        auto* generic = reinterpret_cast<const sockaddr*>(&address);
+        if (::bind(m_listen.fd, generic, sizeof(address)) == -1 ||
+            ::listen(m_listen.fd, SOMAXCONN) == -1)
+            detail::throwErrno("Failed to listen on the header server socket");
+        m_thread = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+    header_server(const header_server&) = delete;
+    header_server& operator=(const header_server&) = delete;
+    ~header_server() {
+        m_thread.request_stop();
+        m_thread.join();
+        for (const Client& client : m_clients)
+            ::close(client.fd);
+        std::error_code ignored;
+        std::filesystem::remove(m_path, ignored);
+    }
+
+    // Opens, maps and validates a file and serves it as name. Replaces any
+    // file previously served under that name for subsequent requests.
+    void add(const std::string& name, const std::filesystem::path& path) {
+        if (name.size() >= sizeof(detail::HeaderRequest::file))
+            throw header_server_error("File name too long: " + name);
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            detail::throwErrno("Failed to open served file");
+        auto file = std::make_shared<File>(shared_fragment(fd));
+        index(*file);
+        std::unique_lock lock(m_mutex);
+        file->generation = ++m_generation;
+        m_files[name] = std::move(file);
+    }
+
+    static constexpr std::chrono::milliseconds ClientTimeout{200};
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Client {
+        int                   fd = -1;
+        detail::HeaderRequest request;
+        size_t                received = 0; // bytes of request so far
+        Clock::time_point     deadline;     // for the rest of a started request
+    };
+
+    struct File {
+        shared_fragment           file;
+        std::map<Magic, uint64_t> headers; // sub-header offsets by identifier
+        uint64_t                  generation = 0;
+    };
+
+    static void index(File& file) {
+        std::span<const std::byte> data = file.file.map();
+        auto invalid = [] { return header_server_error("Not a valid decodeless file"); };
+        if (data.size() < sizeof(RootHeader))
+            throw invalid();
+        auto* root = reinterpret_cast<const RootHeader*>(data.data());
+        if (!root->magicValid() || !root->binaryCompatible())
+            throw invalid();
+        auto offsetOf = [&](const void* ptr, size_t size) {
+            auto offset = uint64_t(reinterpret_cast<uintptr_t>(ptr) -
+                                   reinterpret_cast<uintptr_t>(data.data()));
+            if (offset > data.size() || data.size() - offset < size)
+                throw invalid();
+            return offset;
+        };
+        if (!root->headers.empty())
+            offsetOf(root->headers.data(), root->headers.size() * sizeof(offset_ptr<Header>));
+        for (const offset_ptr<Header>& header : root->headers)
+            file.headers[header->identifier] = offsetOf(header.get(), sizeof(Header));
+    }
+
+    void run(std::stop_token stop) {
+        while (!stop.stop_requested()) {
+            std::vector<pollfd> fds{{.fd = m_listen.fd, .events = POLLIN, .revents = 0}};
+            for (const Client& client : m_clients)
+                fds.push_back({.fd = client.fd, .events = POLLIN, .revents = 0});
+            if (::poll(fds.data(), nfds_t(fds.size()), PollInterval) == -1)
+                continue;
+            Clock::time_point now = Clock::now();
+            for (size_t i = 0; i < m_clients.size(); ++i) {
+                Client& client = m_clients[i];
+                bool    keep = fds[i + 1].revents ? receive(client, now) : true;
+                if (!keep || (client.received && now > client.deadline)) {
+                    ::close(client.fd);
+                    client.fd = -1;
+                }
+            }
+            std::erase_if(m_clients, [](const Client& client) { return client.fd == -1; });
+            if (fds[0].revents & POLLIN)
+                acceptClient();
+        }
+    }
+
+    void acceptClient() {
+        int fd = ::accept(m_listen.fd, nullptr, nullptr);
+        if (fd == -1)
+            return;
+        if (::fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 ||
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+            ::close(fd);
+            return;
+        }
+        m_clients.emplace_back().fd = fd;
+    }
+
+    // Reads what is available of the client's current request and answers it
+    // once complete. Returns false once the client disconnects or misbehaves.
+    bool receive(Client& client, Clock::time_point now) {
+        try {
+            auto    request = std::as_writable_bytes(std::span(&client.request, 1));
+            int     unexpected = -1;
+            ssize_t received =
+                detail::receivePart(client.fd, request.subspan(client.received), unexpected);
+            if (unexpected != -1) {
+                ::close(unexpected);
+                return false;
+            }
+            if (received == -1)
+                return true;
+            if (received == 0)
+                return false;
+            if (client.received == 0)
+                client.deadline = now + ClientTimeout;
+            client.received += size_t(received);
+            if (client.received < request.size())
+                return true;
+            client.received = 0;
+            serve(client.fd, client.request);
+            return true;
+        } catch (const std::system_error&) {
+            return false;
+        }
+    }
+
+    // Answers one complete request. The reply is small, so a send that would
+    // block means the client has stopped reading and throws.
+    void serve(int client, detail::HeaderRequest& request) {
+        request.file[sizeof(request.file) - 1] = '\0';
+        std::shared_ptr<const File> file;
+        {
+            std::shared_lock lock(m_mutex);
+            auto             it = m_files.find(request.file);
+            if (it != m_files.end())
+                file = it->second;
+        }
+        detail::HeaderResponse response;
+        int                    fd = -1;
+        if (!file) {
+            response.status = detail::HeaderResponse::UnknownFile;
+        } else if (auto it = file->headers.find(request.identifier); it == file->headers.end()) {
+            response.status = detail::HeaderResponse::UnknownHeader;
+        } else {
+            response.generation = file->generation;
+            response.fileSize = file->file.size();
+            response.headerOffset = it->second;
+            if (request.generation != file->generation)
+                fd = file->file.fd();
+        }
+        detail::sendMessage(client, std::as_bytes(std::span(&response, 1)), fd);
+    }
+
+    static constexpr int PollInterval = 50; // ms between stop checks
+
+    std::filesystem::path                               m_path;
+    detail::socket_handle                               m_listen;
+    std::shared_mutex                                   m_mutex;
+    std::map<std::string, std::shared_ptr<const File>> m_files;
+    uint64_t                                            m_generation = 0;
+    std::vector<Client>                                 m_clients; // server thread only
+    std::jthread                                        m_thread;  // last, so it stops first
+};
+
+// Connects to a header_server and returns sub-headers of the files it serves.
+// Each file is mapped read only on first use and stays mapped, so returned
+// pointers are valid for the client's lifetime. If the server replaces a file,
+// the next request maps the new one; the old mapping is kept for pointers
+// already returned. Safe to use from multiple threads.
+class header_client {
+public:
+    explicit header_client(const std::filesystem::path& socketPath)
+        : m_socket(::socket(AF_UNIX, SOCK_STREAM, 0)) {
+        sockaddr_un address = detail::socketAddress(socketPath);
+        if (::connect(m_socket.fd, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)) == -1)
+            detail::throwErrno("Failed to connect to the header server");
+    }
+
+    // Returns the sub-header or nullptr if the file does not have it. Throws
+    // header_server_error if the server does not serve the file.
+    const Header* find(const std::string& file, const Magic& identifier) {
+        detail::HeaderRequest request;
+        if (file.size() >= sizeof(request.file))
+            throw header_server_error("File name too long: " + file);
+        std::memcpy(request.file, file.c_str(), file.size() + 1);
+        request.identifier = identifier;
+
+        std::lock_guard lock(m_mutex);
+        auto            mapped = m_files.find(file);
+        if (mapped != m_files.end())
+            request.generation = mapped->second.generation;
+        detail::sendMessage(m_socket.fd, std::as_bytes(std::span(&request, 1)));
+        detail::HeaderResponse response;
+        int                    fd = -1;
+        if (!detail::receiveMessage(m_socket.fd,
+                                    std::as_writable_bytes(std::span(&response, 1)), fd))
+            throw header_server_error("Header server closed the connection");
+        shared_fragment received(fd);
+        if (response.status == detail::HeaderResponse::UnknownFile)
+            throw header_server_error("Header server does not serve " + file);
+        if (response.status == detail::HeaderResponse::UnknownHeader)
+            return nullptr;
+        if (mapped == m_files.end() || mapped->second.generation != response.generation) {
+            if (!received)
+                throw header_server_error("Header server did not send the file");
+            Mapping& mapping = m_files[file];
+            if (mapping.file)
+                m_retired.push_back(std::move(mapping.file));
+            mapping = Mapping{std::move(received), response.generation};
+            mapped = m_files.find(file);
+        }
+        std::span<const std::byte> data = mapped->second.file.map();
+        if (response.headerOffset > data.size() ||
+            data.size() - response.headerOffset < sizeof(Header))
+            throw header_server_error("Header server returned an invalid offset");
+        return reinterpret_cast<const Header*>(data.data() + response.headerOffset);
+    }
+
+    template <SubHeader HeaderType>
+    const HeaderType* find(const std::string& file) {
+        constexpr Magic headerIdentifier = HeaderType::HeaderIdentifier;
+        return reinterpret_cast<const HeaderType*>(find(file, headerIdentifier));
+    }
+
+    template <VersionedSubHeader HeaderType>
+    const HeaderType* findSupported(const std::string& file) {
+        const HeaderType* result = find<HeaderType>(file);
+        constexpr Version versionSupported = HeaderType::VersionSupported;
+        return result && Version::binaryCompatible(versionSupported, result->version) ? result
+                                                                                       : nullptr;
+    }
+
+private:
+    struct Mapping {
+        shared_fragment file;
+        uint64_t        generation = 0;
+    };
+
+    detail::socket_handle          m_socket;
+    std::mutex                     m_mutex;
+    std::map<std::string, Mapping> m_files;
+    std::vector<shared_fragment>   m_retired; // replaced files, still mapped
+};
+
+} // namespace decodeless
+
+#endif
@@ -0,0 +1,268 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/header.hpp>
+#include <map>
+#include <new>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace decodeless {
+
+// An offset_ptr in a fragment that must point at data in another fragment.
+// Offsets are in bytes from the start of the fragment.
+struct Relocation {
+    uint64_t site = 0;   // offset of the offset_ptr to patch
+    Magic    target;     // sub-header the pointer refers to
+    uint64_t addend = 0; // bytes past the target sub-header, within its fragment
+};
+
+// Sub-header in a fragment listing its references to sub-headers defined in
+// other fragments. The fragment's own header list is its symbol table.
+struct LinkTable : Header {
+    static constexpr Magic   HeaderIdentifier{"DL:LINKTABLE"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    LinkTable()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+
+    offset_span<Relocation> relocations;
+};
+
+// Collects the external references of a fragment while it is written. Leave
+// referencing offset_ptrs null; the linker fills them in.
+class link_table_builder {
+public:
+    // root is the fragment's RootHeader, at the start of the fragment
+    explicit link_table_builder(const RootHeader* root)
+        : m_base(reinterpret_cast<const std::byte*>(root)) {}
+
+    template <class T>
+    void reference(offset_ptr<T>& site, const Magic& target, uint64_t addend = 0) {
+        m_relocations.push_back(Relocation{
+            .site = uint64_t(reinterpret_cast<const std::byte*>(&site) - m_base),
+            .target = target,
+            .addend = addend});
+    }
+
+    // Allocates the LinkTable sub-header. Add it to the fragment's header
+    // list like any other sub-header.
+    template <class MemoryResource>
+    LinkTable* create(MemoryResource& memory) const {
+        auto* table = detail::allocateObject<LinkTable>(memory);
+        auto  relocations = detail::allocateArray<Relocation>(memory, m_relocations.size());
+        std::ranges::copy(m_relocations, relocations.begin());
+        table->relocations = relocations;
+        return table;
+    }
+
+private:
+    const std::byte*        m_base;
+    std::vector<Relocation> m_relocations;
+};
+
+class link_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Output layout and patches computed by planLink(). Kept separate from
+// writing so the same plan can drive different output methods.
+struct LinkPlan {
+    static constexpr uint64_t Alignment = 4096;
+
+    struct Patch {
+        uint64_t site = 0;  // offset within the fragment
+        int64_t  value = 0; // new self-relative offset for the offset_ptr
+    };
+
+    struct Fragment {
+        uint64_t           offset = 0; // placement in the output
+        uint64_t           size = 0;
+        std::vector<Patch> patches; // sorted by site
+    };
+
+    // Sub-header offsets in the output by identifier, excluding link tables
+    std::map<Magic, uint64_t> symbols;
+    std::vector<Fragment>     fragments;
+    uint64_t                  prefixSize = 0; // root header and merged header list
+    uint64_t                  size = 0;
+};
+
+namespace detail {
+
+inline std::string magicString(const Magic& magic) {
+    return std::string(magic.begin(), std::find(magic.begin(), magic.end(), '\0'));
+}
+
+inline uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Byte offset of ptr from base if the object of the given size lies within
+// [base, base + size)
+inline uint64_t fragmentOffset(std::span<const std::byte> fragment, const void* ptr,
+                               size_t objectSize) {
+    auto offset = uint64_t(reinterpret_cast<uintptr_t>(ptr) -
+                           reinterpret_cast<uintptr_t>(fragment.data()));
+    if (!ptr || offset > fragment.size() || fragment.size() - offset < objectSize)
+        throw link_error("Pointer outside of its fragment");
+    return offset;
+}
+
+} // namespace detail
+
+// Places each fragment at a page aligned offset after a new root header and
+// merged header list, and resolves every fragment's relocations against the
+// sub-headers of all fragments. Fragments are complete decodeless files, e.g.
+// mapped, with a LinkTable if they reference other fragments.
+inline LinkPlan planLink(std::span<const std::span<const std::byte>> fragments) {
+    static_assert(sizeof(offset_ptr<Header>) == sizeof(int64_t));
+    LinkPlan plan;
+
+    // Count sub-headers to size the prefix, then place the fragments
+    std::vector<const RootHeader*> roots;
+    size_t                         headerCount = 0;
+    for (std::span<const std::byte> fragment : fragments) {
+        if (fragment.size() < sizeof(RootHeader))
+            throw link_error("Truncated fragment");
+        auto* root = reinterpret_cast<const RootHeader*>(fragment.data());
+        if (!root->magicValid() || !root->binaryCompatible())
+            throw link_error("Fragment is not a compatible decodeless file");
+        if (!root->headers.empty())
+            detail::fragmentOffset(fragment, root->headers.data(),
+                                   root->headers.size() * sizeof(offset_ptr<Header>));
+        for (const offset_ptr<Header>& header : root->headers)
+            detail::fragmentOffset(fragment, header.get(), sizeof(Header));
+        headerCount += root->headers.size() - (root->find(LinkTable::HeaderIdentifier) ? 1 : 0);
+        roots.push_back(root);
+    }
+    plan.prefixSize = sizeof(RootHeader) + headerCount * sizeof(offset_ptr<Header>);
+    uint64_t offset = detail::alignUp(plan.prefixSize, LinkPlan::Alignment);
+    for (std::span<const std::byte> fragment : fragments) {
+        plan.fragments.push_back({.offset = offset, .size = fragment.size(), .patches = {}});
+        offset = detail::alignUp(offset + fragment.size(), LinkPlan::Alignment);
+    }
+    plan.size = plan.fragments.empty()
+                    ? plan.prefixSize
+                    : plan.fragments.back().offset + plan.fragments.back().size;
+
+    // Symbol table
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        for (const offset_ptr<Header>& header : roots[i]->headers) {
+            uint64_t headerOffset = detail::fragmentOffset(fragments[i], header.get(),
+                                                           sizeof(Header));
+            if (header->identifier == LinkTable::HeaderIdentifier)
+                continue;
+            if (!plan.symbols.emplace(header->identifier, plan.fragments[i].offset + headerOffset)
+                     .second)
+                throw link_error("Duplicate sub-header " + detail::magicString(header->identifier));
+        }
+    }
+
+    // Relocations
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        auto* table = roots[i]->find<LinkTable>();
+        if (!table)
+            continue;
+        detail::fragmentOffset(fragments[i], table, sizeof(LinkTable));
+        if (!table->relocations.empty())
+            detail::fragmentOffset(fragments[i], table->relocations.data(),
+                                   table->relocations.size() * sizeof(Relocation));
+        LinkPlan::Fragment& placed = plan.fragments[i];
+        for (const Relocation& relocation : table->relocations) {
+            if (relocation.site > fragments[i].size() ||
+                fragments[i].size() - relocation.site < sizeof(int64_t))
+                throw link_error("Relocation site outside of its fragment");
+            auto symbol = plan.symbols.find(relocation.target);
+            if (symbol == plan.symbols.end())
+                throw link_error("Undefined sub-header " + detail::magicString(relocation.target));
+            // Symbols lie within their fragment, so this finds the target's
+            const LinkPlan::Fragment& target =
+                *(std::ranges::upper_bound(plan.fragments, symbol->second, {},
+                                           &LinkPlan::Fragment::offset) -
+                  1);
+            if (relocation.addend > target.offset + target.size - symbol->second)
+                throw link_error("Relocation addend outside of its target fragment");
+            int64_t value = int64_t(symbol->second + relocation.addend) -
+                            int64_t(placed.offset + relocation.site);
+            placed.patches.push_back({relocation.site, value});
+        }
+        std::ranges::sort(placed.patches, {}, &LinkPlan::Patch::site);
+        for (size_t p = 1; p < placed.patches.size(); ++p)
+            if (placed.patches[p].site - placed.patches[p - 1].site < sizeof(int64_t))
+                throw link_error("Overlapping relocation sites");
+    }
+    return plan;
+}
+
+// Writes the root header and merged, sorted header list for a plan. The
+// result is plan.prefixSize bytes.
+inline std::vector<std::byte> linkedPrefix(const LinkPlan& plan, const Magic& identifier) {
+    // Build in an aligned buffer so the offset_span in RootHeader can be set
+    // normally, then copy out
+    static_assert(alignof(RootHeader) <= alignof(uint64_t));
+    std::vector<uint64_t> storage((plan.prefixSize + 7) / 8, 0);
+    auto*                 buffer = reinterpret_cast<std::byte*>(storage.data());
+    auto*                 root = new (buffer) RootHeader(identifier);
+    auto* list = reinterpret_cast<offset_ptr<Header>*>(buffer + sizeof(RootHeader));
+    root->headers = std::span<offset_ptr<Header>>(list, plan.symbols.size());
+
+    // The symbol map is ordered by identifier, matching HeaderPtrComp. Entries
+    // point past this buffer, so write the self-relative offsets directly.
+    size_t i = 0;
+    for (const auto& [magic, offset] : plan.symbols) {
+        uint64_t site = sizeof(RootHeader) + i++ * sizeof(offset_ptr<Header>);
+        int64_t  value = int64_t(offset) - int64_t(site);
+        std::memcpy(buffer + site, &value, sizeof(value));
+    }
+    return std::vector<std::byte>(buffer, buffer + plan.prefixSize);
+}
+
+// Writes the linked file front to back: the prefix, then each fragment copied
+// verbatim except for its patched relocation sites, with zero padding
+// between. Stale root headers and link tables remain in the fragments but are
+// no longer referenced.
+inline void writeLinked(const LinkPlan& plan, std::span<const std::span<const std::byte>> fragments,
+                        const Magic& identifier, std::ostream& out) {
+    auto write = [&](const void* data, uint64_t size) {
+        if (!out.write(static_cast<const char*>(data), std::streamsize(size)))
+            throw link_error("Failed to write linked file");
+    };
+    auto pad = [&](uint64_t from, uint64_t to) {
+        static constexpr char zeros[LinkPlan::Alignment] = {};
+        write(zeros, to - from);
+    };
+
+    std::vector<std::byte> prefix = linkedPrefix(plan, identifier);
+    write(prefix.data(), prefix.size());
+    uint64_t position = prefix.size();
+    for (size_t i = 0; i < fragments.size(); ++i) {
+        const LinkPlan::Fragment& placed = plan.fragments[i];
+        pad(position, placed.offset);
+        uint64_t copied = 0;
+        for (const LinkPlan::Patch& patch : placed.patches) {
+            write(fragments[i].data() + copied, patch.site - copied);
+            write(&patch.value, sizeof(patch.value));
+            copied = patch.site + sizeof(patch.value);
+        }
+        write(fragments[i].data() + copied, placed.size - copied);
+        position = placed.offset + placed.size;
+    }
+}
+
+// Links fragments into a single decodeless file written to out
+inline void link(std::span<const std::span<const std::byte>> fragments, const Magic& identifier,
+                 std::ostream& out) {
+    writeLinked(planLink(fragments), fragments, identifier, out);
+}
+
+} // namespace decodeless
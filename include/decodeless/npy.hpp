@@ -0,0 +1,273 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/system_error.hpp>
+#include <istream>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Reading and writing NumPy .npy files. The payload of a .npy file is a raw
+// array, so it can be read straight into memory allocated for an offset_span
+// and written straight out of one, with no per-element conversion. On POSIX,
+// copyData() also copies a payload between files in the kernel.
+namespace decodeless::npy {
+
+class format_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+inline constexpr std::string_view MagicString = "\x93NUMPY";
+
+// Longest header dict readHeader() accepts. NumPy writes a few hundred bytes
+// but v2/v3 length fields allow 4 GiB.
+inline constexpr size_t MaxHeaderLength = 64 << 10;
+
+// Parsed .npy header
+struct Info {
+    std::string         descr;
+    bool                fortranOrder = false;
+    std::vector<size_t> shape;
+
+    // Byte offset of the payload from the start of the file, e.g. for
+    // copyData() or mmap()
+    size_t dataOffset = 0;
+
+    // Throws format_error if the product overflows
+    size_t count() const {
+        size_t result = 1;
+        for (size_t dim : shape) {
+            if (dim && result > std::numeric_limits<size_t>::max() / dim)
+                throw format_error("Overflowing .npy shape");
+            result *= dim;
+        }
+        return result;
+    }
+};
+
+// NumPy array-protocol type string for T in native byte order, e.g. "<i4"
+template <class T>
+    requires std::is_arithmetic_v<T>
+std::string dtype() {
+    char kind = 'u';
+    if constexpr (std::is_same_v<T, bool>)
+        kind = 'b';
+    else if constexpr (std::is_floating_point_v<T>)
+        kind = 'f';
+    else if constexpr (std::is_signed_v<T>)
+        kind = 'i';
+    char order = std::endian::native == std::endian::little ? '<' : '>';
+    if constexpr (sizeof(T) == 1)
+        order = '|';
+    return std::string{order, kind} + std::to_string(sizeof(T));
+}
+
+// Returns the complete .npy preamble for an array. The total size is padded to
+// a multiple of alignment, which NumPy requires to be at least 64. Pass the
+// page size to keep the payload page aligned in the file.
+inline std::string header(std::string_view descr, std::span<const size_t> shape,
+                          bool fortranOrder = false, size_t alignment = 64) {
+    if (alignment == 0)
+        throw std::invalid_argument(".npy header alignment must be non-zero");
+    std::string dict = "{'descr': '" + std::string(descr) + "', 'fortran_order': " +
+                       (fortranOrder ? "True" : "False") + ", 'shape': (";
+    for (size_t i = 0; i < shape.size(); ++i)
+        dict += (i ? ", " : "") + std::to_string(shape[i]);
+    dict += shape.size() == 1 ? ",)" : ")";
+    dict += ", }";
+
+    // Version 1.0 stores a 16 bit header length, 2.0 a 32 bit one
+    size_t      preamble = MagicString.size() + 2 + 2;
+    size_t      total = (preamble + dict.size() + 1 + alignment - 1) / alignment * alignment;
+    bool        version2 = total - preamble > 0xffff;
+    std::string result(MagicString);
+    if (version2) {
+        preamble += 2;
+        total = (preamble + dict.size() + 1 + alignment - 1) / alignment * alignment;
+    }
+    size_t headerLength = total - preamble;
+    result += char(version2 ? 2 : 1);
+    result += char(0);
+    for (size_t i = 0; i < (version2 ? 4u : 2u); ++i)
+        result += char((headerLength >> (i * 8)) & 0xff);
+    result += dict;
+    result.resize(total - 1, ' ');
+    result += '\n';
+    return result;
+}
+
+template <class T>
+std::string header(std::span<const size_t> shape, size_t alignment = 64) {
+    return header(dtype<T>(), shape, false, alignment);
+}
+
+namespace detail {
+
+inline std::string_view dictValue(std::string_view dict, std::string_view key) {
+    size_t pos = dict.find("'" + std::string(key) + "'");
+    if (pos == dict.npos)
+        throw format_error("Missing .npy header key " + std::string(key));
+    pos = dict.find(':', pos);
+    if (pos == dict.npos)
+        throw format_error("Malformed .npy header");
+    pos = dict.find_first_not_of(' ', pos + 1);
+    return pos == dict.npos ? std::string_view() : dict.substr(pos);
+}
+
+} // namespace detail
+
+// Parses the .npy header dictionary
+inline Info parseHeader(std::string_view dict, size_t dataOffset) {
+    Info             info;
+    std::string_view descr = detail::dictValue(dict, "descr");
+    if (descr.empty() || (descr[0] != '\'' && descr[0] != '"'))
+        throw format_error("Unsupported .npy descr");
+    size_t descrEnd = descr.find(descr[0], 1);
+    if (descrEnd == descr.npos)
+        throw format_error("Malformed .npy descr");
+    info.descr = std::string(descr.substr(1, descrEnd - 1));
+
+    std::string_view fortranOrder = detail::dictValue(dict, "fortran_order");
+    if (fortranOrder.starts_with("True"))
+        info.fortranOrder = true;
+    else if (!fortranOrder.starts_with("False"))
+        throw format_error("Malformed .npy fortran_order");
+
+    std::string_view shape = detail::dictValue(dict, "shape");
+    if (shape.empty() || shape[0] != '(')
+        throw format_error("Malformed .npy shape");
+    shape = shape.substr(1, shape.find(')') - 1);
+    while (!shape.empty()) {
+        size_t dim = 0;
+        size_t i = shape.find_first_not_of(" ,");
+        if (i == shape.npos)
+            break;
+        shape.remove_prefix(i);
+        if (shape[0] < '0' || shape[0] > '9')
+            throw format_error("Malformed .npy shape");
+        for (i = 0; i < shape.size() && shape[i] >= '0' && shape[i] <= '9'; ++i) {
+            size_t digit = size_t(shape[i] - '0');
+            if (dim > (std::numeric_limits<size_t>::max() - digit) / 10)
+                throw format_error("Overflowing .npy shape");
+            dim = dim * 10 + digit;
+        }
+        info.shape.push_back(dim);
+        shape.remove_prefix(i);
+    }
+    info.count();
+    info.dataOffset = dataOffset;
+    return info;
+}
+
+// Reads the .npy preamble, leaving in at the start of the payload
+inline Info readHeader(std::istream& in) {
+    char preamble[12];
+    if (!in.read(preamble, 8) || std::string_view(preamble, 6) != MagicString)
+        throw format_error("Not a .npy file");
+    uint8_t major = uint8_t(preamble[6]);
+    if (major < 1 || major > 3)
+        throw format_error("Unsupported .npy version");
+    size_t lengthBytes = major == 1 ? 2 : 4;
+    if (!in.read(preamble + 8, lengthBytes))
+        throw format_error("Truncated .npy header");
+    size_t length = 0;
+    for (size_t i = 0; i < lengthBytes; ++i)
+        length |= size_t(uint8_t(preamble[8 + i])) << (i * 8);
+    if (length > MaxHeaderLength)
+        throw format_error("Oversized .npy header");
+    std::string dict(length, '\0');
+    if (!in.read(dict.data(), length))
+        throw format_error("Truncated .npy header");
+    return parseHeader(dict, 8 + lengthBytes + length);
+}
+
+namespace detail {
+
+// Checks info describes an array of T that can be read in place and returns its
+// size in bytes
+template <class T>
+size_t payloadBytes(const Info& info) {
+    if (info.descr != dtype<T>())
+        throw format_error("Mismatched .npy dtype " + info.descr + ", expected " + dtype<T>());
+    if (info.fortranOrder && info.shape.size() > 1)
+        throw format_error("Fortran order .npy arrays are not supported");
+    size_t count = info.count();
+    if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+        throw format_error("Overflowing .npy payload size");
+    return count * sizeof(T);
+}
+
+} // namespace detail
+
+// Reads the payload described by info into out with a single read. out must
+// have exactly info.count() elements of the matching dtype.
+template <class T>
+void readData(std::istream& in, const Info& info, std::span<T> out) {
+    detail::payloadBytes<T>(info);
+    if (out.size() != info.count())
+        throw format_error("Mismatched .npy element count");
+    if (!in.read(reinterpret_cast<char*>(out.data()), std::streamsize(out.size_bytes())))
+        throw format_error("Truncated .npy payload");
+}
+
+#if !defined(_WIN32)
+
+// Copies the payload described by info, of the matching dtype, from the .npy
+// file in to outOffset in out with copy_file_range() where supported, e.g. to
+// a page aligned offset in a decodeless file being assembled. Returns the
+// payload size in bytes.
+template <class T>
+size_t copyData(int in, const Info& info, int out, uint64_t outOffset) {
+    size_t bytes = detail::payloadBytes<T>(info);
+    if (decodeless::detail::copyFileRange(in, info.dataOffset, out, outOffset, bytes,
+                                          ".npy payload copy failed") != bytes)
+        throw format_error("Truncated .npy payload");
+    return bytes;
+}
+
+#endif
+
+// Reads a whole .npy file into memory from a decodeless memory resource, e.g.
+// to assign to an offset_span in a sub-header. The array shape is flattened;
+// use readHeader() and readData() to keep it.
+template <class T, class MemoryResource>
+std::span<T> read(std::istream& in, MemoryResource& memory, size_t alignment = alignof(T)) {
+    Info         info = readHeader(in);
+    size_t       bytes = detail::payloadBytes<T>(info);
+    std::span<T> result(
+        static_cast<T*>(memory.allocate(bytes, std::max(alignment, alignof(T)))), info.count());
+    readData(in, info, result);
+    return result;
+}
+
+// Writes data as a .npy file, with the payload written in a single call
+template <class T>
+void write(std::ostream& out, std::span<const T> data, std::span<const size_t> shape,
+           size_t alignment = 64) {
+    size_t count = std::accumulate(shape.begin(), shape.end(), size_t(1), std::multiplies<>());
+    if (count != data.size())
+        throw std::invalid_argument("Shape does not match the .npy element count");
+    std::string preamble = header<T>(shape, alignment);
+    out.write(preamble.data(), std::streamsize(preamble.size()));
+    out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size_bytes()));
+}
+
+template <class T>
+void write(std::ostream& out, std::span<const T> data, size_t alignment = 64) {
+    const size_t shape[] = {data.size()};
+    write(out, data, std::span<const size_t>(shape), alignment);
+}
+
+} // namespace decodeless::npy
@@ -0,0 +1,188 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/offset_span.hpp>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+// Linear model mapping keys >= key to approximate positions
+struct PgmSegment {
+    uint64_t key = 0;
+    double   slope = 0.0;
+    uint64_t intercept = 0;
+
+    size_t predict(uint64_t x, size_t size) const {
+        if (x <= key)
+            return std::min<size_t>(intercept, size);
+        double position = double(intercept) + slope * double(x - key);
+        return position >= double(size) ? size : size_t(std::max(position, 0.0));
+    }
+};
+
+namespace detail {
+
+// First index in [0, size) with keyAt(index) >= x, searching outward from a
+// predicted index. Normally only the +/- epsilon window is searched, but the
+// window grows exponentially if the prediction was off, e.g. due to floating
+// point rounding, so the result is always exact.
+template <class KeyAt>
+size_t boundedLowerBound(KeyAt&& keyAt, size_t size, size_t predicted, size_t epsilon,
+                         uint64_t x) {
+    size_t lo = predicted > epsilon ? predicted - epsilon : 0;
+    size_t hi = std::min(size, predicted + epsilon + 1);
+    for (size_t step = epsilon + 1; lo > 0 && keyAt(lo - 1) >= x; step *= 2)
+        lo = lo > step ? lo - step : 0;
+    for (size_t step = epsilon + 1; hi < size && keyAt(hi) < x; step *= 2)
+        hi = std::min(size, hi + step);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keyAt(mid) < x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Fits segments to the first position of each distinct key in one pass using
+// the shrinking cone algorithm. Every distinct key's position is predicted to
+// within epsilon by the segment covering it.
+template <class KeyAt>
+std::vector<PgmSegment> fitPgmSegments(KeyAt&& keyAt, size_t size, size_t epsilon) {
+    std::vector<PgmSegment> segments;
+    if (size == 0)
+        return segments;
+    PgmSegment current{keyAt(0), 0.0, 0};
+    double     lo = 0.0;
+    double     hi = std::numeric_limits<double>::infinity();
+    auto       emit = [&] {
+        current.slope = std::isinf(hi) ? 0.0 : (lo + hi) / 2.0;
+        segments.push_back(current);
+    };
+    for (size_t i = 1; i < size; ++i) {
+        uint64_t key = keyAt(i);
+        if (key == keyAt(i - 1))
+            continue;
+        double dx = double(key - current.key);
+        double dy = double(i) - double(current.intercept);
+        double newLo = std::max(lo, (dy - double(epsilon)) / dx);
+        double newHi = std::min(hi, (dy + double(epsilon)) / dx);
+        if (newLo > newHi) {
+            emit();
+            current = PgmSegment{key, 0.0, i};
+            lo = 0.0;
+            hi = std::numeric_limits<double>::infinity();
+        } else {
+            lo = newLo;
+            hi = newHi;
+        }
+    }
+    emit();
+    return segments;
+}
+
+} // namespace detail
+
+// Piecewise linear learned index (PGM index) over a sorted
+// offset_span<uint64_t>, embeddable in a Header subclass. Segments predict a
+// key's position to within epsilon and further levels of segments index the
+// segment keys, so a lookup is a few predictions and small bounded searches.
+// The index is typically orders of magnitude smaller than the keys, so placing
+// it in its own sub-header makes it cheap to keep resident or mlock().
+// Build with buildPgmIndex().
+struct PgmIndex {
+    uint64_t                    epsilon = 0;
+    offset_span<const uint64_t> keys;
+
+    // Segments for all levels, those over keys first and the single root
+    // segment last
+    offset_span<PgmSegment> segments;
+
+    // Offset of each level in segments, with a final entry holding
+    // segments.size()
+    offset_span<uint64_t> levels;
+
+    // Index of the first key not less than x, or keys.size()
+    size_t lower_bound(uint64_t x) const {
+        if (keys.empty())
+            return 0;
+
+        // Walk down from the root, at each level finding the last segment
+        // whose key is <= x
+        size_t segment = levels[levels.size() - 2];
+        for (size_t level = levels.size() - 2; level > 0; --level) {
+            const PgmSegment* below = segments.data() + levels[level - 1];
+            size_t            count = levels[level] - levels[level - 1];
+            size_t            predicted = segments[segment].predict(x, count);
+            size_t            upper = x == std::numeric_limits<uint64_t>::max()
+                                          ? count
+                                          : detail::boundedLowerBound(
+                                     [below](size_t i) { return below[i].key; }, count, predicted,
+                                     size_t(epsilon), x + 1);
+            segment = levels[level - 1] + (upper ? upper - 1 : 0);
+        }
+        const uint64_t* data = keys.data();
+        return detail::boundedLowerBound([data](size_t i) { return data[i]; }, keys.size(),
+                                         segments[segment].predict(x, keys.size()),
+                                         size_t(epsilon), x);
+    }
+
+    // Index of the first key greater than x, or keys.size()
+    size_t upper_bound(uint64_t x) const {
+        return x == std::numeric_limits<uint64_t>::max() ? keys.size() : lower_bound(x + 1);
+    }
+
+    // Index range of keys in [first, last)
+    std::pair<size_t, size_t> range(uint64_t first, uint64_t last) const {
+        size_t begin = lower_bound(first);
+        return {begin, first < last ? lower_bound(last) : begin};
+    }
+
+    bool contains(uint64_t x) const {
+        size_t i = lower_bound(x);
+        return i < keys.size() && keys[i] == x;
+    }
+};
+
+// Fits the index to sortedKeys, which must already be in the file and remain
+// there, in a single pass per level. Smaller epsilon gives faster lookups and
+// a larger index.
+template <class MemoryResource>
+void buildPgmIndex(PgmIndex& result, MemoryResource& memory, std::span<const uint64_t> sortedKeys,
+                   size_t epsilon = 64) {
+    std::vector<std::vector<PgmSegment>> levels;
+    levels.push_back(detail::fitPgmSegments([&](size_t i) { return sortedKeys[i]; },
+                                            sortedKeys.size(), epsilon));
+    while (levels.back().size() > 1) {
+        const std::vector<PgmSegment>& below = levels.back();
+        levels.push_back(detail::fitPgmSegments([&](size_t i) { return below[i].key; },
+                                                below.size(), epsilon));
+    }
+
+    size_t total = 0;
+    for (const auto& level : levels)
+        total += level.size();
+    std::span<PgmSegment> segments = detail::allocateArray<PgmSegment>(memory, total);
+    std::span<uint64_t>   offsets = detail::allocateArray<uint64_t>(memory, levels.size() + 1);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        std::ranges::copy(levels[i], segments.begin() + offsets[i]);
+        offsets[i + 1] = offsets[i] + levels[i].size();
+    }
+
+    result.epsilon = epsilon;
+    result.keys = sortedKeys;
+    result.segments = segments;
+    result.levels = offsets;
+}
+
+} // namespace decodeless
@@ -0,0 +1,198 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/bitpacked.hpp>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/offset_span.hpp>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace decodeless {
+
+// Skip entry for one block: its first and last values and, packed together,
+// the bit width of its deltas and the offset of its words
+struct PostingBlock {
+    uint32_t first = 0;
+    uint32_t last = 0;
+    uint64_t packed = 0;
+
+    unsigned width() const { return unsigned(packed >> 56); }
+    uint64_t wordOffset() const { return packed & ((uint64_t(1) << 56) - 1); }
+};
+
+// Sorted uint32_t list stored as bit-packed deltas in blocks of BlockSize, in
+// the style of SIMD-BP128, embeddable in a Header subclass. Each block's first
+// and last values form a skip list, so searches and intersections only decode
+// blocks that can contain a match. Build with buildPostingList().
+struct PostingList {
+    static constexpr size_t BlockSize = 128;
+
+    uint64_t                  size = 0;
+    offset_span<PostingBlock> blocks;
+    offset_span<uint64_t>     words; // BlockSize * width / 64 per block
+
+    // Decodes a block into out, returning the number of values
+    size_t decodeBlock(size_t block, uint32_t* out) const {
+        const PostingBlock&             b = blocks[block];
+        std::array<uint64_t, BlockSize> deltas;
+        detail::unpackBits<BlockSize>(words.data() + b.wordOffset(), b.width(), deltas.data());
+        size_t   count = std::min<size_t>(BlockSize, size - block * BlockSize);
+        uint32_t value = b.first;
+        for (size_t i = 0; i < count; ++i)
+            out[i] = value += uint32_t(deltas[i]);
+        return count;
+    }
+
+    std::vector<uint32_t> decode() const {
+        std::vector<uint32_t> result(size);
+        for (size_t block = 0; block < blocks.size(); ++block)
+            decodeBlock(block, result.data() + block * BlockSize);
+        return result;
+    }
+
+    // Forward iterator over the list, decoding one block at a time
+    class cursor {
+    public:
+        explicit cursor(const PostingList& list)
+            : m_list(list) {
+            if (!m_list.blocks.empty())
+                load(0);
+        }
+
+        bool     valid() const { return m_pos < m_count; }
+        uint32_t value() const { return m_values[m_pos]; }
+
+        // Index of the current value in the list
+        uint64_t index() const { return m_block * BlockSize + m_pos; }
+
+        void next() {
+            if (++m_pos == m_count && m_block + 1 < m_list.blocks.size())
+                load(m_block + 1);
+        }
+
+        // Moves to the first value not less than target. Galloping search
+        // over the block skip entries, then a binary search in one decoded
+        // block. Never moves backwards.
+        void advanceTo(uint32_t target) {
+            if (!valid() || value() >= target)
+                return;
+            const auto& blocks = m_list.blocks;
+            if (blocks[m_block].last < target) {
+                size_t lo = m_block + 1;
+                size_t step = 1;
+                while (lo + step < blocks.size() && blocks[lo + step - 1].last < target) {
+                    lo += step;
+                    step *= 2;
+                }
+                size_t hi = std::min(lo + step, blocks.size());
+                auto   lastLess = [](const PostingBlock& b, uint32_t t) { return b.last < t; };
+                size_t block = size_t(std::lower_bound(blocks.begin() + lo, blocks.begin() + hi,
+                                                       target, lastLess) -
+                                      blocks.begin());
+                if (block == blocks.size()) {
+                    m_pos = m_count;
+                    return;
+                }
+                load(block);
+            }
+            m_pos = size_t(std::lower_bound(m_values.begin() + m_pos, m_values.begin() + m_count,
+                                            target) -
+                           m_values.begin());
+        }
+
+    private:
+        void load(size_t block) {
+            m_block = block;
+            m_pos = 0;
+            m_count = m_list.decodeBlock(block, m_values.data());
+        }
+
+        const PostingList&              m_list;
+        size_t                          m_block = 0;
+        size_t                          m_pos = 0;
+        size_t                          m_count = 0;
+        std::array<uint32_t, BlockSize> m_values;
+    };
+
+    bool contains(uint32_t value) const {
+        cursor c(*this);
+        c.advanceTo(value);
+        return c.valid() && c.value() == value;
+    }
+};
+
+// Calls fn(value) for each value in both lists, in order. Leapfrogs with
+// galloping cursors so long runs in either list are skipped block-wise.
+template <class Fn>
+void intersect(const PostingList& a, const PostingList& b, Fn&& fn) {
+    PostingList::cursor ca(a), cb(b);
+    while (ca.valid() && cb.valid()) {
+        if (ca.value() < cb.value()) {
+            ca.advanceTo(cb.value());
+        } else if (cb.value() < ca.value()) {
+            cb.advanceTo(ca.value());
+        } else {
+            fn(ca.value());
+            ca.next();
+            cb.next();
+        }
+    }
+}
+
+inline std::vector<uint32_t> intersect(const PostingList& a, const PostingList& b) {
+    std::vector<uint32_t> result;
+    intersect(a, b, [&](uint32_t value) { result.push_back(value); });
+    return result;
+}
+
+// Builds a posting list from non-decreasing values
+template <class MemoryResource>
+void buildPostingList(PostingList& result, MemoryResource& memory,
+                      std::span<const uint32_t> sortedValues) {
+    constexpr size_t B = PostingList::BlockSize;
+    size_t           blockCount = (sortedValues.size() + B - 1) / B;
+    std::span<PostingBlock> blocks = detail::allocateArray<PostingBlock>(memory, blockCount);
+
+    // The first delta of each block is zero, from the block's first value
+    uint64_t totalWords = 0;
+    for (size_t block = 0; block < blockCount; ++block) {
+        std::span<const uint32_t> v =
+            sortedValues.subspan(block * B, std::min(B, sortedValues.size() - block * B));
+        uint32_t maxDelta = 0;
+        for (size_t i = 1; i < v.size(); ++i) {
+            if (v[i] < v[i - 1])
+                throw std::invalid_argument("Posting list values must be sorted");
+            maxDelta = std::max(maxDelta, v[i] - v[i - 1]);
+        }
+        if (block && v.front() < sortedValues[block * B - 1])
+            throw std::invalid_argument("Posting list values must be sorted");
+        unsigned width = detail::bitWidth(maxDelta);
+        blocks[block].first = v.front();
+        blocks[block].last = v.back();
+        blocks[block].packed = (uint64_t(width) << 56) | totalWords;
+        totalWords += B * width / 64;
+    }
+
+    std::span<uint64_t> words = detail::allocateArray<uint64_t>(memory, totalWords);
+    for (size_t block = 0; block < blockCount; ++block) {
+        const PostingBlock& b = blocks[block];
+        if (b.width() == 0)
+            continue;
+        for (size_t i = block * B + 1; i < std::min(sortedValues.size(), block * B + B); ++i)
+            detail::depositBits(words.data() + b.wordOffset(), (i % B) * b.width(), b.width(),
+                                sortedValues[i] - sortedValues[i - 1]);
+    }
+
+    result.size = sortedValues.size();
+    result.blocks = blocks;
+    result.words = words;
+}
+
+} // namespace decodeless
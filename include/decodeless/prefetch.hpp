@@ -0,0 +1,152 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <decodeless/offset_ptr.hpp>
+#include <decodeless/offset_span.hpp>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+    #include <xmmintrin.h>
+#endif
+
+namespace decodeless {
+
+// Hint that the cache line at ptr will be read soon. Never faults, even for
+// nullptr or unmapped addresses.
+inline void prefetch(const void* ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(ptr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(ptr), _MM_HINT_T0);
+#else
+    (void)ptr;
+#endif
+}
+
+// How many elements ahead to prefetch when walking an array of offset_ptrs.
+// Each dereference is a dependent load, so this needs to cover roughly the
+// memory latency divided by the per-element work.
+inline constexpr size_t DefaultPrefetchDistance = 8;
+
+// Forward iterator over an array of offset_ptr<T> that dereferences to T& and
+// prefetches the target Distance elements ahead. Pointers must be non-null to
+// be dereferenced.
+template <class T, size_t Distance = DefaultPrefetchDistance>
+class prefetch_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::remove_cv_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    prefetch_iterator() = default;
+    prefetch_iterator(const offset_ptr<T>* pos, const offset_ptr<T>* end)
+        : m_pos(pos)
+        , m_end(end) {
+        const offset_ptr<T>* warm = m_pos + std::min<size_t>(Distance, m_end - m_pos);
+        for (const offset_ptr<T>* p = m_pos; p != warm; ++p)
+            prefetch(p->get());
+    }
+
+    reference operator*() const { return *m_pos->get(); }
+    pointer   operator->() const { return m_pos->get(); }
+
+    // Targets [m_pos, m_pos + Distance) have already been prefetched, so
+    // extend the window by one before advancing
+    prefetch_iterator& operator++() {
+        if (static_cast<size_t>(m_end - m_pos) > Distance)
+            prefetch(m_pos[Distance].get());
+        ++m_pos;
+        return *this;
+    }
+    prefetch_iterator operator++(int) {
+        prefetch_iterator result = *this;
+        ++*this;
+        return result;
+    }
+
+    bool operator==(const prefetch_iterator& other) const { return m_pos == other.m_pos; }
+
+    // The underlying position in the offset_ptr array
+    const offset_ptr<T>* base() const { return m_pos; }
+
+private:
+    const offset_ptr<T>* m_pos = nullptr;
+    const offset_ptr<T>* m_end = nullptr;
+};
+
+// Range of prefetch_iterators, e.g. for range-based for loops
+template <class T, size_t Distance = DefaultPrefetchDistance>
+class prefetch_range {
+public:
+    using iterator = prefetch_iterator<T, Distance>;
+
+    prefetch_range(const offset_span<offset_ptr<T>>& pointers)
+        : m_begin(pointers.data())
+        , m_end(pointers.data() + pointers.size()) {}
+
+    iterator begin() const { return iterator(m_begin, m_end); }
+    iterator end() const { return iterator(m_end, m_end); }
+    size_t   size() const { return m_end - m_begin; }
+
+private:
+    const offset_ptr<T>* m_begin;
+    const offset_ptr<T>* m_end;
+};
+
+// Calls fn(T&) for each target in order
+template <size_t Distance = DefaultPrefetchDistance, class T, class Fn>
+void prefetch_for_each(const offset_span<offset_ptr<T>>& pointers, Fn&& fn) {
+    for (T& value : prefetch_range<T, Distance>(pointers))
+        std::invoke(fn, value);
+}
+
+// Writes fn(T&) for each target in order to out
+template <size_t Distance = DefaultPrefetchDistance, class T, class OutputIt, class Fn>
+OutputIt prefetch_transform(const offset_span<offset_ptr<T>>& pointers, OutputIt out, Fn&& fn) {
+    for (T& value : prefetch_range<T, Distance>(pointers))
+        *out++ = std::invoke(fn, value);
+    return out;
+}
+
+// Returns the first pointer whose target satisfies pred, or pointers.end()
+template <size_t Distance = DefaultPrefetchDistance, class T, class Pred>
+typename offset_span<offset_ptr<T>>::iterator
+prefetch_find_if(const offset_span<offset_ptr<T>>& pointers, Pred&& pred) {
+    prefetch_range<T, Distance> range(pointers);
+    auto it = std::find_if(range.begin(), range.end(), std::forward<Pred>(pred));
+    return pointers.begin() + (it.base() - pointers.data());
+}
+
+// Calls fn(index, T&) for every target, visiting each batch of batchSize
+// pointers in increasing address order rather than array order. This improves
+// page and cache line locality when the targets are scattered through a large
+// mapping, at the cost of an unspecified visiting order.
+template <class T, class Fn>
+void sorted_gather(const offset_span<offset_ptr<T>>& pointers, Fn&& fn, size_t batchSize = 4096) {
+    assert(batchSize > 0);
+    std::vector<std::pair<T*, size_t>> batch;
+    batch.reserve(std::min(batchSize, pointers.size()));
+    for (size_t begin = 0; begin < pointers.size(); begin += batchSize) {
+        size_t end = std::min(begin + batchSize, pointers.size());
+        batch.clear();
+        for (size_t i = begin; i < end; ++i)
+            batch.emplace_back(pointers[i].get(), i);
+        std::ranges::sort(batch, std::less<>(), &std::pair<T*, size_t>::first);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (i + DefaultPrefetchDistance < batch.size())
+                prefetch(batch[i + DefaultPrefetchDistance].first);
+            std::invoke(fn, batch[i].second, *batch[i].first);
+        }
+    }
+}
+
+} // namespace decodeless
@@ -0,0 +1,115 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/detail/parallel.hpp>
+#include <decodeless/offset_span.hpp>
+#include <limits>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+// Array of variable length records, embeddable in a Header subclass. Record i
+// is data[offsets[i]..offsets[i + 1]]. Offset may be uint32_t to halve the
+// offsets column when data has fewer than 2^32 elements. Build with
+// buildRaggedArray().
+template <class T, class Offset = uint64_t>
+struct RaggedArray {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(std::is_same_v<Offset, uint32_t> || std::is_same_v<Offset, uint64_t>);
+
+    offset_span<Offset> offsets; // size() + 1 entries
+    offset_span<T>      data;
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    bool   empty() const { return size() == 0; }
+
+    std::span<const T> operator[](size_t i) const {
+        assert(i < size());
+        return {data.data() + offsets[i], size_t(offsets[i + 1] - offsets[i])};
+    }
+
+    // Calls fn(index, record) for records in [begin, end), reading offsets
+    // and data strictly front to back
+    template <class Fn>
+    void forEach(size_t begin, size_t end, Fn&& fn) const {
+        assert(begin <= end && end <= size());
+        const Offset* offset = offsets.data() + begin;
+        const T*      base = data.data();
+        for (size_t i = begin; i < end; ++i, ++offset)
+            fn(i, std::span<const T>(base + offset[0], size_t(offset[1] - offset[0])));
+    }
+
+    template <class Fn>
+    void forEach(Fn&& fn) const {
+        forEach(0, size(), std::forward<Fn>(fn));
+    }
+};
+
+// Builds a ragged array of count records in parallel. length(i) returns the
+// size of record i and fill(i, std::span<T>) writes it. Lengths are gathered
+// and prefix summed in parallel chunks, then records are filled in parallel
+// directly in place. A threadCount of zero uses all cores.
+template <class T, class Offset, class MemoryResource, class LengthFn, class FillFn>
+void buildRaggedArray(RaggedArray<T, Offset>& result, MemoryResource& memory, size_t count,
+                      LengthFn&& length, FillFn&& fill, size_t threadCount = 0) {
+    size_t              threads = detail::threadsFor(count, threadCount, 16384);
+    std::span<Offset>   offsets = detail::allocateArray<Offset>(memory, count + 1);
+    std::vector<size_t> chunkTotals(threads + 1, 0);
+
+    // Per-chunk inclusive scans of the lengths, then a short serial scan of
+    // the chunk totals and a parallel pass adding each chunk's base
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = detail::chunkRange(count, threads, t);
+        size_t total = 0;
+        for (size_t i = begin; i < end; ++i) {
+            total += size_t(length(i));
+            offsets[i + 1] = Offset(total);
+        }
+        chunkTotals[t + 1] = total;
+    });
+    for (size_t t = 0; t < threads; ++t)
+        chunkTotals[t + 1] += chunkTotals[t];
+    if (chunkTotals.back() > std::numeric_limits<Offset>::max())
+        throw std::overflow_error("Ragged array data exceeds the offset type");
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = detail::chunkRange(count, threads, t);
+        Offset base = Offset(chunkTotals[t]);
+        for (size_t i = begin; i < end; ++i)
+            offsets[i + 1] += base;
+    });
+
+    std::span<T> data = detail::allocateArray<T>(memory, chunkTotals.back());
+    detail::parallelFor(threads, [&](size_t t) {
+        auto [begin, end] = detail::chunkRange(count, threads, t);
+        for (size_t i = begin; i < end; ++i)
+            fill(i, data.subspan(offsets[i], offsets[i + 1] - offsets[i]));
+    });
+
+    result.offsets = offsets;
+    result.data = data;
+}
+
+// Builds a ragged array by copying a random access range of ranges, e.g. a
+// std::vector<std::string> or std::vector<std::vector<T>>
+template <class T, class Offset, class MemoryResource, std::ranges::random_access_range Records>
+void buildRaggedArray(RaggedArray<T, Offset>& result, MemoryResource& memory,
+                      const Records& records, size_t threadCount = 0) {
+    buildRaggedArray(
+        result, memory, std::ranges::size(records),
+        [&](size_t i) { return std::ranges::size(records[i]); },
+        [&](size_t i, std::span<T> out) { std::ranges::copy(records[i], out.begin()); },
+        threadCount);
+}
+
+} // namespace decodeless
@@ -0,0 +1,60 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <decodeless/offset_ptr.hpp>
+#include <decodeless/offset_span.hpp>
+#include <memory>
+#include <span>
+
+namespace decodeless {
+
+// Converts each offset_ptr in src to a raw pointer in dst. This is a plain
+// loop over contiguous memory with no dependencies between iterations so the
+// compiler can vectorize the load-and-add.
+template <class T>
+void resolve(std::span<const offset_ptr<T>> src, std::span<T*> dst) {
+    assert(src.size() == dst.size());
+    const offset_ptr<T>* in = src.data();
+    T**                  out = dst.data();
+    for (size_t i = 0; i < src.size(); ++i)
+        out[i] = in[i].get();
+}
+
+// Runtime-only copy of an offset_span<offset_ptr<T>> with the pointers already
+// resolved, e.g. for RootHeader::headers or large user pointer tables that are
+// traversed repeatedly. Raw pointers are only valid for the address the file
+// is currently mapped at, so keep this alongside the mapping and destroy it on
+// unmap or reload.
+template <class T>
+class resolved_span {
+public:
+    using element_type = T*;
+    using iterator = T* const*;
+
+    resolved_span() = default;
+    explicit resolved_span(const offset_span<offset_ptr<T>>& pointers) {
+        if (pointers.empty())
+            return;
+        m_pointers = std::make_unique_for_overwrite<T*[]>(pointers.size());
+        m_size = pointers.size();
+        resolve(std::span<const offset_ptr<T>>(pointers.data(), pointers.size()),
+                std::span<T*>(m_pointers.get(), m_size));
+    }
+
+    T* const*           data() const { return m_pointers.get(); }
+    size_t              size() const { return m_size; }
+    bool                empty() const { return m_size == 0; }
+    iterator            begin() const { return data(); }
+    iterator            end() const { return data() + m_size; }
+    T*                  operator[](size_t i) const { return m_pointers[i]; }
+    std::span<T* const> span() const { return {data(), m_size}; }
+
+private:
+    std::unique_ptr<T*[]> m_pointers;
+    size_t                m_size = 0;
+};
+
+} // namespace decodeless
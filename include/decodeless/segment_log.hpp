@@ -0,0 +1,168 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/header.hpp>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+namespace decodeless {
+
+// Fixed capacity block of timestamped events stored as a structure of arrays.
+// Immutable once sealed. Timestamps within a segment are non-decreasing.
+template <class T>
+struct LogSegment {
+    uint64_t              size = 0;
+    uint64_t              minTimestamp = 0;
+    uint64_t              maxTimestamp = 0;
+    offset_span<uint64_t> timestamps;
+    offset_span<T>        values;
+
+    std::span<const uint64_t> validTimestamps() const { return {timestamps.data(), size}; }
+    std::span<const T>        validValues() const { return {values.data(), size}; }
+};
+
+// Sub-header for an append-only log of sealed segments. Segments are listed in
+// the order they were sealed, which is only time ordered per writer. The
+// segment table is reserved up front and sealedCount is published atomically,
+// so readers may scan sealed segments while writers continue appending.
+template <class T>
+struct SegmentLog : Header {
+    static_assert(std::is_trivially_copyable_v<T>);
+    static constexpr Magic   HeaderIdentifier{"DL:SEGMENTLOG"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    SegmentLog()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+
+    uint64_t                               valueSize = sizeof(T);
+    uint64_t                               segmentCapacity = 0;
+    uint64_t                               sealedCount = 0;
+    offset_span<offset_ptr<LogSegment<T>>> segments;
+
+    // Segments sealed so far. Safe to call concurrently with writers.
+    std::span<const offset_ptr<LogSegment<T>>> sealed() const {
+        std::atomic_ref<uint64_t> count(const_cast<uint64_t&>(sealedCount));
+        return {segments.data(), size_t(count.load(std::memory_order_acquire))};
+    }
+
+    // Calls fn(timestamp, value) for each sealed event with a timestamp in
+    // [begin, end), visiting segments in sealed order
+    template <class Fn>
+    void forEach(uint64_t begin, uint64_t end, Fn&& fn) const {
+        for (const offset_ptr<LogSegment<T>>& ptr : sealed()) {
+            const LogSegment<T>& segment = *ptr;
+            if (segment.size == 0 || segment.maxTimestamp < begin || segment.minTimestamp >= end)
+                continue;
+            std::span<const uint64_t> timestamps = segment.validTimestamps();
+            auto                      it = std::ranges::lower_bound(timestamps, begin);
+            for (; it != timestamps.end() && *it < end; ++it)
+                fn(*it, segment.values[it - timestamps.begin()]);
+        }
+    }
+};
+
+// Appends to a SegmentLog from multiple threads. Each thread uses its own
+// appender, which fills a private segment with plain stores. Only allocating
+// and sealing a segment, once per segmentCapacity events, takes a lock. The
+// memory resource must keep allocations at stable addresses, e.g. a reserved
+// growable mapping.
+template <class T, class MemoryResource>
+class segment_log_writer {
+public:
+    segment_log_writer(SegmentLog<T>& log, MemoryResource& memory, size_t maxSegments,
+                       size_t segmentCapacity)
+        : m_log(log)
+        , m_memory(memory) {
+        if (segmentCapacity == 0)
+            throw std::invalid_argument("Segment capacity must be non-zero");
+        m_log.segments = detail::allocateArray<offset_ptr<LogSegment<T>>>(memory, maxSegments);
+        m_log.segmentCapacity = segmentCapacity;
+        m_log.sealedCount = 0;
+    }
+
+    // Per-thread writer. Seals its current segment when full and on
+    // destruction or flush().
+    class appender {
+    public:
+        appender(segment_log_writer& writer)
+            : m_writer(writer) {}
+        appender(const appender&) = delete;
+        appender& operator=(const appender&) = delete;
+        ~appender() { flush(); }
+
+        void append(uint64_t timestamp, const T& value) {
+            if (m_size == m_capacity)
+                next();
+            assert(m_size == 0 || m_timestamps[m_size - 1] <= timestamp);
+            m_timestamps[m_size] = timestamp;
+            m_values[m_size] = value;
+            ++m_size;
+        }
+
+        // Seals and publishes a partially filled segment
+        void flush() {
+            if (m_segment && m_size) {
+                m_writer.seal(*m_segment, m_size);
+            }
+            m_segment = nullptr;
+            m_size = m_capacity = 0;
+        }
+
+    private:
+        void next() {
+            flush();
+            m_segment = m_writer.allocateSegment();
+            m_timestamps = m_segment->timestamps.data();
+            m_values = m_segment->values.data();
+            m_capacity = m_segment->timestamps.size();
+        }
+
+        segment_log_writer& m_writer;
+        LogSegment<T>*      m_segment = nullptr;
+        uint64_t*           m_timestamps = nullptr;
+        T*                  m_values = nullptr;
+        size_t              m_size = 0;
+        size_t              m_capacity = 0;
+    };
+
+private:
+    LogSegment<T>* allocateSegment() {
+        std::lock_guard lock(m_mutex);
+        if (m_reserved == m_log.segments.size())
+            throw std::length_error("Segment log is full");
+        ++m_reserved;
+        auto* segment = detail::allocateObject<LogSegment<T>>(m_memory);
+
+        // Cache line aligned columns so appenders on different threads never
+        // share a line
+        segment->timestamps = detail::allocateArray<uint64_t>(m_memory, m_log.segmentCapacity, 64);
+        segment->values = detail::allocateArray<T>(m_memory, m_log.segmentCapacity, 64);
+        return segment;
+    }
+
+    void seal(LogSegment<T>& segment, size_t size) {
+        segment.size = size;
+        segment.minTimestamp = segment.timestamps[0];
+        segment.maxTimestamp = segment.timestamps[size - 1];
+        std::lock_guard lock(m_mutex);
+        uint64_t        index = m_log.sealedCount;
+        m_log.segments[index] = &segment;
+        std::atomic_ref<uint64_t>(m_log.sealedCount).store(index + 1, std::memory_order_release);
+    }
+
+    SegmentLog<T>&  m_log;
+    MemoryResource& m_memory;
+    std::mutex      m_mutex;
+    size_t          m_reserved = 0;
+};
+
+} // namespace decodeless
@@ -0,0 +1,130 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/offset_span.hpp>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace decodeless {
+
+// One cache line of sorted keys. Unused slots hold the maximum key so the
+// branchless in-node search can always compare all of them.
+struct alignas(64) StaticBTreeNode {
+    static constexpr size_t Keys = 64 / sizeof(uint64_t);
+    std::array<uint64_t, Keys> keys;
+
+    // Number of keys less than key. A fixed length loop the compiler can
+    // vectorize.
+    uint32_t rank(uint64_t key) const {
+        uint32_t result = 0;
+        for (size_t i = 0; i < Keys; ++i)
+            result += keys[i] < key;
+        return result;
+    }
+};
+static_assert(sizeof(StaticBTreeNode) == 64);
+
+// Static B+ tree (S-tree) over a sorted offset_span<uint64_t>, embeddable in a
+// Header subclass. Internal nodes are one cache line each, stored level by
+// level with implicit child indices, so a lookup touches one line per level
+// instead of the ~log2(n) lines of a binary search. Leaves are the original
+// keys, which are not copied. Build with buildStaticBTree().
+struct StaticBTree {
+    static constexpr size_t Fanout = StaticBTreeNode::Keys + 1;
+
+    offset_span<const uint64_t>  keys;
+    offset_span<StaticBTreeNode> nodes;
+
+    // Offset of each level in nodes, root first, with a final entry holding
+    // nodes.size()
+    offset_span<uint64_t> levels;
+
+    // Index of the first key not less than key, or keys.size()
+    size_t lower_bound(uint64_t key) const {
+        // Each internal level selects which block of Fanout children to
+        // descend into. The last level's child index is a block of
+        // StaticBTreeNode::Keys leaf keys.
+        size_t child = 0;
+        for (size_t level = 0; level + 1 < levels.size(); ++level)
+            child = child * Fanout + nodes[levels[level] + child].rank(key);
+        size_t begin = std::min(child * StaticBTreeNode::Keys, keys.size());
+        size_t end = std::min(begin + StaticBTreeNode::Keys, keys.size());
+        return size_t(std::lower_bound(keys.begin() + begin, keys.begin() + end, key) -
+                      keys.begin());
+    }
+
+    // Index of the first key greater than key, or keys.size()
+    size_t upper_bound(uint64_t key) const {
+        return key == std::numeric_limits<uint64_t>::max() ? keys.size() : lower_bound(key + 1);
+    }
+
+    // Index range of keys in [first, last)
+    std::pair<size_t, size_t> range(uint64_t first, uint64_t last) const {
+        size_t begin = lower_bound(first);
+        return {begin, first < last ? lower_bound(last) : begin};
+    }
+
+    bool contains(uint64_t key) const {
+        size_t i = lower_bound(key);
+        return i < keys.size() && keys[i] == key;
+    }
+};
+
+// Builds the internal nodes for sortedKeys, which must already be in the file
+// and remain there. Allocates the nodes from memory.
+template <class MemoryResource>
+void buildStaticBTree(StaticBTree& result, MemoryResource& memory,
+                      std::span<const uint64_t> sortedKeys) {
+    constexpr size_t B = StaticBTreeNode::Keys;
+    constexpr size_t Fanout = StaticBTree::Fanout;
+    constexpr auto   Max = std::numeric_limits<uint64_t>::max();
+
+    // Work out the level sizes bottom up. Leaf blocks hold B keys and each
+    // internal node separates Fanout children.
+    std::vector<size_t> levelSizes;
+    size_t              children = std::max<size_t>(1, (sortedKeys.size() + B - 1) / B);
+    do {
+        size_t nodes = (children + Fanout - 1) / Fanout;
+        levelSizes.push_back(nodes);
+        children = nodes;
+    } while (children > 1);
+    std::ranges::reverse(levelSizes);
+
+    std::span<uint64_t> levels = detail::allocateArray<uint64_t>(memory, levelSizes.size() + 1);
+    for (size_t i = 0; i < levelSizes.size(); ++i)
+        levels[i + 1] = levels[i] + levelSizes[i];
+    std::span<StaticBTreeNode> nodes =
+        detail::allocateArray<StaticBTreeNode>(memory, levels.back(), alignof(StaticBTreeNode));
+
+    // Smallest key in the subtree at a given level and child index, i.e. the
+    // separator that routes lookups to it. Subtrees past the end get Max.
+    auto firstKey = [&](size_t level, size_t child) -> uint64_t {
+        // Descend to the leftmost leaf block of the subtree
+        size_t block = child;
+        for (size_t l = level; l < levelSizes.size(); ++l)
+            block *= Fanout;
+        size_t index = block * B;
+        return index < sortedKeys.size() ? sortedKeys[index] : Max;
+    };
+    for (size_t level = 0; level < levelSizes.size(); ++level) {
+        for (size_t node = 0; node < levelSizes[level]; ++node) {
+            StaticBTreeNode& n = nodes[levels[level] + node];
+            for (size_t i = 0; i < B; ++i)
+                n.keys[i] = firstKey(level + 1, node * Fanout + i + 1);
+        }
+    }
+
+    result.keys = sortedKeys;
+    result.nodes = nodes;
+    result.levels = levels;
+}
+
+} // namespace decodeless
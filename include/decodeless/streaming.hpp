@@ -0,0 +1,193 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <decodeless/detail/allocate.hpp>
+#include <decodeless/header.hpp>
+#include <istream>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace decodeless {
+
+// Writes a file in "streaming order": the root header, then the header list,
+// then each sub-header immediately followed by its payload. Every offset_ptr
+// then points forward and each sub-header's data lies between it and the next
+// sub-header, so the file can be consumed from a pipe with streaming_reader.
+// It is still a regular random access decodeless file.
+template <class RootType, class MemoryResource>
+class streaming_writer {
+public:
+    template <class... Args>
+    streaming_writer(MemoryResource& memory, size_t headerCount, Args&&... rootArgs)
+        : m_memory(memory) {
+        m_root = detail::allocateObject<RootType>(memory, std::forward<Args>(rootArgs)...);
+        m_root->headers = detail::allocateArray<offset_ptr<Header>>(memory, headerCount);
+    }
+
+    // Creates the next sub-header. Allocate all of its payload from memory()
+    // before creating the next one.
+    template <SubHeader HeaderType, class... Args>
+    HeaderType* create(Args&&... args) {
+        if (m_next == m_root->headers.size())
+            throw std::length_error("More sub-headers created than reserved");
+        auto* header = detail::allocateObject<HeaderType>(m_memory, std::forward<Args>(args)...);
+        m_root->headers[m_next++] = header;
+        return header;
+    }
+
+    MemoryResource& memory() { return m_memory; }
+
+    // Sorts the header list. Sub-headers keep their file order.
+    RootType* finish() {
+        if (m_next != m_root->headers.size())
+            throw std::logic_error("Fewer sub-headers created than reserved");
+        std::ranges::sort(m_root->headers, RootHeader::HeaderPtrComp());
+        return m_root;
+    }
+
+private:
+    MemoryResource& m_memory;
+    RootType*       m_root = nullptr;
+    size_t          m_next = 0;
+};
+
+class streaming_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Reads a streaming order file front to back from a non-seekable stream,
+// returning one complete sub-header at a time. Memory use is bounded by
+// maxExtentSize, which limits both the root header plus header list and each
+// sub-header plus payload. Sub-header payloads must not reference data
+// outside their own extent.
+class streaming_reader {
+public:
+    static constexpr size_t DefaultMaxExtentSize = 64 << 20;
+
+    streaming_reader(std::istream& in, size_t maxExtentSize = DefaultMaxExtentSize)
+        : m_in(in)
+        , m_maxExtentSize(checkedExtentSize(maxExtentSize))
+        , m_prefix(allocate(maxExtentSize)) {
+        // Read the root header, then everything up to the end of the header
+        // list so RootHeader::headers remains valid in the prefix buffer
+        read(m_prefix.get(), sizeof(RootHeader));
+        if (!root().magicValid())
+            throw streaming_error("Not a decodeless file");
+        if (!root().binaryCompatible())
+            throw streaming_error("Incompatible decodeless file");
+        const RootHeader::HeaderList& headers = root().headers;
+        size_t                        listEnd = sizeof(RootHeader);
+        if (!headers.empty()) {
+            // Bound the size before multiplying so a corrupt count cannot wrap
+            uint64_t listBegin = fileOffset(m_prefix.get(), headers.data());
+            if (listBegin < sizeof(RootHeader) || listBegin > maxExtentSize ||
+                headers.size() > (maxExtentSize - listBegin) / sizeof(offset_ptr<Header>))
+                throw streaming_error("Header list is not in streaming order");
+            listEnd = listBegin + headers.size() * sizeof(offset_ptr<Header>);
+            read(m_prefix.get() + m_position, listEnd - m_position);
+        }
+
+        // Sub-headers are sorted by identifier; visit them in file order
+        for (const offset_ptr<Header>& header : headers)
+            m_offsets.push_back(fileOffset(m_prefix.get(), header.get()));
+        std::ranges::sort(m_offsets);
+        if (!m_offsets.empty() && m_offsets.front() < listEnd)
+            throw streaming_error("Sub-header is not in streaming order");
+    }
+
+    // The root header. Its header list is valid but sub-header pointers must
+    // not be dereferenced; use next() instead.
+    const RootHeader& root() const { return *reinterpret_cast<const RootHeader*>(m_prefix.get()); }
+
+    // Returns the next sub-header in file order, or nullptr after the last.
+    // The result is only valid until the next call.
+    const Header* next() {
+        if (m_next == m_offsets.size())
+            return nullptr;
+        uint64_t begin = m_offsets[m_next++];
+        skip(begin - m_position);
+
+        // Place the extent at the same offset within a page as in the file to
+        // preserve alignment
+        if (!m_extent)
+            m_extent = allocate(m_maxExtentSize + PageSize);
+        std::byte* dst = m_extent.get() + begin % PageSize;
+        if (m_next < m_offsets.size()) {
+            size_t size = m_offsets[m_next] - begin;
+            if (size > m_maxExtentSize)
+                throw streaming_error("Sub-header exceeds the maximum extent size");
+            read(dst, size);
+            m_extentSize = size;
+        } else {
+            // The last sub-header extends to the end of the stream
+            m_in.read(reinterpret_cast<char*>(dst), std::streamsize(m_maxExtentSize));
+            m_extentSize = size_t(m_in.gcount());
+            m_position += m_extentSize;
+            if (m_in.peek() != std::istream::traits_type::eof())
+                throw streaming_error("Sub-header exceeds the maximum extent size");
+        }
+        if (m_extentSize < sizeof(Header))
+            throw streaming_error("Truncated sub-header");
+        return reinterpret_cast<const Header*>(dst);
+    }
+
+    // Bytes of the sub-header and payload last returned by next()
+    std::span<const std::byte> extent() const {
+        return {m_extent.get() + m_offsets[m_next - 1] % PageSize, m_extentSize};
+    }
+
+private:
+    static constexpr size_t PageSize = 4096;
+
+    struct AlignedDelete {
+        void operator()(std::byte* p) const { ::operator delete(p, std::align_val_t(PageSize)); }
+    };
+    using Buffer = std::unique_ptr<std::byte[], AlignedDelete>;
+
+    static size_t checkedExtentSize(size_t size) {
+        if (size < sizeof(RootHeader))
+            throw std::invalid_argument("maxExtentSize is smaller than the root header");
+        return size;
+    }
+
+    static Buffer allocate(size_t size) {
+        return Buffer(static_cast<std::byte*>(::operator new(size, std::align_val_t(PageSize))));
+    }
+
+    // Offset in the file of a pointer resolved relative to the buffer holding
+    // the start of the file
+    static uint64_t fileOffset(const std::byte* fileStart, const void* ptr) {
+        return uint64_t(reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(fileStart));
+    }
+
+    void read(std::byte* dst, size_t size) {
+        if (!m_in.read(reinterpret_cast<char*>(dst), std::streamsize(size)))
+            throw streaming_error("Unexpected end of stream");
+        m_position += size;
+    }
+
+    void skip(uint64_t size) {
+        if (!m_in.ignore(std::streamsize(size)) || size_t(m_in.gcount()) != size)
+            throw streaming_error("Unexpected end of stream");
+        m_position += size;
+    }
+
+    std::istream&         m_in;
+    size_t                m_maxExtentSize;
+    uint64_t              m_position = 0;
+    Buffer                m_prefix;
+    Buffer                m_extent;
+    size_t                m_extentSize = 0;
+    std::vector<uint64_t> m_offsets;
+    size_t                m_next = 0;
+};
+
+} // namespace decodeless
@@ -0,0 +1,184 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/batched_writer.hpp>
+#include <decodeless/buffer_pool.hpp>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+using namespace decodeless;
+
+struct BatchedRootHeader : RootHeader {
+    BatchedRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+// One type with many instances, each with its own identifier
+struct BatchedHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"batched"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    BatchedHeader(const Magic& identifier)
+        : Header{.identifier = identifier, .version = VersionSupported, .gitHash = ""} {}
+    offset_span<uint16_t> data;
+};
+
+static Magic batchedIdentifier(size_t i) {
+    return Magic("batched-" + std::to_string(i));
+}
+
+struct BatchedWriter : testing::Test {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        (std::string("decodeless_") +
+         testing::UnitTest::GetInstance()->current_test_info()->name() + ".bin");
+    void TearDown() override { std::filesystem::remove(path); }
+
+    // Aligned in memory copy of the written file
+    std::vector<uint64_t> read() const {
+        std::ifstream     file(path, std::ios::binary);
+        std::vector<char> chars((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+        std::vector<uint64_t> result((chars.size() + 7) / 8);
+        std::memcpy(result.data(), chars.data(), chars.size());
+        fileSize = chars.size();
+        return result;
+    }
+    mutable size_t fileSize = 0;
+};
+
+TEST_F(BatchedWriter, ManySmallHeaders) {
+    constexpr size_t Count = 500;
+    {
+        // Small buffers so writes cycle through the ring many times
+        batched_writer<BatchedRootHeader> writer(
+            path, Count, batched_writer_options{.bufferSize = 8192, .bufferCount = 3});
+        for (size_t i = 0; i < Count; ++i) {
+            // Reverse order so the header list must be sorted
+            size_t id = Count - 1 - i;
+            auto*  header = writer.create<BatchedHeader>(batchedIdentifier(id));
+            header->data = create::array<uint16_t>(writer.memory(), id % 7 + 1);
+            std::ranges::fill(header->data, uint16_t(id));
+        }
+        writer.finish();
+        EXPECT_EQ(writer.size(), std::filesystem::file_size(path));
+    }
+
+    std::vector<uint64_t> file = read();
+    auto*                 root = reinterpret_cast<const RootHeader*>(file.data());
+    ASSERT_TRUE(root->magicValid());
+    ASSERT_EQ(root->headers.size(), Count);
+    EXPECT_TRUE(std::ranges::is_sorted(root->headers, RootHeader::HeaderPtrComp()));
+    for (size_t id = 0; id < Count; ++id) {
+        auto* header = reinterpret_cast<const BatchedHeader*>(root->find(batchedIdentifier(id)));
+        ASSERT_NE(header, nullptr);
+        ASSERT_EQ(header->data.size(), id % 7 + 1);
+        EXPECT_EQ(header->data.back(), uint16_t(id));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(header) % alignof(BatchedHeader), 0u);
+    }
+}
+
+TEST_F(BatchedWriter, StreamingOrder) {
+    // Sub-headers are laid out in creation order, so the file can also be read
+    // by extent with buffer_pool_reader
+    {
+        batched_writer<BatchedRootHeader> writer(path, 2, {});
+        auto* a = writer.create<BatchedHeader>(batchedIdentifier(1));
+        a->data = create::array<uint16_t>(writer.memory(), 3000);
+        std::iota(a->data.begin(), a->data.end(), uint16_t(0));
+        auto* b = writer.create<BatchedHeader>(batchedIdentifier(0));
+        b->data = create::array<uint16_t>(writer.memory(), 5);
+        std::ranges::fill(b->data, uint16_t(9));
+        writer.finish();
+    }
+    buffer_pool_reader reader(path, 1 << 20);
+    auto               a = reader.find(batchedIdentifier(1));
+    ASSERT_TRUE(a);
+    auto* header = reinterpret_cast<const BatchedHeader*>(a.get());
+    EXPECT_EQ(header->data.size(), 3000u);
+    EXPECT_EQ(header->data[2999], 2999);
+}
+
+TEST_F(BatchedWriter, Errors) {
+    batched_writer<BatchedRootHeader> writer(path, 1, batched_writer_options{.scratchSize = 256});
+    auto* header = writer.create<BatchedHeader>(batchedIdentifier(0));
+    EXPECT_THROW(create::array<uint16_t>(writer.memory(), 1000), std::length_error);
+    header->data = create::array<uint16_t>(writer.memory(), 10);
+    EXPECT_THROW(writer.create<BatchedHeader>(batchedIdentifier(1)), std::length_error);
+    writer.finish();
+}
+
+TEST_F(BatchedWriter, Unfinished) {
+    {
+        batched_writer<BatchedRootHeader> writer(
+            path, 100, batched_writer_options{.bufferSize = 2 * direct_writer::BlockSize});
+        for (size_t id = 0; id < 50; ++id) {
+            auto* header = writer.create<BatchedHeader>(batchedIdentifier(id));
+            header->data = create::array<uint16_t>(writer.memory(), 1000);
+        }
+        EXPECT_GT(writer.size(), 50 * 2000u);
+    }
+    // Abandoned part way, so nothing that looks like a decodeless file remains
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+}
+
+#if !defined(_WIN32)
+TEST_F(BatchedWriter, FailedFinish) {
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &limit), 0);
+    auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    {
+        batched_writer<BatchedRootHeader> writer(
+            path, 20, batched_writer_options{.bufferSize = 2 * direct_writer::BlockSize});
+        for (size_t id = 0; id < 20; ++id) {
+            auto* header = writer.create<BatchedHeader>(batchedIdentifier(id));
+            header->data = create::array<uint16_t>(writer.memory(), 1000);
+        }
+
+        // Payload is on disk but the root header is only written last
+        ASSERT_GT(std::filesystem::file_size(path), 0u);
+        EXPECT_FALSE(reinterpret_cast<const RootHeader*>(read().data())->magicValid());
+
+        // Writes past the current size fail with EFBIG
+        rlimit small = limit;
+        small.rlim_cur = std::filesystem::file_size(path);
+        ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &small), 0);
+        EXPECT_THROW(writer.finish(), std::system_error);
+        ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+    std::signal(SIGXFSZ, previousHandler);
+}
+#endif
+
+TEST_F(BatchedWriter, Rewrite) {
+    std::vector<std::byte> data(3 * direct_writer::BlockSize + 100, std::byte(1));
+    std::vector<std::byte> patch(direct_writer::BlockSize, std::byte(2));
+    std::vector<std::byte> tail(100, std::byte(3));
+    {
+        direct_writer writer(path, 2 * direct_writer::BlockSize, 3);
+        writer.write(data);
+
+        // Already submitted, in the staging buffer and past the end
+        writer.rewrite(direct_writer::BlockSize, patch);
+        writer.rewrite(3 * direct_writer::BlockSize, tail);
+        EXPECT_THROW(writer.rewrite(3 * direct_writer::BlockSize, patch), std::invalid_argument);
+        EXPECT_THROW(writer.rewrite(100, tail), std::invalid_argument);
+        writer.finish();
+    }
+    std::ranges::copy(patch, data.begin() + direct_writer::BlockSize);
+    std::ranges::copy(tail, data.begin() + 3 * direct_writer::BlockSize);
+    std::vector<uint64_t> file = read();
+    ASSERT_EQ(fileSize, data.size());
+    EXPECT_EQ(std::memcmp(file.data(), data.data(), data.size()), 0);
+}
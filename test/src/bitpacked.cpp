@@ -0,0 +1,93 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/bitpacked.hpp>
+#include <decodeless/header.hpp>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace decodeless;
+
+struct ColumnHeader : Header {
+    static constexpr Magic  HeaderIdentifier{"COLUMN"};
+    BitPackedArray<int32_t> column;
+};
+
+template <class T>
+static void checkPacked(const std::vector<T>& values) {
+    linear_memory_resource<> memory(values.size() * sizeof(T) * 2 + 4096);
+    BitPackedArray<T>        packed;
+    buildBitPackedArray(packed, memory, std::span<const T>(values));
+    ASSERT_EQ(packed.size, values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        ASSERT_EQ(packed[i], values[i]) << i;
+
+    std::vector<T> unpacked(values.size());
+    packed.unpack(0, unpacked);
+    EXPECT_EQ(unpacked, values);
+    if (values.size() > 300) {
+        std::vector<T> middle(200);
+        packed.unpack(100, middle);
+        EXPECT_TRUE(std::equal(middle.begin(), middle.end(), values.begin() + 100));
+    }
+}
+
+TEST(BitPackedArray, Widths) {
+    std::mt19937_64 rng(1);
+    for (unsigned width = 0; width <= 32; ++width) {
+        std::vector<int32_t> values(1000);
+        for (int32_t& v : values)
+            v = -5000 + int32_t(width == 0 ? 0 : rng() & ((uint64_t(1) << width) - 1));
+        checkPacked(values);
+    }
+}
+
+TEST(BitPackedArray, Extremes) {
+    checkPacked(std::vector<uint64_t>{0, std::numeric_limits<uint64_t>::max(), 5});
+    checkPacked(std::vector<int64_t>{std::numeric_limits<int64_t>::min(), 0,
+                                     std::numeric_limits<int64_t>::max()});
+    checkPacked(std::vector<int32_t>{});
+    checkPacked(std::vector<uint8_t>{255, 0, 17});
+}
+
+TEST(BitPackedArray, Compresses) {
+    std::mt19937         rng(2);
+    std::vector<int32_t> values(100000);
+    for (int32_t& v : values)
+        v = 1000 + int32_t(rng() % 1000);
+    linear_memory_resource<> memory(1 << 20);
+    auto*                    header = create::object<ColumnHeader>(memory);
+    buildBitPackedArray(header->column, memory, std::span<const int32_t>(values));
+    size_t packedBytes = header->column.words.size() * 8 + header->column.blocks.size() * 16;
+    EXPECT_LT(packedBytes, values.size() * sizeof(int32_t) * 12 / 32);
+}
+
+TEST(BitPackedArray, RangePredicates) {
+    std::mt19937         rng(3);
+    std::vector<int32_t> values(10000);
+    for (size_t i = 0; i < values.size(); ++i)
+        values[i] = int32_t(i / 128) * 50 + int32_t(rng() % 40) - 2000;
+    linear_memory_resource<> memory(1 << 20);
+    BitPackedArray<int32_t>  packed;
+    buildBitPackedArray(packed, memory, std::span<const int32_t>(values));
+
+    for (auto [lo, hi] : {std::pair{-2000, -1990}, {-100, 100}, {-5000, 5000}, {3, 2}, {0, 0}}) {
+        uint64_t             expected = 0;
+        std::vector<int32_t> expectedValues, actualValues;
+        for (int32_t v : values) {
+            if (v >= lo && v <= hi) {
+                ++expected;
+                expectedValues.push_back(v);
+            }
+        }
+        EXPECT_EQ(packed.countInRange(lo, hi), expected);
+        packed.forEachInRange(lo, hi, [&](uint64_t i, int32_t v) {
+            EXPECT_EQ(values[i], v);
+            actualValues.push_back(v);
+        });
+        EXPECT_EQ(actualValues, expectedValues);
+    }
+}
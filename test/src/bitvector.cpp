@@ -0,0 +1,70 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/bitvector.hpp>
+#include <decodeless/header.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using namespace decodeless;
+
+TEST(BitVector, SelectInWord) {
+    EXPECT_EQ(selectInWord(1, 0), 0);
+    EXPECT_EQ(selectInWord(0x8000000000000000ull, 0), 63);
+    EXPECT_EQ(selectInWord(0b10110, 0), 1);
+    EXPECT_EQ(selectInWord(0b10110, 1), 2);
+    EXPECT_EQ(selectInWord(0b10110, 2), 4);
+    EXPECT_EQ(selectInWord(~0ull, 37), 37);
+    EXPECT_EQ(selectInWord(0xff00000000000100ull, 1), 56);
+}
+
+struct BitmapHeader : Header {
+    static constexpr Magic HeaderIdentifier{"BITMAP"};
+    RankSelectBitVector    bits;
+};
+
+static void checkBitVector(double density, uint64_t sizeBits, uint32_t seed) {
+    linear_memory_resource<> memory(sizeBits / 4 + 4096);
+    auto*                    header = create::object<BitmapHeader>(memory);
+    std::span<uint64_t>      words = create::array<uint64_t>(memory, (sizeBits + 63) / 64);
+
+    std::mt19937                rng(seed);
+    std::bernoulli_distribution bit(density);
+    std::vector<uint64_t>       positions;
+    for (uint64_t i = 0; i < words.size() * 64; ++i) {
+        if (bit(rng)) {
+            words[i / 64] |= uint64_t(1) << (i % 64);
+            if (i < sizeBits)
+                positions.push_back(i);
+        }
+    }
+    buildRankSelect(header->bits, memory, words, sizeBits);
+
+    const RankSelectBitVector& bits = header->bits;
+    EXPECT_EQ(bits.size, sizeBits);
+    ASSERT_EQ(bits.ones, positions.size());
+    uint64_t expectedRank = 0;
+    for (uint64_t i = 0; i <= sizeBits; ++i) {
+        ASSERT_EQ(bits.rank1(i), expectedRank) << "rank1(" << i << ")";
+        if (i < sizeBits && bits[i])
+            ++expectedRank;
+    }
+    for (uint64_t k = 0; k < positions.size(); ++k)
+        ASSERT_EQ(bits.select1(k), positions[k]) << "select1(" << k << ")";
+}
+
+TEST(BitVector, Empty) {
+    linear_memory_resource<> memory(4096);
+    RankSelectBitVector      bits;
+    buildRankSelect(bits, memory, std::span<uint64_t>(), 0);
+    EXPECT_EQ(bits.ones, 0);
+    EXPECT_EQ(bits.rank1(0), 0);
+}
+
+TEST(BitVector, Dense) { checkBitVector(0.9, 100000, 1); }
+TEST(BitVector, Half) { checkBitVector(0.5, 65536, 2); }
+TEST(BitVector, Sparse) { checkBitVector(0.001, 1000003, 3); }
+TEST(BitVector, AllOnes) { checkBitVector(1.0, 20000, 4); }
+TEST(BitVector, AllZeros) { checkBitVector(0.0, 20000, 5); }
@@ -0,0 +1,134 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include "test_headers.hpp"
+#include <cstdint>
+#include <cstring>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/buffer_pool.hpp>
+#include <decodeless/direct_writer.hpp>
+#include <decodeless/streaming.hpp>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <numeric>
+
+using namespace decodeless;
+
+struct PoolRootHeader : RootHeader {
+    PoolRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+struct BufferPool : testing::Test {
+    // Each extent holds 2000 ints, so it spans at least two 4096 byte blocks
+    static constexpr size_t Count = 2000;
+
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        (std::string("decodeless_") +
+         testing::UnitTest::GetInstance()->current_test_info()->name() + ".bin");
+
+    void SetUp() override {
+        linear_memory_resource<> memory(1 << 16);
+        streaming_writer<PoolRootHeader, linear_memory_resource<>> writer(memory, 3);
+        fill(writer.create<DataHeader<"poolc">>(), writer.memory(), 3000);
+        fill(writer.create<DataHeader<"poola">>(), writer.memory(), 1000);
+        fill(writer.create<DataHeader<"poolb">>(), writer.memory(), 2000);
+        writer.finish();
+        writeDirect(path, std::span<const std::byte>(memory.data(), memory.size()));
+    }
+    void TearDown() override { std::filesystem::remove(path); }
+
+    template <class H>
+    static void fill(H* header, linear_memory_resource<>& memory, int first) {
+        header->data = create::array<int>(memory, Count);
+        std::iota(header->data.begin(), header->data.end(), first);
+    }
+
+    template <class H>
+    static void expectData(const pinned<const H>& header, int first) {
+        ASSERT_TRUE(header);
+        ASSERT_EQ(header->data.size(), Count);
+        EXPECT_EQ(header->data.front(), first);
+        EXPECT_EQ(header->data.back(), first + int(Count) - 1);
+    }
+};
+
+TEST_F(BufferPool, Find) {
+    buffer_pool_reader reader(path, 1 << 20);
+    EXPECT_TRUE(reader.root().magicValid());
+    EXPECT_EQ(reader.root().headers.size(), 3u);
+    EXPECT_EQ(reader.residentBytes(), 0u);
+    expectData(reader.find<DataHeader<"poola">>(), 1000);
+    expectData(reader.findSupported<DataHeader<"poolb">>(), 2000);
+    expectData(reader.find<DataHeader<"poolc">>(), 3000);
+    EXPECT_FALSE(reader.find<DataHeader<"poold">>());
+    EXPECT_GT(reader.residentBytes(), 3 * Count * sizeof(int));
+    EXPECT_LE(reader.residentBytes(), reader.capacity());
+}
+
+TEST_F(BufferPool, Eviction) {
+    // Room for exactly one extent at a time
+    buffer_pool_reader reader(path, 3 * buffer_pool_reader::BlockSize);
+    for (int pass = 0; pass < 3; ++pass) {
+        expectData(reader.find<DataHeader<"poola">>(), 1000);
+        expectData(reader.find<DataHeader<"poolb">>(), 2000);
+        expectData(reader.find<DataHeader<"poolc">>(), 3000);
+        EXPECT_LE(reader.residentBytes(), reader.capacity());
+    }
+
+    // Repeated lookups of a resident extent do not reload it
+    auto   first = reader.find<DataHeader<"poolc">>();
+    size_t resident = reader.residentBytes();
+    EXPECT_EQ(reader.find<DataHeader<"poolc">>().get(), first.get());
+    EXPECT_EQ(reader.residentBytes(), resident);
+}
+
+TEST_F(BufferPool, Pinned) {
+    buffer_pool_reader reader(path, 3 * buffer_pool_reader::BlockSize);
+    auto               a = reader.find<DataHeader<"poola">>();
+    EXPECT_THROW(reader.find<DataHeader<"poolb">>(), buffer_pool_error);
+
+    // The pinned extent is untouched by the failed load
+    expectData(a, 1000);
+    a.reset();
+    EXPECT_FALSE(a);
+    expectData(reader.find<DataHeader<"poolb">>(), 2000);
+}
+
+TEST_F(BufferPool, TooSmall) {
+    buffer_pool_reader reader(path, buffer_pool_reader::BlockSize);
+    EXPECT_THROW(reader.find<DataHeader<"poola">>(), buffer_pool_error);
+    EXPECT_EQ(reader.residentBytes(), 0u);
+}
+
+TEST_F(BufferPool, NotDecodeless) {
+    writeDirect(path, std::as_bytes(std::span("not a decodeless file, just some text bytes")));
+    EXPECT_THROW(buffer_pool_reader(path, 1 << 20), buffer_pool_error);
+}
+
+TEST_F(BufferPool, CorruptHeaderCount) {
+    // A header count large enough that the end of the list wraps around to
+    // just before its start, which is still inside the file
+    linear_memory_resource<> memory(4096);
+    auto* root = create::object<PoolRootHeader>(memory);
+    auto  list = create::array<offset_ptr<Header>>(memory, 2);
+    list[1] = create::object<DataHeader<"poola">>(memory);
+    root->headers = std::span(&list[1], 1);
+
+    // Written raw, as constructing a std::span of that size is itself invalid
+    size_t count = SIZE_MAX / sizeof(offset_ptr<Header>);
+    static_assert(sizeof(root->headers) == sizeof(offset_ptr<Header>) + sizeof(count));
+    std::memcpy(reinterpret_cast<std::byte*>(&root->headers) + sizeof(offset_ptr<Header>), &count,
+                sizeof(count));
+    ASSERT_EQ(root->headers.size(), count);
+    writeDirect(path, std::span<const std::byte>(memory.data(), memory.size()));
+    EXPECT_THROW(buffer_pool_reader(path, 1 << 20), buffer_pool_error);
+}
+
+TEST_F(BufferPool, Incompatible) {
+    linear_memory_resource<> memory(4096);
+    create::object<PoolRootHeader>(memory)->platformBits.flip();
+    writeDirect(path, std::span<const std::byte>(memory.data(), memory.size()));
+    EXPECT_THROW(buffer_pool_reader(path, 1 << 20), buffer_pool_error);
+}
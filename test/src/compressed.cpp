@@ -0,0 +1,175 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/compressed.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace decodeless;
+
+struct CompressedRootHeader : RootHeader {
+    CompressedRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+// A tiny sub-header type with many instances, each with its own identifier
+struct MaterialHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"material"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    MaterialHeader(const Magic& identifier)
+        : Header{.identifier = identifier, .version = VersionSupported, .gitHash = ""} {}
+    float             roughness = 0.5f;
+    float             metallic = 0.0f;
+    offset_span<char> shader;
+    offset_span<int>  textures;
+};
+
+static Magic materialIdentifier(size_t i) {
+    return Magic("material-" + std::to_string(i));
+}
+
+// Appends material i to memory and returns its contiguous region
+static std::span<const std::byte> writeMaterial(linear_memory_resource<>& memory, size_t i) {
+    size_t begin = memory.size();
+    auto*  header = create::object<MaterialHeader>(memory, materialIdentifier(i));
+    header->roughness = float(i % 10) / 10.0f;
+    std::string shader = "shaders/pbr_standard_metallic_roughness.glsl#variant=" +
+                         std::to_string(i % 4);
+    header->shader = create::array<char>(memory, shader.size());
+    std::ranges::copy(shader, header->shader.begin());
+    header->textures = create::array<int>(memory, 4);
+    for (int t = 0; t < 4; ++t)
+        header->textures[t] = int(i % 16) * 4 + t;
+    return {memory.data() + begin, memory.size() - begin};
+}
+
+TEST(Compressed, RoundTrip) {
+    std::mt19937           rng(3);
+    std::vector<std::byte> dictionaryContent(1000), region(5000);
+    for (std::byte& b : dictionaryContent)
+        b = std::byte(rng() % 4);
+    for (std::byte& b : region)
+        b = std::byte(rng() % 4);
+    std::ranges::copy(std::span(dictionaryContent).subspan(100, 500), region.begin() + 2000);
+
+    for (bool useDictionary : {false, true}) {
+        compression_dictionary dictionary(useDictionary ? dictionaryContent
+                                                        : std::vector<std::byte>{});
+        std::vector<std::byte> compressed = dictionary.compress(region);
+        EXPECT_LT(compressed.size(), region.size());
+        std::vector<std::byte> decompressed(region.size());
+        decompress(dictionary.content(), compressed, decompressed);
+        EXPECT_EQ(decompressed, region);
+    }
+
+    // Long runs are split into matches of at most LzMaxMatch
+    std::vector<std::byte> run(100000, std::byte(9));
+    compression_dictionary empty;
+    std::vector<std::byte> runCompressed = empty.compress(run);
+    EXPECT_LE(run.size(), detail::lzMaxOutput(runCompressed.size()));
+    std::vector<std::byte> runDecompressed(run.size());
+    decompress({}, runCompressed, runDecompressed);
+    EXPECT_EQ(runDecompressed, run);
+
+    std::vector<std::byte> nothing;
+    std::vector<std::byte> compressed = empty.compress(nothing);
+    decompress({}, compressed, nothing);
+}
+
+TEST(Compressed, Corrupt) {
+    std::vector<std::byte> region(300, std::byte(7));
+    compression_dictionary dictionary;
+    std::vector<std::byte> compressed = dictionary.compress(region);
+    std::vector<std::byte> out(region.size());
+    EXPECT_THROW(decompress({}, std::span(compressed).first(compressed.size() - 1), out),
+                 decompression_error);
+    std::vector<std::byte> shorter(region.size() - 1);
+    EXPECT_THROW(decompress({}, compressed, shorter), decompression_error);
+
+    // Match distance beyond the start of the output
+    std::vector<std::byte> bad{std::byte(1), std::byte(7), std::byte(5), std::byte(0)};
+    EXPECT_THROW(decompress({}, bad, out), decompression_error);
+}
+
+TEST(Compressed, SharedDictionary) {
+    constexpr size_t                      Count = 2000;
+    linear_memory_resource<>                regions(1 << 20);
+    std::vector<std::span<const std::byte>> samples;
+    for (size_t i = 0; i < Count; ++i)
+        samples.push_back(writeMaterial(regions, i));
+
+    // Small headers barely compress alone but share most of their content
+    compressed_headers_builder alone, shared;
+    alone.add(alone.addDictionary({}), samples[0]);
+    uint32_t dictionary =
+        shared.addDictionary(trainDictionary(std::span(samples).first(100), 4096));
+    for (std::span<const std::byte> sample : samples)
+        shared.add(dictionary, sample);
+    EXPECT_LT(shared.compressedSize() * 3, alone.compressedSize() * Count);
+    EXPECT_LT(shared.compressedSize() * 4, regions.size());
+
+    linear_memory_resource<> memory(1 << 20);
+    auto*                    root = create::object<CompressedRootHeader>(memory);
+    CompressedHeaders*       compressed = shared.create(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = compressed;
+    EXPECT_LT(memory.size(), regions.size());
+
+    decompressed_headers headers(*root);
+    EXPECT_EQ(headers.find<CompressedHeaders>(), compressed);
+    EXPECT_EQ(headers.find(materialIdentifier(Count)), nullptr);
+    for (size_t i : {size_t(0), size_t(1), size_t(1234), Count - 1}) {
+        auto* material = reinterpret_cast<MaterialHeader*>(headers.find(materialIdentifier(i)));
+        ASSERT_NE(material, nullptr);
+        EXPECT_EQ(material->identifier, materialIdentifier(i));
+        EXPECT_EQ(material->roughness, float(i % 10) / 10.0f);
+        EXPECT_EQ(std::string_view(material->shader.data(), material->shader.size()).back(),
+                  char('0' + i % 4));
+        EXPECT_EQ(material->textures[3], int(i % 16) * 4 + 3);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(material) % alignof(MaterialHeader), 0u);
+
+        // Decompressed once
+        EXPECT_EQ(headers.find(materialIdentifier(i)), material);
+    }
+}
+
+TEST(Compressed, UnknownCodec) {
+    linear_memory_resource<>   regions(4096);
+    compressed_headers_builder builder;
+    builder.add(builder.addDictionary({}), writeMaterial(regions, 0));
+
+    linear_memory_resource<> memory(1 << 16);
+    auto*                    root = create::object<CompressedRootHeader>(memory);
+    CompressedHeaders*       compressed = builder.create(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = compressed;
+    EXPECT_EQ(compressed->entries[0].codec, CompressionCodec::Lz77);
+    compressed->entries[0].codec = CompressionCodec(7);
+
+    decompressed_headers headers(*root);
+    EXPECT_THROW(headers.find(materialIdentifier(0)), decompression_error);
+}
+
+TEST(Compressed, CorruptEntry) {
+    linear_memory_resource<>   regions(4096);
+    compressed_headers_builder builder;
+    builder.add(builder.addDictionary({}), writeMaterial(regions, 0));
+
+    linear_memory_resource<> memory(1 << 16);
+    auto*                    root = create::object<CompressedRootHeader>(memory);
+    CompressedHeaders*       compressed = builder.create(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = compressed;
+
+    // A size the compressed data cannot produce is rejected before allocating
+    compressed->entries[0].size = uint64_t(1) << 60;
+    decompressed_headers headers(*root);
+    EXPECT_THROW(headers.find(materialIdentifier(0)), decompression_error);
+
+    // An incompatible CompressedHeaders layout is not parsed
+    compressed->version.major = 2;
+    EXPECT_EQ(headers.find(materialIdentifier(0)), nullptr);
+}
@@ -0,0 +1,122 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <atomic>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/csr_graph.hpp>
+#include <decodeless/header.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using namespace decodeless;
+
+struct GraphHeader : Header {
+    static constexpr Magic HeaderIdentifier{"GRAPH"};
+    CsrGraph<float>        graph;
+};
+
+TEST(CsrGraph, Small) {
+    std::vector<CsrEdge>     edges{{2, 0}, {0, 1}, {0, 2}, {2, 1}, {0, 3}};
+    std::vector<float>       weights{2.0f, 0.5f, 1.5f, 3.0f, 4.0f};
+    linear_memory_resource<> memory(4096);
+    auto*                    header = create::object<GraphHeader>(memory);
+    buildCsrGraph(header->graph, memory, 4, std::span<const CsrEdge>(edges), weights, 2);
+
+    const CsrGraph<float>& graph = header->graph;
+    EXPECT_EQ(graph.vertexCount(), 4u);
+    EXPECT_EQ(graph.edgeCount(), 5u);
+    EXPECT_TRUE(graph.weighted());
+    EXPECT_EQ(std::vector<uint32_t>(graph.neighborsOf(0).begin(), graph.neighborsOf(0).end()),
+              (std::vector<uint32_t>{1, 2, 3}));
+    EXPECT_EQ(graph.degree(1), 0u);
+    EXPECT_EQ(std::vector<uint32_t>(graph.neighborsOf(2).begin(), graph.neighborsOf(2).end()),
+              (std::vector<uint32_t>{0, 1}));
+    EXPECT_EQ(graph.weightsOf(2)[1], 3.0f);
+
+    float total = 0.0f;
+    graph.forEachNeighbor(0, [&](uint32_t, float w) { total += w; });
+    EXPECT_EQ(total, 6.0f);
+}
+
+TEST(CsrGraph, GenericCallback) {
+    std::vector<CsrEdge>     edges{{0, 1}, {0, 2}};
+    std::vector<float>       weights{2.0f, 0.5f};
+    linear_memory_resource<> memory(4096);
+    CsrGraph<float>          weighted, unweighted;
+    buildCsrGraph(weighted, memory, 3, std::span<const CsrEdge>(edges), weights, 1);
+    buildCsrGraph(unweighted, memory, 3, std::span<const CsrEdge>(edges), {}, 1);
+
+    // Accepts either form, so the graph decides whether weights are passed
+    std::vector<float> seen;
+    auto visit = [&](uint32_t, auto... weight) { seen.push_back((0.0f + ... + weight)); };
+    weighted.forEachNeighbor(0, visit);
+    EXPECT_EQ(seen, (std::vector<float>{2.0f, 0.5f}));
+    seen.clear();
+    unweighted.forEachNeighbor(0, visit);
+    EXPECT_EQ(seen, (std::vector<float>{0.0f, 0.0f}));
+
+    // A weight-only callback cannot be called without weights
+    EXPECT_THROW(unweighted.forEachNeighbor(0, [](uint32_t, float) {}), std::invalid_argument);
+}
+
+TEST(CsrGraph, ParallelMatchesSerial) {
+    const uint32_t       vertices = 5000;
+    std::mt19937         rng(7);
+    std::vector<CsrEdge> edges(200000);
+    for (CsrEdge& edge : edges)
+        edge = {uint32_t(rng() % vertices), uint32_t(rng() % vertices)};
+
+    linear_memory_resource<> memory(4 << 20);
+    CsrGraph<float>          serial, parallel;
+    buildCsrGraph(serial, memory, vertices, std::span<const CsrEdge>(edges), {}, 1);
+    buildCsrGraph(parallel, memory, vertices, std::span<const CsrEdge>(edges), {}, 8);
+    EXPECT_FALSE(parallel.weighted());
+    ASSERT_TRUE(std::ranges::equal(serial.offsets, parallel.offsets));
+    ASSERT_TRUE(std::ranges::equal(serial.neighbors, parallel.neighbors));
+
+    // Edge lists keep input order
+    std::vector<std::vector<uint32_t>> expected(vertices);
+    for (const CsrEdge& edge : edges)
+        expected[edge.source].push_back(edge.target);
+    for (uint32_t v = 0; v < vertices; ++v) {
+        std::vector<uint32_t> visited;
+        parallel.forEachNeighbor(v, [&](uint32_t u) { visited.push_back(u); });
+        ASSERT_EQ(visited, expected[v]);
+    }
+}
+
+TEST(CsrGraph, Partition) {
+    const uint32_t       vertices = 1000;
+    std::vector<CsrEdge> edges;
+    for (uint32_t v = 0; v < vertices; ++v)
+        for (uint32_t i = 0; i < v % 10; ++i)
+            edges.push_back({v, i});
+    linear_memory_resource<> memory(1 << 16);
+    CsrGraph<float>          graph;
+    buildCsrGraph(graph, memory, vertices, std::span<const CsrEdge>(edges));
+
+    std::vector<CsrVertexRange> ranges = graph.partition(4);
+    ASSERT_EQ(ranges.size(), 4u);
+    EXPECT_EQ(ranges.front().begin, 0u);
+    EXPECT_EQ(ranges.back().end, vertices);
+    std::atomic<uint64_t> visited = 0;
+    detail::parallelFor(ranges.size(), [&](size_t i) {
+        uint64_t edgesInRange = graph.offsets[ranges[i].end] - graph.offsets[ranges[i].begin];
+        EXPECT_NEAR(double(edgesInRange), edges.size() / 4.0, 10.0);
+        for (uint32_t v = ranges[i].begin; v < ranges[i].end; ++v)
+            graph.forEachNeighbor(v, [&](uint32_t) { ++visited; });
+        if (i) {
+            EXPECT_EQ(ranges[i].begin, ranges[i - 1].end);
+        }
+    });
+    EXPECT_EQ(visited, edges.size());
+}
+
+TEST(CsrGraph, OutOfRange) {
+    std::vector<CsrEdge>     edges{{0, 5}};
+    linear_memory_resource<> memory(4096);
+    CsrGraph<float>          graph;
+    EXPECT_THROW(buildCsrGraph(graph, memory, 2, std::span<const CsrEdge>(edges)),
+                 std::out_of_range);
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <algorithm>
+#include <atomic>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/derived_cache.hpp>
+#include <functional>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace decodeless;
+
+struct DerivedRootHeader : RootHeader {
+    DerivedRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+struct IndexedKeysHeader : Header {
+    static constexpr Magic HeaderIdentifier{"KEYS"};
+    IndexedKeysHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    offset_span<int> keys;
+};
+
+struct MissingHeader : Header {
+    static constexpr Magic HeaderIdentifier{"MISSING"};
+};
+
+// Key to index map over the mapped keys
+using KeyIndex = std::pmr::unordered_map<int, size_t>;
+
+static KeyIndex buildKeyIndex(const IndexedKeysHeader& header, std::pmr::memory_resource& arena) {
+    KeyIndex result(&arena);
+    for (size_t i = 0; i < header.keys.size(); ++i)
+        result.emplace(header.keys[i], i);
+    return result;
+}
+
+struct DerivedCache : testing::Test {
+    linear_memory_resource<> memory{1 << 16};
+    RootHeader*              root = nullptr;
+
+    void SetUp() override {
+        root = create::object<DerivedRootHeader>(memory);
+        auto* header = create::object<IndexedKeysHeader>(memory);
+        header->keys = create::array<int>(memory, 1000);
+        for (int i = 0; i < 1000; ++i)
+            header->keys[i] = i * 7;
+        root->headers = create::array<offset_ptr<Header>>(memory, 1);
+        root->headers[0] = header;
+    }
+};
+
+TEST_F(DerivedCache, BuildOnce) {
+    derived_cache     cache(*root);
+    std::atomic<int>  builds = 0;
+    std::atomic<bool> correct = true;
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&] {
+                const KeyIndex* index = cache.get_or_build<IndexedKeysHeader, KeyIndex>(
+                    [&](const IndexedKeysHeader& header, std::pmr::memory_resource& arena) {
+                        ++builds;
+                        return buildKeyIndex(header, arena);
+                    });
+                if (!index || index->at(700) != 100)
+                    correct = false;
+            });
+        }
+    }
+    EXPECT_EQ(builds, 1);
+    EXPECT_TRUE(correct);
+
+    // Different derived types from the same sub-header are separate entries
+    using Descending = std::pmr::vector<int>;
+    const Descending* descending = cache.get_or_build<IndexedKeysHeader, Descending>(
+        [](const IndexedKeysHeader& header, std::pmr::memory_resource& arena) {
+            Descending result(header.keys.begin(), header.keys.end(), &arena);
+            std::ranges::sort(result, std::greater<>());
+            return result;
+        });
+    ASSERT_NE(descending, nullptr);
+    EXPECT_EQ(descending->front(), 999 * 7);
+}
+
+TEST_F(DerivedCache, Missing) {
+    derived_cache cache(*root);
+    bool          built = false;
+    EXPECT_EQ((cache.get_or_build<MissingHeader, int>(
+                  [&](const MissingHeader&, std::pmr::memory_resource&) {
+                      built = true;
+                      return 1;
+                  })),
+              nullptr);
+    EXPECT_FALSE(built);
+}
+
+TEST_F(DerivedCache, RetryAfterThrow) {
+    derived_cache cache(*root);
+    auto          fail = [](const IndexedKeysHeader&, std::pmr::memory_resource&) -> KeyIndex {
+        throw std::runtime_error("build failed");
+    };
+    EXPECT_THROW((cache.get_or_build<IndexedKeysHeader, KeyIndex>(fail)), std::runtime_error);
+    const KeyIndex* index = cache.get_or_build<IndexedKeysHeader, KeyIndex>(buildKeyIndex);
+    ASSERT_NE(index, nullptr);
+    EXPECT_EQ(index->size(), 1000u);
+}
+
+TEST_F(DerivedCache, DestroyedWithCache) {
+    struct Counted {
+        int* destroyed;
+        ~Counted() { ++*destroyed; }
+    };
+    int destroyed = 0;
+    {
+        derived_cache cache(*root);
+        cache.get_or_build<IndexedKeysHeader, Counted>(
+            [&](const IndexedKeysHeader&, std::pmr::memory_resource&) {
+                return Counted{&destroyed};
+            });
+        EXPECT_EQ(destroyed, 0);
+    }
+    EXPECT_EQ(destroyed, 1);
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/direct_writer.hpp>
+#include <decodeless/header.hpp>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+using namespace decodeless;
+
+static std::vector<std::byte> readFile(const std::filesystem::path& path) {
+    std::ifstream     file(path, std::ios::binary);
+    std::vector<char> chars((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+    std::vector<std::byte> result(chars.size());
+    std::memcpy(result.data(), chars.data(), chars.size());
+    return result;
+}
+
+struct DirectWriter : testing::Test {
+    std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        (std::string("decodeless_") +
+         testing::UnitTest::GetInstance()->current_test_info()->name() + ".bin");
+    void TearDown() override { std::filesystem::remove(path); }
+};
+
+TEST_F(DirectWriter, PipelinedChunks) {
+    std::mt19937           rng(1);
+    std::vector<std::byte> data(3 * 8192 + 1234);
+    for (std::byte& b : data)
+        b = std::byte(rng());
+    {
+        // Small buffers so the writes cycle through both staging buffers
+        direct_writer writer(path, 8192);
+        for (size_t offset = 0; offset < data.size(); offset += 1000) {
+            size_t size = std::min<size_t>(1000, data.size() - offset);
+            writer.write(std::span<const std::byte>(data).subspan(offset, size));
+        }
+        EXPECT_EQ(writer.size(), data.size());
+        writer.finish();
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), data.size());
+    EXPECT_EQ(readFile(path), data);
+}
+
+TEST_F(DirectWriter, RootHeaderImage) {
+    linear_memory_resource<> memory(1 << 16);
+    auto*                    root = create::object<RootHeader>(memory, "DECODELESS-TEST");
+    auto                     values = create::array<int>(memory, 1001);
+    std::ranges::fill(values, 3);
+    root->headers = create::array<offset_ptr<Header>>(memory, 0);
+    std::span<const std::byte> image(memory.data(), memory.size());
+    writeDirect(path, image);
+
+    std::vector<std::byte> written = readFile(path);
+    ASSERT_EQ(written.size(), image.size());
+    EXPECT_TRUE(std::ranges::equal(written, image));
+    EXPECT_TRUE(reinterpret_cast<const RootHeader*>(written.data())->magicValid());
+}
+
+TEST_F(DirectWriter, Empty) {
+    writeDirect(path, {});
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+}
+
+TEST_F(DirectWriter, Unfinished) {
+    std::vector<std::byte> data(3 * 8192 + 1234, std::byte(7));
+    {
+        direct_writer writer(path, 8192);
+        writer.write(data);
+        EXPECT_EQ(writer.size(), data.size());
+    }
+    // Abandoned without finish(), so no partial file remains
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+}
+
+#if !defined(_WIN32)
+TEST_F(DirectWriter, FailedFinish) {
+    // RLIMIT_FSIZE makes writes past 8 KiB fail with EFBIG rather than raise
+    // SIGXFSZ, so finish() fails writing the tail
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &limit), 0);
+    auto previousHandler = std::signal(SIGXFSZ, SIG_IGN);
+    std::vector<std::byte> data(8192 + 1234, std::byte(5));
+    for (bool useIoUring : {false, true}) {
+        {
+            direct_writer writer(path, 8192, 4, useIoUring);
+            rlimit small = limit;
+            small.rlim_cur = 8192;
+            ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &small), 0);
+            writer.write(data); // the first buffer fits, the tail does not
+            EXPECT_THROW(writer.finish(), std::system_error);
+            ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+        }
+        // Discarded, not left partially written
+        EXPECT_EQ(std::filesystem::file_size(path), 0u);
+    }
+    std::signal(SIGXFSZ, previousHandler);
+}
+#endif
+
+TEST_F(DirectWriter, IoUringMatchesThread) {
+    std::mt19937           rng(2);
+    std::vector<std::byte> data(7 * 8192 + 777);
+    for (std::byte& b : data)
+        b = std::byte(rng());
+    std::vector<std::byte> written[2];
+    for (bool useIoUring : {false, true}) {
+        {
+            direct_writer writer(path, 8192, 4, useIoUring);
+            if (useIoUring && !writer.ioUring())
+                GTEST_SKIP() << "io_uring unavailable";
+            EXPECT_EQ(writer.ioUring(), useIoUring);
+            for (size_t offset = 0; offset < data.size(); offset += 1500) {
+                size_t size = std::min<size_t>(1500, data.size() - offset);
+                writer.write(std::span<const std::byte>(data).subspan(offset, size));
+            }
+            writer.finish();
+        }
+        written[useIoUring] = readFile(path);
+    }
+    EXPECT_EQ(written[0], data);
+    EXPECT_EQ(written[1], data);
+}
+
+TEST_F(DirectWriter, IoUringUnfinished) {
+    std::vector<std::byte> data(5 * 8192 + 1, std::byte(9));
+    {
+        direct_writer writer(path, 8192, 3);
+        if (!writer.ioUring())
+            GTEST_SKIP() << "io_uring unavailable";
+        writer.write(data);
+    }
+    EXPECT_EQ(std::filesystem::file_size(path), 0u);
+}
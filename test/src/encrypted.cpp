@@ -0,0 +1,179 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstring>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/encrypted.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <string_view>
+#include <vector>
+
+using namespace decodeless;
+
+template <size_t N>
+static std::array<uint8_t, N> sequence(uint8_t first) {
+    std::array<uint8_t, N> result;
+    std::iota(result.begin(), result.end(), first);
+    return result;
+}
+
+// RFC 8439 section 2.5.2
+TEST(ChaCha20Poly1305, Poly1305Vector) {
+    const uint8_t key[32] = {0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52,
+                             0xfe, 0x42, 0xd5, 0x06, 0xa8, 0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d,
+                             0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b};
+    std::string_view message = "Cryptographic Forum Research Group";
+    chacha20poly1305::Poly1305 mac{std::span<const uint8_t, 32>(key)};
+    mac.update(std::span(reinterpret_cast<const uint8_t*>(message.data()), 10));
+    mac.update(std::span(reinterpret_cast<const uint8_t*>(message.data()) + 10,
+                         message.size() - 10));
+    chacha20poly1305::Tag expected = {0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+                                      0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9};
+    EXPECT_EQ(mac.finish(), expected);
+}
+
+// RFC 8439 section 2.8.2
+TEST(ChaCha20Poly1305, AeadVector) {
+    std::string_view plaintext =
+        "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the "
+        "future, sunscreen would be it.";
+    std::vector<std::byte> data(plaintext.size());
+    std::memcpy(data.data(), plaintext.data(), data.size());
+    const uint8_t           aad[12] = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1,
+                                       0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7};
+    chacha20poly1305::Key   key = sequence<32>(0x80);
+    chacha20poly1305::Nonce nonce = {0x07, 0x00, 0x00, 0x00, 0x40, 0x41,
+                                     0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+    chacha20poly1305::Tag   tag = chacha20poly1305::encrypt(key, nonce, aad, data);
+    chacha20poly1305::Tag   expectedTag = {0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+                                           0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+    const uint8_t           expectedPrefix[16] = {0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb,
+                                                  0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2};
+    EXPECT_EQ(tag, expectedTag);
+    EXPECT_EQ(std::memcmp(data.data(), expectedPrefix, sizeof(expectedPrefix)), 0);
+
+    EXPECT_TRUE(chacha20poly1305::decrypt(key, nonce, aad, data, tag));
+    EXPECT_EQ(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()),
+              plaintext);
+
+    data[5] ^= std::byte(1);
+    EXPECT_FALSE(chacha20poly1305::decrypt(key, nonce, aad, data, tag));
+}
+
+struct PublicHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"PUBLIC"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    PublicHeader()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+    offset_span<int> data;
+};
+
+struct SecretHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"SECRET"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    SecretHeader()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+    offset_span<int> data;
+};
+
+struct TestRootHeader : RootHeader {
+    TestRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+static void writeEncryptedFile(linear_memory_resource<>& memory, const chacha20poly1305::Key& key,
+                               size_t secretSize) {
+    auto* root = create::object<TestRootHeader>(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 2);
+    auto* encrypted = create::object<EncryptedHeaders>(memory);
+    encrypted->entries = create::array<EncryptedHeaderEntry>(memory, 1);
+
+    auto* publicHeader = create::object<PublicHeader>(memory);
+    publicHeader->data = create::array<int>(memory, 10);
+    std::ranges::fill(publicHeader->data, 1);
+
+    // The encrypted region spans the header and its payload
+    auto* secretHeader = create::object<SecretHeader>(memory);
+    secretHeader->data = create::array<int>(memory, secretSize);
+    std::iota(secretHeader->data.begin(), secretHeader->data.end(), 0);
+    auto* regionBegin = reinterpret_cast<std::byte*>(secretHeader);
+    auto* regionEnd = memory.data() + memory.size();
+    encryptHeader(encrypted->entries[0], std::span(regionBegin, regionEnd), key,
+                  chacha20poly1305::Nonce{1});
+
+    root->headers[0] = encrypted;
+    root->headers[1] = publicHeader;
+    std::ranges::sort(root->headers, RootHeader::HeaderPtrComp());
+}
+
+TEST(Encrypted, FindDecrypts) {
+    chacha20poly1305::Key    key = sequence<32>(0);
+    linear_memory_resource<> memory(4096);
+    writeEncryptedFile(memory, key, 100);
+    auto* root = reinterpret_cast<RootHeader*>(memory.data());
+
+    // The ciphertext is not reachable through the root header
+    EXPECT_EQ(root->find<SecretHeader>(), nullptr);
+
+    decrypted_headers headers(*root, key);
+    EXPECT_EQ(headers.find<PublicHeader>(), root->find<PublicHeader>());
+    SecretHeader* secret = headers.findSupported<SecretHeader>();
+    ASSERT_NE(secret, nullptr);
+    EXPECT_EQ(secret->identifier, SecretHeader::HeaderIdentifier);
+    ASSERT_EQ(secret->data.size(), 100);
+    EXPECT_EQ(secret->data[0], 0);
+    EXPECT_EQ(secret->data[99], 99);
+
+    // Decrypted once and cached
+    EXPECT_EQ(headers.find<SecretHeader>(), secret);
+}
+
+TEST(Encrypted, WrongKey) {
+    chacha20poly1305::Key    key = sequence<32>(0);
+    linear_memory_resource<> memory(4096);
+    writeEncryptedFile(memory, key, 100);
+    auto* root = reinterpret_cast<RootHeader*>(memory.data());
+
+    chacha20poly1305::Key wrongKey = sequence<32>(1);
+    decrypted_headers     headers(*root, wrongKey);
+    EXPECT_NE(headers.find<PublicHeader>(), nullptr);
+    EXPECT_THROW(headers.find<SecretHeader>(), decryption_error);
+}
+
+TEST(Encrypted, KeyWiped) {
+    chacha20poly1305::Key    key = sequence<32>(3);
+    linear_memory_resource<> memory(4096);
+    writeEncryptedFile(memory, key, 100);
+    auto* root = reinterpret_cast<RootHeader*>(memory.data());
+
+    // Inspect the storage after the destructor to check the key copy is gone
+    alignas(decrypted_headers) std::byte storage[sizeof(decrypted_headers)];
+    auto* headers = new (storage) decrypted_headers(*root, key);
+    ASSERT_NE(headers->find<SecretHeader>(), nullptr);
+    auto containsKey = [&] {
+        auto* keyBytes = reinterpret_cast<const std::byte*>(key.data());
+        return !std::ranges::search(storage, std::span(keyBytes, key.size())).empty();
+    };
+    EXPECT_TRUE(containsKey());
+    headers->~decrypted_headers();
+    EXPECT_FALSE(containsKey());
+}
+
+TEST(Encrypted, ParallelDecrypt) {
+    chacha20poly1305::Key    key = sequence<32>(7);
+    size_t                   count = 4 * decrypted_headers::ParallelThreshold / sizeof(int) + 13;
+    linear_memory_resource<> memory(count * sizeof(int) + 4096);
+    writeEncryptedFile(memory, key, count);
+    auto* root = reinterpret_cast<RootHeader*>(memory.data());
+
+    decrypted_headers headers(*root, key);
+    SecretHeader*     secret = headers.find<SecretHeader>();
+    ASSERT_NE(secret, nullptr);
+    ASSERT_EQ(secret->data.size(), count);
+    for (size_t i = 0; i < count; ++i) {
+        if (secret->data[i] != int(i)) {
+            FAIL() << "Mismatch at " << i;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include "test_headers.hpp"
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/fingerprint.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <string>
+
+using namespace decodeless;
+
+struct BakeRootHeader : RootHeader {
+    BakeRootHeader()
+        : RootHeader("DECODELESS-BAKE") {}
+};
+
+static Fingerprint fingerprintOf(std::string_view input) {
+    return fingerprint_hasher().update(input).finish();
+}
+
+TEST(Fingerprint, Hasher) {
+    EXPECT_EQ(fingerprint_hasher().finish(), Fingerprint{});
+
+    // Reference MurmurHash3_x64_128("hello", seed 0)
+    Fingerprint hello = fingerprintOf("hello");
+    uint64_t    h1 = 0, h2 = 0;
+    for (size_t i = 8; i-- > 0;) {
+        h1 = (h1 << 8) | hello[i];
+        h2 = (h2 << 8) | hello[i + 8];
+    }
+    EXPECT_EQ(h1, 0xcbd8a7b341bd9b02ull);
+    EXPECT_EQ(h2, 0x5b1e906a48ae1d19ull);
+
+    // Incremental updates match one shot
+    std::string text(100, 'x');
+    std::iota(text.begin(), text.end(), 'A');
+    fingerprint_hasher pieces;
+    pieces.update(std::string_view(text).substr(0, 3));
+    pieces.update(std::string_view(text).substr(3, 40));
+    pieces.update(std::string_view(text).substr(43));
+    EXPECT_EQ(pieces.finish(), fingerprintOf(text));
+    EXPECT_NE(fingerprintOf(text), fingerprintOf(text.substr(1)));
+}
+
+using Builder = incremental_builder<BakeRootHeader, linear_memory_resource<>>;
+
+static void bake(Builder& builder, std::string_view inputA, std::string_view inputB,
+                 int& generatedCalls) {
+    builder.build<DataHeader<"asseta">>(fingerprintOf(inputA), [&](auto& header, auto& memory) {
+        ++generatedCalls;
+        auto data = create::array<int>(memory, 1000);
+        std::ranges::fill(data, int(inputA.size()));
+        header.data = data;
+        (void)memory.allocate(100, 256); // over-aligned scratch inside the extent
+    });
+    builder.build<DataHeader<"assetb">>(fingerprintOf(inputB), [&](auto& header, auto& memory) {
+        ++generatedCalls;
+        auto data = create::array<int>(memory, 10);
+        std::ranges::fill(data, int(inputB.size()));
+        header.data = data;
+    });
+    builder.finish();
+}
+
+TEST(Fingerprint, IncrementalRebuild) {
+    linear_memory_resource<> first(1 << 16);
+    int                      generated = 0;
+    {
+        Builder builder(first, 2, {});
+        bake(builder, "aaaa", "bb", generated);
+        EXPECT_EQ(builder.generatedCount(), 2u);
+        EXPECT_EQ(builder.clonedCount(), 0u);
+    }
+    EXPECT_EQ(generated, 2);
+    auto* firstRoot = reinterpret_cast<const RootHeader*>(first.data());
+    ASSERT_NE(firstRoot->find<Fingerprints>(), nullptr);
+    EXPECT_EQ(firstRoot->find<Fingerprints>()->entries.size(), 2u);
+
+    // Change only the input of b
+    linear_memory_resource<> second(1 << 16);
+    generated = 0;
+    {
+        Builder builder(second, 2, std::span<const std::byte>(first.data(), first.size()));
+        (void)second.allocate(8, 8); // shift the new file's layout
+        bake(builder, "aaaa", "bbbbbb", generated);
+        EXPECT_EQ(builder.generatedCount(), 1u);
+        EXPECT_EQ(builder.clonedCount(), 1u);
+    }
+    EXPECT_EQ(generated, 1);
+
+    auto* root = reinterpret_cast<const RootHeader*>(second.data());
+    auto* a = root->find<DataHeader<"asseta">>();
+    auto* b = root->find<DataHeader<"assetb">>();
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_NE(static_cast<const void*>(a->data.data()),
+              static_cast<const void*>(firstRoot->find<DataHeader<"asseta">>()->data.data()));
+    EXPECT_EQ(a->data.size(), 1000u);
+    EXPECT_EQ(a->data[999], 4);
+    EXPECT_EQ(b->data[9], 6);
+
+    constexpr Magic         identifier = DataHeader<"asseta">::HeaderIdentifier;
+    const FingerprintEntry* entry = root->find<Fingerprints>()->find(identifier);
+    const FingerprintEntry* firstEntry = firstRoot->find<Fingerprints>()->find(identifier);
+    ASSERT_NE(entry, nullptr);
+    ASSERT_NE(firstEntry, nullptr);
+    EXPECT_EQ(entry->extentAlignment, 256u);
+    EXPECT_EQ(entry->extentOffset % 256, firstEntry->extentOffset % 256);
+}
+
+TEST(Fingerprint, CorruptEntry) {
+    linear_memory_resource<> first(1 << 16);
+    int                      generated = 0;
+    {
+        Builder builder(first, 2, {});
+        bake(builder, "aaaa", "bb", generated);
+    }
+    auto* firstRoot = reinterpret_cast<const RootHeader*>(first.data());
+    auto* entry = const_cast<FingerprintEntry*>(
+        firstRoot->find<Fingerprints>()->find(DataHeader<"asseta">::HeaderIdentifier));
+    ASSERT_NE(entry, nullptr);
+    entry->headerOffset = ~uint64_t(0) - 8; // wraps if added to sizeof(Header)
+
+    linear_memory_resource<> second(1 << 16);
+    Builder builder(second, 2, std::span<const std::byte>(first.data(), first.size()));
+    EXPECT_THROW(bake(builder, "aaaa", "bb", generated), std::runtime_error);
+}
+
+TEST(Fingerprint, TruncatedPrevious) {
+    linear_memory_resource<> first(1 << 16);
+    int                      generated = 0;
+    {
+        Builder builder(first, 2, {});
+        bake(builder, "aaaa", "bb", generated);
+    }
+
+    // The fingerprints are written last, so they are cut off
+    linear_memory_resource<>   second(1 << 16);
+    std::span<const std::byte> truncated(first.data(), first.size() / 2);
+    EXPECT_THROW(Builder(second, 2, truncated), std::runtime_error);
+}
@@ -0,0 +1,250 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <cstring>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/fragment_ipc.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace decodeless;
+
+struct IpcRootHeader : RootHeader {
+    IpcRootHeader()
+        : RootHeader("DECODELESS-PART") {}
+};
+
+struct IpcMeshHeader : Header {
+    static constexpr Magic HeaderIdentifier{"MESH"};
+    IpcMeshHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    offset_span<int> vertices;
+};
+
+struct IpcSceneHeader : Header {
+    static constexpr Magic HeaderIdentifier{"SCENE"};
+    IpcSceneHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    offset_ptr<IpcMeshHeader> mesh; // built by another process
+    offset_span<int>          instances;
+};
+
+static void buildMesh(linear_memory_resource<>& memory) {
+    auto* root = create::object<IpcRootHeader>(memory);
+    auto* mesh = create::object<IpcMeshHeader>(memory);
+    mesh->vertices = create::array<int>(memory, 5000);
+    std::iota(mesh->vertices.begin(), mesh->vertices.end(), 0);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = mesh;
+}
+
+static void buildScene(linear_memory_resource<>& memory) {
+    auto*              root = create::object<IpcRootHeader>(memory);
+    link_table_builder links(root);
+    auto*              scene = create::object<IpcSceneHeader>(memory);
+    scene->instances = create::array<int>(memory, 3);
+    std::ranges::fill(scene->instances, 5);
+    links.reference(scene->mesh, IpcMeshHeader::HeaderIdentifier);
+    LinkTable* table = links.create(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 2);
+    root->headers[0] = table;
+    root->headers[1] = scene;
+    std::ranges::sort(root->headers, RootHeader::HeaderPtrComp());
+}
+
+// Builds a fragment in a child process and sends it back over the socket
+template <class Build>
+static pid_t spawnBuilder(int socket, Build build) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        int status = 0;
+        try {
+            linear_memory_resource<> memory(1 << 16);
+            build(memory);
+            shared_fragment fragment = shared_fragment::create();
+            fragment.assign({memory.data(), memory.size()});
+            sendFragment(socket, fragment);
+        } catch (...) {
+            status = 1;
+        }
+        ::_exit(status);
+    }
+    return pid;
+}
+
+TEST(FragmentIpc, ChildProcesses) {
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    pid_t scene = spawnBuilder(sockets[1], buildScene);
+    ASSERT_GT(scene, 0);
+    pid_t mesh = spawnBuilder(sockets[1], buildMesh);
+    ASSERT_GT(mesh, 0);
+    ::close(sockets[1]);
+
+    // Fragments arrive in completion order, which link() does not depend on
+    std::vector<shared_fragment> fragments;
+    while (shared_fragment fragment = receiveFragment(sockets[0]))
+        fragments.push_back(std::move(fragment));
+    ::close(sockets[0]);
+    for (pid_t pid : {scene, mesh}) {
+        int status = -1;
+        ::waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    ASSERT_EQ(fragments.size(), 2u);
+
+    shared_fragment output = shared_fragment::create("decodeless-linked");
+    link(fragments, "DECODELESS-LINK", output.fd());
+    std::span<const std::byte> file = output.map();
+    auto*                      root = reinterpret_cast<const RootHeader*>(file.data());
+    ASSERT_TRUE(root->magicValid());
+    EXPECT_EQ(root->headers.size(), 2u);
+    const IpcSceneHeader* sceneHeader = root->find<IpcSceneHeader>();
+    const IpcMeshHeader*  meshHeader = root->find<IpcMeshHeader>();
+    ASSERT_NE(sceneHeader, nullptr);
+    ASSERT_NE(meshHeader, nullptr);
+    EXPECT_EQ(sceneHeader->mesh.get(), meshHeader);
+    EXPECT_EQ(sceneHeader->mesh->vertices[4999], 4999);
+    EXPECT_EQ(sceneHeader->instances[2], 5);
+}
+
+TEST(FragmentIpc, MatchesStreamLink) {
+    linear_memory_resource<> scenePart(1 << 16), meshPart(1 << 16);
+    buildScene(scenePart);
+    buildMesh(meshPart);
+    std::vector<shared_fragment> fragments(2);
+    fragments[0] = shared_fragment::create();
+    fragments[0].assign({scenePart.data(), scenePart.size()});
+    fragments[1] = shared_fragment::create();
+    fragments[1].assign({meshPart.data(), meshPart.size()});
+
+    shared_fragment output = shared_fragment::create();
+    link(fragments, "DECODELESS-LINK", output.fd());
+
+    std::vector<std::span<const std::byte>> images{{scenePart.data(), scenePart.size()},
+                                                   {meshPart.data(), meshPart.size()}};
+    std::ostringstream                      expected;
+    link(images, "DECODELESS-LINK", expected);
+    std::span<const std::byte> file = output.map();
+    ASSERT_EQ(file.size(), expected.str().size());
+    EXPECT_EQ(std::memcmp(file.data(), expected.str().data(), file.size()), 0);
+}
+
+TEST(FragmentIpc, Sealed) {
+    linear_memory_resource<> memory(1 << 16);
+    buildMesh(memory);
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    shared_fragment fragment = shared_fragment::create();
+    fragment.assign({memory.data(), memory.size()});
+    sendFragment(sockets[1], fragment);
+    shared_fragment received = receiveFragment(sockets[0]);
+    ASSERT_TRUE(received);
+    EXPECT_TRUE(received.sealed());
+#if defined(__linux__)
+    // The sender can no longer change what the receiver validated
+    EXPECT_THROW(fragment.assign({memory.data(), memory.size()}), std::system_error);
+
+    // A descriptor sent without sendFragment() is rejected
+    shared_fragment unsealed = shared_fragment::create();
+    unsealed.assign({memory.data(), memory.size()});
+    char tag = 'F';
+    detail::sendMessage(sockets[1], std::as_bytes(std::span(&tag, 1)), unsealed.fd());
+    EXPECT_THROW(receiveFragment(sockets[0]), link_error);
+#endif
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
+
+TEST(FragmentIpc, PeerClosed) {
+    int sockets[2];
+    ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+    ::close(sockets[1]);
+    EXPECT_FALSE(receiveFragment(sockets[0]));
+    ::close(sockets[0]);
+}
+
+// Sends one byte with all of fds attached in a single SCM_RIGHTS message
+static void sendDescriptors(int socket, std::span<const int> fds) {
+    std::vector<char> control(CMSG_SPACE(fds.size_bytes()));
+    char              tag = 'F';
+    iovec             vector{.iov_base = &tag, .iov_len = 1};
+    msghdr            message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(fds.size_bytes());
+    std::memcpy(CMSG_DATA(header), fds.data(), fds.size_bytes());
+    ASSERT_EQ(::sendmsg(socket, &message, 0), 1);
+}
+
+// Received descriptors are write ends of a pipe. Once every copy is closed the
+// read end reports end of file, so any leaked copy is detected.
+struct FragmentDescriptors : testing::Test {
+    int sockets[2] = {-1, -1};
+    int pipe[2] = {-1, -1};
+
+    void SetUp() override {
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+        ASSERT_EQ(::pipe(pipe), 0);
+    }
+    void TearDown() override {
+        for (int fd : {sockets[0], sockets[1], pipe[0], pipe[1]})
+            if (fd != -1)
+                ::close(fd);
+    }
+
+    void expectAllClosed() {
+        ::close(std::exchange(pipe[1], -1));
+        pollfd readEnd{.fd = pipe[0], .events = POLLIN, .revents = 0};
+        ASSERT_EQ(::poll(&readEnd, 1, 1000), 1);
+        char byte;
+        EXPECT_EQ(::read(pipe[0], &byte, 1), 0);
+    }
+};
+
+TEST_F(FragmentDescriptors, SeveralInOneMessage) {
+    int fds[] = {pipe[1], pipe[1]};
+    sendDescriptors(sockets[1], fds);
+    char tag = 0;
+    int  fd = -1;
+    ASSERT_TRUE(detail::receiveMessage(sockets[0], std::as_writable_bytes(std::span(&tag, 1)), fd));
+    EXPECT_NE(fd, -1);
+    ::close(fd);
+    expectAllClosed();
+}
+
+TEST_F(FragmentDescriptors, OnePerReceive) {
+    char tag = 'F';
+    detail::sendMessage(sockets[1], std::as_bytes(std::span(&tag, 1)), pipe[1]);
+    detail::sendMessage(sockets[1], std::as_bytes(std::span(&tag, 1)), pipe[1]);
+    char tags[2] = {};
+    int  fd = -1;
+    ASSERT_TRUE(detail::receiveMessage(sockets[0], std::as_writable_bytes(std::span(tags)), fd));
+    EXPECT_NE(fd, -1);
+    ::close(fd);
+    expectAllClosed();
+}
+
+TEST_F(FragmentDescriptors, Truncated) {
+    int fds[] = {pipe[1], pipe[1], pipe[1], pipe[1]};
+    sendDescriptors(sockets[1], fds);
+    char tag = 0;
+    int  fd = -1;
+    EXPECT_THROW(
+        detail::receiveMessage(sockets[0], std::as_writable_bytes(std::span(&tag, 1)), fd),
+        std::system_error);
+    EXPECT_EQ(fd, -1);
+    expectAllClosed();
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/front_coded.hpp>
+#include <decodeless/header.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace decodeless;
+
+struct DictionaryHeader : Header {
+    static constexpr Magic HeaderIdentifier{"DICT"};
+    FrontCodedDictionary   dictionary;
+};
+
+static std::vector<std::string> randomKeys(size_t count, uint32_t seed) {
+    std::mt19937          rng(seed);
+    std::set<std::string> keys;
+    while (keys.size() < count) {
+        std::string key = "key/";
+        for (size_t i = 0, length = rng() % 12; i < length; ++i)
+            key.push_back(char('a' + rng() % 4));
+        keys.insert(key);
+    }
+    return {keys.begin(), keys.end()};
+}
+
+TEST(FrontCodedDictionary, Empty) {
+    linear_memory_resource<> memory(4096);
+    FrontCodedDictionary     dictionary;
+    buildFrontCodedDictionary(dictionary, memory, std::vector<std::string>{});
+    EXPECT_EQ(dictionary.size, 0u);
+    EXPECT_EQ(dictionary.lower_bound("a"), 0u);
+    EXPECT_FALSE(dictionary.contains(""));
+}
+
+TEST(FrontCodedDictionary, LookupAndOrdinals) {
+    std::vector<std::string> keys = randomKeys(3000, 1);
+    linear_memory_resource<> memory(1 << 20);
+    auto*                    header = create::object<DictionaryHeader>(memory);
+    buildFrontCodedDictionary(header->dictionary, memory, keys);
+    const FrontCodedDictionary& dictionary = header->dictionary;
+    ASSERT_EQ(dictionary.size, keys.size());
+
+    size_t rawBytes = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        rawBytes += keys[i].size() + sizeof(uint64_t);
+        ASSERT_EQ(dictionary.key(i), keys[i]);
+        ASSERT_EQ(dictionary.find(keys[i]), i);
+    }
+    EXPECT_LT(dictionary.data.size() + dictionary.blockOffsets.size() * 16, rawBytes / 2);
+
+    for (const std::string& probe : randomKeys(3000, 2)) {
+        size_t expected = std::ranges::lower_bound(keys, probe) - keys.begin();
+        ASSERT_EQ(dictionary.lower_bound(probe), expected) << probe;
+        ASSERT_EQ(dictionary.contains(probe), std::ranges::binary_search(keys, probe)) << probe;
+    }
+    EXPECT_EQ(dictionary.lower_bound(""), 0u);
+    EXPECT_EQ(dictionary.lower_bound("\xff"), keys.size());
+
+    // Sequential decoding from an arbitrary ordinal
+    size_t i = 37;
+    for (FrontCodedDictionary::cursor c(dictionary, i); c.valid(); c.next(), ++i)
+        ASSERT_EQ(c.key(), keys[i]);
+    EXPECT_EQ(i, keys.size());
+}
+
+TEST(FrontCodedDictionary, Prefix) {
+    std::vector<std::string> keys = randomKeys(2000, 3);
+    linear_memory_resource<> memory(1 << 20);
+    FrontCodedDictionary     dictionary;
+    buildFrontCodedDictionary(dictionary, memory, keys);
+    for (std::string prefix : {"key/", "key/ab", "key/dddd", "key/e", "x"}) {
+        std::vector<std::string> expected, actual;
+        for (size_t i = 0; i < keys.size(); ++i)
+            if (keys[i].starts_with(prefix))
+                expected.push_back(keys[i]);
+        dictionary.forEachPrefix(prefix, [&](uint64_t ordinal, std::string_view key) {
+            EXPECT_EQ(keys[ordinal], key);
+            actual.emplace_back(key);
+        });
+        EXPECT_EQ(actual, expected) << prefix;
+    }
+}
+
+TEST(FrontCodedDictionary, Unsorted) {
+    linear_memory_resource<> memory(4096);
+    FrontCodedDictionary     dictionary;
+    EXPECT_THROW(
+        buildFrontCodedDictionary(dictionary, memory, std::vector<std::string>{"b", "a"}),
+        std::invalid_argument);
+    EXPECT_THROW(
+        buildFrontCodedDictionary(dictionary, memory, std::vector<std::string>{"a", "a"}),
+        std::invalid_argument);
+}
@@ -10,6 +10,9 @@
 #include <decodeless/offset_ptr.hpp>
 #include <gtest/gtest.h>
 #include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
 
 using namespace decodeless;
@@ -203,6 +206,13 @@ TEST(Header, Magic) {
     EXPECT_FALSE(rootHeader.magicValid());
 }
 
+TEST(Header, RuntimeMagic) {
+    EXPECT_EQ(Magic(std::string("test")), Magic("test"));
+    EXPECT_EQ(Magic(std::string_view("DECODELESS->FILE")), RootHeader::DecodelessMagic);
+    EXPECT_EQ(Magic(std::string_view()), Magic());
+    EXPECT_THROW(Magic(std::string_view("DECODELESS->FILE!")), std::length_error);
+}
+
 struct Ext1 : Header {
     static constexpr Magic HeaderIdentifier{"    a"};
     int                    data[10];
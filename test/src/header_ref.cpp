@@ -0,0 +1,89 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header_ref.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace decodeless;
+
+struct Material {
+    float roughness = 0.0f;
+};
+
+struct MaterialsHeader : Header {
+    static constexpr Magic HeaderIdentifier{"MATERIALS"};
+    MaterialsHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    Material              defaultMaterial;
+    offset_span<Material> materials;
+};
+
+struct ObjectsHeader : Header {
+    static constexpr Magic HeaderIdentifier{"OBJECTS"};
+    ObjectsHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    header_ref<MaterialsHeader> materials;
+    header_ref<Material>        fallback;
+    header_ref<Material>        missing;
+};
+
+TEST(HeaderRef, ResolvesAcrossRewrites) {
+    linear_memory_resource<> memory(8192);
+    auto*                    root = create::object<RootHeader>(memory, "DECODELESS-TEST");
+    auto*                    materials = create::object<MaterialsHeader>(memory);
+    materials->defaultMaterial.roughness = 0.5f;
+    auto* objects = create::object<ObjectsHeader>(memory);
+    objects->materials = *materials;
+    objects->fallback = header_ref<Material>(*materials, &materials->defaultMaterial);
+    root->headers = create::array<offset_ptr<Header>>(memory, 2);
+    root->headers[0] = materials;
+    root->headers[1] = objects;
+
+    EXPECT_EQ(objects->materials.resolve(*root), materials);
+    EXPECT_EQ(objects->fallback.resolve(*root)->roughness, 0.5f);
+    EXPECT_FALSE(objects->missing);
+    EXPECT_EQ(objects->missing.resolve(*root), nullptr);
+
+    // Replace the materials sub-header as an append update would. The
+    // reference follows the header list.
+    auto* rewritten = create::object<MaterialsHeader>(memory);
+    rewritten->defaultMaterial.roughness = 0.25f;
+    root->headers[0] = rewritten;
+    EXPECT_EQ(objects->materials.resolve(*root), rewritten);
+    EXPECT_EQ(objects->fallback.resolve(*root)->roughness, 0.25f);
+
+    header_ref<Material> dangling;
+    dangling.target = Magic("GONE");
+    EXPECT_EQ(dangling.resolve(*root), nullptr);
+}
+
+TEST(HeaderRef, Cache) {
+    linear_memory_resource<> memory(8192);
+    auto*                    root = create::object<RootHeader>(memory, "DECODELESS-TEST");
+    auto*                    materials = create::object<MaterialsHeader>(memory);
+    auto*                    objects = create::object<ObjectsHeader>(memory);
+    objects->materials = *materials;
+    root->headers = create::array<offset_ptr<Header>>(memory, 2);
+    root->headers[0] = materials;
+    root->headers[1] = objects;
+
+    header_cache cache(*root);
+    EXPECT_EQ(cache.find<ObjectsHeader>(), objects);
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < 1000; ++j) {
+                EXPECT_EQ(objects->materials.resolve(cache), materials);
+                EXPECT_EQ(cache.find("NOPE"), nullptr);
+            }
+        });
+    }
+    threads.clear();
+
+    // Cached per mapping: later header list changes are not observed
+    root->headers[0] = objects;
+    EXPECT_EQ(objects->materials.resolve(cache), materials);
+}
@@ -0,0 +1,212 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header_server.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace decodeless;
+
+struct ServedRootHeader : RootHeader {
+    ServedRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+struct ServedHeader : Header {
+    static constexpr Magic   HeaderIdentifier{"SERVED"};
+    static constexpr Version VersionSupported{1, 0, 0};
+    ServedHeader()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+    offset_span<int> data;
+};
+
+struct OtherHeader : Header {
+    static constexpr Magic HeaderIdentifier{"OTHER"};
+    OtherHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+};
+
+struct HeaderServer : testing::Test {
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() /
+        (std::string("decodeless_") +
+         testing::UnitTest::GetInstance()->current_test_info()->name());
+    std::filesystem::path socket = directory / "server.sock";
+
+    void SetUp() override { std::filesystem::create_directories(directory); }
+    void TearDown() override { std::filesystem::remove_all(directory); }
+
+    // padding moves the sub-header to a different offset
+    std::filesystem::path writeFile(const std::string& name, int first, size_t padding = 0) const {
+        linear_memory_resource<> memory(1 << 16);
+        auto*                    root = create::object<ServedRootHeader>(memory);
+        create::array<std::byte>(memory, padding);
+        auto* header = create::object<ServedHeader>(memory);
+        header->data = create::array<int>(memory, 1000);
+        std::iota(header->data.begin(), header->data.end(), first);
+        root->headers = create::array<offset_ptr<Header>>(memory, 1);
+        root->headers[0] = header;
+        std::filesystem::path path = directory / name;
+        std::ofstream(path, std::ios::binary)
+            .write(reinterpret_cast<const char*>(memory.data()), std::streamsize(memory.size()));
+        return path;
+    }
+};
+
+TEST_F(HeaderServer, Find) {
+    header_server server(socket);
+    server.add("a", writeFile("a.bin", 0));
+    server.add("b", writeFile("b.bin", 100));
+
+    header_client client(socket);
+    const ServedHeader* a = client.findSupported<ServedHeader>("a");
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(a->data[999], 999);
+    const ServedHeader* b = client.find<ServedHeader>("b");
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(b->data[0], 100);
+
+    // Repeated requests reuse the client's mapping
+    EXPECT_EQ(client.find<ServedHeader>("a"), a);
+    EXPECT_EQ(client.find<OtherHeader>("a"), nullptr);
+    EXPECT_THROW(client.find<ServedHeader>("missing"), header_server_error);
+}
+
+TEST_F(HeaderServer, ManyClients) {
+    header_server server(socket);
+    server.add("a", writeFile("a.bin", 7));
+    std::vector<std::jthread> threads;
+    std::atomic<int>          found = 0;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&] {
+            header_client client(socket);
+            for (int j = 0; j < 10; ++j) {
+                const ServedHeader* header = client.find<ServedHeader>("a");
+                if (header && header->data[10] == 17)
+                    ++found;
+            }
+        });
+    }
+    threads.clear();
+    EXPECT_EQ(found, 80);
+}
+
+TEST_F(HeaderServer, Replace) {
+    header_server server(socket);
+    server.add("a", writeFile("a.bin", 0));
+    header_client       client(socket);
+    const ServedHeader* before = client.find<ServedHeader>("a");
+    ASSERT_NE(before, nullptr);
+
+    // Re-adding the name with a different layout remaps on the next request
+    server.add("a", writeFile("a2.bin", 500, 4096));
+    const ServedHeader* after = client.find<ServedHeader>("a");
+    ASSERT_NE(after, nullptr);
+    EXPECT_NE(after, before);
+    EXPECT_EQ(after->data[0], 500);
+    EXPECT_EQ(after->data[999], 1499);
+    EXPECT_EQ(before->data[999], 999); // still mapped
+    EXPECT_EQ(client.find<ServedHeader>("a"), after);
+}
+
+TEST_F(HeaderServer, StalledClient) {
+    std::optional<header_server> server(std::in_place, socket);
+    server->add("a", writeFile("a.bin", 3));
+
+    auto connect = [&] {
+        auto client = std::make_unique<detail::socket_handle>(::socket(AF_UNIX, SOCK_STREAM, 0));
+        sockaddr_un address = detail::socketAddress(socket);
+        EXPECT_EQ(::connect(client->fd, reinterpret_cast<const sockaddr*>(&address),
+                            sizeof(address)),
+                  0);
+        return client;
+    };
+
+    // Connects and sends half a request, never completed
+    auto stall = [&] {
+        auto stalled = connect();
+        char partial[16] = {'a'};
+        EXPECT_EQ(::send(stalled->fd, partial, sizeof(partial), 0), ssize_t(sizeof(partial)));
+        return stalled;
+    };
+
+    // Other clients are served without waiting for it to time out
+    auto                first = stall();
+    header_client       client(socket);
+    auto                start = std::chrono::steady_clock::now();
+    const ServedHeader* header = client.find<ServedHeader>("a");
+    EXPECT_LT(std::chrono::steady_clock::now() - start, header_server::ClientTimeout);
+    ASSERT_NE(header, nullptr);
+    EXPECT_EQ(header->data[0], 3);
+
+    // Shutdown does not hang on a client stalled mid-request
+    auto second = stall();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    start = std::chrono::steady_clock::now();
+    server.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(HeaderServer, TricklingClient) {
+    std::optional<header_server> server(std::in_place, socket);
+    server->add("a", writeFile("a.bin", 3));
+
+    // Sends a request one byte at a time, each well within ClientTimeout of
+    // the last, until the server disconnects it
+    std::atomic<bool> disconnected = false;
+    std::jthread      trickle([&](std::stop_token stop) {
+        detail::socket_handle trickler(::socket(AF_UNIX, SOCK_STREAM, 0));
+        sockaddr_un           address = detail::socketAddress(socket);
+        if (::connect(trickler.fd, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)) == -1)
+            return;
+        char byte = 'a';
+        for (size_t i = 0; i < sizeof(detail::HeaderRequest) && !stop.stop_requested(); ++i) {
+            if (::send(trickler.fd, &byte, 1, MSG_NOSIGNAL) != 1)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            char reply;
+            if (::recv(trickler.fd, &reply, 1, MSG_DONTWAIT) == 0)
+                break;
+        }
+        disconnected = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Other clients are served while it trickles
+    header_client client(socket);
+    for (int i = 0; i < 3; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_NE(client.find<ServedHeader>("a"), nullptr);
+        EXPECT_LT(std::chrono::steady_clock::now() - start, header_server::ClientTimeout);
+    }
+
+    // It is disconnected shortly after ClientTimeout, long before it would
+    // have sent the whole request
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!disconnected && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(disconnected);
+
+    // Shutdown does not wait for it either
+    auto start = std::chrono::steady_clock::now();
+    server.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+
+TEST_F(HeaderServer, Invalid) {
+    header_server         server(socket);
+    std::filesystem::path path = directory / "text.bin";
+    std::ofstream(path) << "not a decodeless file, just some text in a file";
+    EXPECT_THROW(server.add("text", path), header_server_error);
+    EXPECT_THROW(server.add("missing", directory / "missing.bin"), std::system_error);
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/linker.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <sstream>
+#include <vector>
+
+using namespace decodeless;
+
+struct PartRootHeader : RootHeader {
+    PartRootHeader()
+        : RootHeader("DECODELESS-PART") {}
+};
+
+struct MeshHeader : Header {
+    static constexpr Magic HeaderIdentifier{"MESH"};
+    MeshHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    offset_span<int> vertices;
+};
+
+struct SceneHeader : Header {
+    static constexpr Magic HeaderIdentifier{"SCENE"};
+    SceneHeader()
+        : Header{.identifier = HeaderIdentifier, .version = {1, 0, 0}, .gitHash = ""} {}
+    offset_ptr<MeshHeader> mesh; // defined in another fragment
+    offset_span<int>       instances;
+};
+
+static std::span<const std::byte> bytes(const linear_memory_resource<>& memory) {
+    return {memory.data(), memory.size()};
+}
+
+static void writeMeshFragment(linear_memory_resource<>& memory) {
+    auto* root = create::object<PartRootHeader>(memory);
+    auto* mesh = create::object<MeshHeader>(memory);
+    mesh->vertices = create::array<int>(memory, 100);
+    std::iota(mesh->vertices.begin(), mesh->vertices.end(), 0);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = mesh;
+}
+
+static void writeSceneFragment(linear_memory_resource<>& memory, Magic target,
+                               uint64_t addend = 0) {
+    auto*              root = create::object<PartRootHeader>(memory);
+    link_table_builder links(root);
+    auto*              scene = create::object<SceneHeader>(memory);
+    scene->instances = create::array<int>(memory, 3);
+    std::ranges::fill(scene->instances, 5);
+    links.reference(scene->mesh, target, addend);
+    LinkTable* table = links.create(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 2);
+    root->headers[0] = table;
+    root->headers[1] = scene;
+    std::ranges::sort(root->headers, RootHeader::HeaderPtrComp());
+}
+
+TEST(Linker, CrossReference) {
+    linear_memory_resource<> scenePart(8192), meshPart(8192);
+    writeSceneFragment(scenePart, MeshHeader::HeaderIdentifier);
+    writeMeshFragment(meshPart);
+
+    std::vector<std::span<const std::byte>> fragments{bytes(scenePart), bytes(meshPart)};
+    LinkPlan plan = planLink(fragments);
+    EXPECT_EQ(plan.symbols.size(), 2u);
+    EXPECT_EQ(plan.fragments[1].offset % LinkPlan::Alignment, 0u);
+
+    std::ostringstream out;
+    writeLinked(plan, fragments, "DECODELESS-LINK", out);
+    std::string file = out.str();
+    ASSERT_EQ(file.size(), plan.size);
+
+    // Load at an aligned address
+    linear_memory_resource<> loaded(file.size());
+    std::byte*               data = create::array<std::byte>(loaded, file.size()).data();
+    std::memcpy(data, file.data(), file.size());
+    auto* root = reinterpret_cast<const RootHeader*>(data);
+    ASSERT_TRUE(root->magicValid());
+    EXPECT_EQ(root->identifier, Magic("DECODELESS-LINK"));
+    EXPECT_EQ(root->headers.size(), 2u);
+    EXPECT_EQ(root->find<LinkTable>(), nullptr);
+
+    const SceneHeader* scene = root->find<SceneHeader>();
+    const MeshHeader*  mesh = root->find<MeshHeader>();
+    ASSERT_NE(scene, nullptr);
+    ASSERT_NE(mesh, nullptr);
+    EXPECT_EQ(scene->mesh.get(), mesh);
+    EXPECT_EQ(scene->mesh->vertices[99], 99);
+    EXPECT_EQ(scene->instances[2], 5);
+}
+
+TEST(Linker, Errors) {
+    linear_memory_resource<> scenePart(8192), meshPart(8192), otherMeshPart(8192);
+    writeSceneFragment(scenePart, "MISSING");
+    writeMeshFragment(meshPart);
+    writeMeshFragment(otherMeshPart);
+
+    std::vector<std::span<const std::byte>> undefined{bytes(scenePart), bytes(meshPart)};
+    EXPECT_THROW(planLink(undefined), link_error);
+    std::vector<std::span<const std::byte>> duplicate{bytes(meshPart), bytes(otherMeshPart)};
+    EXPECT_THROW(planLink(duplicate), link_error);
+    std::vector<std::byte>                  garbage(sizeof(RootHeader));
+    std::vector<std::span<const std::byte>> invalid{garbage};
+    EXPECT_THROW(planLink(invalid), link_error);
+
+    // Sub-header pointer outside the fragment, rejected before it is read
+    linear_memory_resource<> corruptPart(8192);
+    writeMeshFragment(corruptPart);
+    auto*   corruptRoot = reinterpret_cast<RootHeader*>(corruptPart.data());
+    int64_t farAway = int64_t(1) << 40;
+    std::memcpy(static_cast<void*>(corruptRoot->headers.data()), &farAway, sizeof(farAway));
+    std::vector<std::span<const std::byte>> outside{bytes(corruptPart)};
+    EXPECT_THROW(planLink(outside), link_error);
+
+    // Relocation addend past the end of the target's fragment
+    linear_memory_resource<> farScenePart(8192);
+    writeSceneFragment(farScenePart, MeshHeader::HeaderIdentifier, meshPart.size());
+    std::vector<std::span<const std::byte>> farAddend{bytes(farScenePart), bytes(meshPart)};
+    EXPECT_THROW(planLink(farAddend), link_error);
+}
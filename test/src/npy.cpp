@@ -0,0 +1,170 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/header.hpp>
+#include <decodeless/npy.hpp>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <sstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace decodeless;
+
+TEST(Npy, Dtype) {
+    EXPECT_EQ(npy::dtype<uint8_t>(), "|u1");
+    EXPECT_EQ(npy::dtype<bool>(), "|b1");
+    if constexpr (std::endian::native == std::endian::little) {
+        EXPECT_EQ(npy::dtype<int32_t>(), "<i4");
+        EXPECT_EQ(npy::dtype<uint16_t>(), "<u2");
+        EXPECT_EQ(npy::dtype<double>(), "<f8");
+    }
+}
+
+TEST(Npy, Header) {
+    const size_t shape[] = {3, 4};
+    std::string  header = npy::header<float>(shape);
+    EXPECT_EQ(header.size() % 64, 0);
+    EXPECT_EQ(header.substr(0, 6), npy::MagicString);
+    EXPECT_EQ(header.back(), '\n');
+
+    std::istringstream in(header);
+    npy::Info          info = npy::readHeader(in);
+    EXPECT_EQ(info.descr, npy::dtype<float>());
+    EXPECT_FALSE(info.fortranOrder);
+    EXPECT_EQ(info.shape, (std::vector<size_t>{3, 4}));
+    EXPECT_EQ(info.count(), 12);
+    EXPECT_EQ(info.dataOffset, header.size());
+}
+
+TEST(Npy, PageAlignedHeader) {
+    const size_t shape[] = {10};
+    std::string  header = npy::header<int>(shape, 4096);
+    EXPECT_EQ(header.size(), 4096);
+    std::istringstream in(header);
+    EXPECT_EQ(npy::readHeader(in).dataOffset, 4096);
+}
+
+TEST(Npy, ParseNumpyOutput) {
+    // As written by numpy.save() for a scalar and a 1D array
+    npy::Info scalar =
+        npy::parseHeader("{'descr': '<f8', 'fortran_order': False, 'shape': (), }", 128);
+    EXPECT_TRUE(scalar.shape.empty());
+    EXPECT_EQ(scalar.count(), 1);
+    npy::Info array =
+        npy::parseHeader("{'descr': '|u1', 'fortran_order': True, 'shape': (1000,), }", 128);
+    EXPECT_EQ(array.descr, "|u1");
+    EXPECT_TRUE(array.fortranOrder);
+    EXPECT_EQ(array.shape, std::vector<size_t>{1000});
+    EXPECT_THROW(npy::parseHeader("{'descr': '<f8', 'shape': (), }", 128), npy::format_error);
+}
+
+TEST(Npy, RoundTrip) {
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), -500);
+    std::stringstream file;
+    npy::write(file, std::span<const int>(values));
+
+    struct ColumnHeader : Header {
+        offset_span<int> column;
+    };
+    linear_memory_resource<> memory(8192);
+    auto* header = new (memory.allocate(sizeof(ColumnHeader), alignof(ColumnHeader))) ColumnHeader;
+    header->column = npy::read<int>(file, memory, 4096);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(header->column.data()) % 4096, 0);
+    ASSERT_EQ(header->column.size(), values.size());
+    EXPECT_TRUE(std::equal(values.begin(), values.end(), header->column.begin()));
+
+    // Write the column back out and compare
+    std::stringstream copy;
+    npy::write(copy, std::span<const int>(header->column.data(), header->column.size()));
+    file.seekg(0);
+    EXPECT_EQ(copy.str(), file.str());
+}
+
+TEST(Npy, Errors) {
+    std::vector<float> values(10);
+    std::stringstream  file;
+    npy::write(file, std::span<const float>(values));
+
+    linear_memory_resource<> memory(4096);
+    EXPECT_THROW(npy::read<int>(file, memory), npy::format_error);
+    EXPECT_EQ(memory.size(), 0); // rejected before allocating
+
+    std::istringstream truncated(file.str().substr(0, file.str().size() - 1));
+    EXPECT_THROW(npy::read<float>(truncated, memory), npy::format_error);
+
+    std::istringstream notNpy("hello world");
+    EXPECT_THROW(npy::readHeader(notNpy), npy::format_error);
+
+    // v2 length fields allow up to 4 GiB, but even a valid long header is
+    // rejected before allocating
+    std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': (0,), }";
+    dict.resize(npy::MaxHeaderLength + 1, ' ');
+    dict.back() = '\n';
+    std::string longHeader("\x93NUMPY\x02\x00", 8);
+    for (size_t i = 0; i < 4; ++i)
+        longHeader += char((dict.size() >> (i * 8)) & 0xff);
+    std::istringstream oversized(longHeader + dict);
+    EXPECT_THROW(npy::readHeader(oversized), npy::format_error);
+
+    EXPECT_THROW(npy::parseHeader("{'descr': '<f4', 'fortran_order': False, "
+                                  "'shape': (99999999999999999999999,), }",
+                                  0),
+                 npy::format_error);
+    EXPECT_THROW(npy::parseHeader("{'descr': '<f4', 'fortran_order': False, "
+                                  "'shape': (4294967296, 4294967296), }",
+                                  0),
+                 npy::format_error);
+    npy::Info large = npy::parseHeader("{'descr': '<f4', 'fortran_order': False, "
+                                       "'shape': (4611686018427387904,), }",
+                                       0);
+    std::istringstream payload;
+    EXPECT_THROW(npy::readData(payload, large, std::span<float>()), npy::format_error);
+
+    const size_t shape[] = {3, 3};
+    EXPECT_THROW(npy::write(file, std::span<const float>(values), shape), std::invalid_argument);
+    EXPECT_THROW(npy::write(file, std::span<const float>(values), 0), std::invalid_argument);
+}
+
+#if !defined(_WIN32)
+TEST(Npy, CopyData) {
+    std::filesystem::path npyPath = std::filesystem::temp_directory_path() / "decodeless_npy.npy";
+    std::filesystem::path outPath = std::filesystem::temp_directory_path() / "decodeless_npy.bin";
+    std::vector<uint32_t> values(3000);
+    std::iota(values.begin(), values.end(), 7u);
+    {
+        std::ofstream file(npyPath, std::ios::binary);
+        npy::write(file, std::span<const uint32_t>(values), 4096);
+    }
+    npy::Info info;
+    {
+        std::ifstream file(npyPath, std::ios::binary);
+        info = npy::readHeader(file);
+    }
+    int in = ::open(npyPath.c_str(), O_RDONLY);
+    int out = ::open(outPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(in, -1);
+    ASSERT_NE(out, -1);
+    EXPECT_EQ(npy::copyData<uint32_t>(in, info, out, 4096), values.size() * sizeof(uint32_t));
+    EXPECT_THROW(npy::copyData<float>(in, info, out, 4096), npy::format_error);
+
+    std::vector<uint32_t> copied(values.size());
+    EXPECT_EQ(::pread(out, copied.data(), copied.size() * sizeof(uint32_t), 4096),
+              ssize_t(copied.size() * sizeof(uint32_t)));
+    EXPECT_EQ(copied, values);
+
+    // A payload cut short by the end of the file
+    std::filesystem::resize_file(npyPath, info.dataOffset + 100);
+    EXPECT_THROW(npy::copyData<uint32_t>(in, info, out, 0), npy::format_error);
+    ::close(in);
+    ::close(out);
+    std::filesystem::remove(npyPath);
+    std::filesystem::remove(outPath);
+}
+#endif
@@ -0,0 +1,87 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header.hpp>
+#include <decodeless/pgm_index.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using namespace decodeless;
+
+struct PgmKeysHeader : Header {
+    static constexpr Magic HeaderIdentifier{"PGMKEYS"};
+    offset_span<uint64_t>  keys;
+    PgmIndex               index;
+};
+
+static void checkPgm(std::vector<uint64_t> keys, size_t epsilon, uint32_t seed) {
+    std::ranges::sort(keys);
+    linear_memory_resource<> memory(keys.size() * 40 + 4096);
+    auto*                    header = create::object<PgmKeysHeader>(memory);
+    header->keys = create::array(memory, keys);
+    buildPgmIndex(header->index, memory,
+                  std::span<const uint64_t>(header->keys.data(), header->keys.size()), epsilon);
+
+    const PgmIndex& index = header->index;
+    EXPECT_EQ(index.keys.size(), keys.size());
+    EXPECT_EQ(index.levels.back(), index.segments.size());
+    auto check = [&](uint64_t key) {
+        size_t expected = std::ranges::lower_bound(keys, key) - keys.begin();
+        ASSERT_EQ(index.lower_bound(key), expected) << "key " << key;
+        size_t expectedUpper = std::ranges::upper_bound(keys, key) - keys.begin();
+        ASSERT_EQ(index.upper_bound(key), expectedUpper) << "key " << key;
+    };
+    for (uint64_t key : keys) {
+        check(key);
+        check(key - 1);
+        check(key + 1);
+    }
+    std::mt19937_64 rng(seed);
+    for (int i = 0; i < 10000; ++i)
+        check(rng() >> (rng() % 64));
+    check(0);
+    check(std::numeric_limits<uint64_t>::max());
+}
+
+TEST(PgmIndex, Empty) { checkPgm({}, 8, 0); }
+TEST(PgmIndex, Single) { checkPgm({42}, 8, 1); }
+
+TEST(PgmIndex, Random) {
+    for (size_t epsilon : {1, 4, 64}) {
+        for (size_t size : {2, 100, 5000, 100000}) {
+            std::mt19937_64       rng(size);
+            std::vector<uint64_t> keys(size);
+            for (uint64_t& key : keys)
+                key = rng() >> 20;
+            checkPgm(keys, epsilon, uint32_t(size));
+        }
+    }
+}
+
+TEST(PgmIndex, Duplicates) {
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 3000; ++i)
+        keys.push_back(i / 100);
+    checkPgm(keys, 2, 3);
+}
+
+TEST(PgmIndex, FullRange) {
+    std::vector<uint64_t> keys{0, 1, 2, std::numeric_limits<uint64_t>::max() - 1,
+                               std::numeric_limits<uint64_t>::max()};
+    checkPgm(keys, 1, 4);
+}
+
+TEST(PgmIndex, LinearKeysCompress) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 0; i < 100000; ++i)
+        values.push_back(i * 7 + 3);
+    linear_memory_resource<> memory(1 << 16);
+    PgmIndex                 index;
+    buildPgmIndex(index, memory, std::span<const uint64_t>(values), 16);
+    EXPECT_EQ(index.segments.size(), 1u);
+    EXPECT_EQ(index.range(10, 24), (std::pair<size_t, size_t>(1, 3)));
+    EXPECT_TRUE(index.contains(699996));
+    EXPECT_FALSE(index.contains(699997));
+}
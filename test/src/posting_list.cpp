@@ -0,0 +1,101 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header.hpp>
+#include <decodeless/posting_list.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace decodeless;
+
+struct PostingsHeader : Header {
+    static constexpr Magic HeaderIdentifier{"POSTINGS"};
+    PostingList            a;
+    PostingList            b;
+};
+
+static std::vector<uint32_t> randomPostings(size_t count, uint32_t range, uint32_t seed) {
+    std::mt19937       rng(seed);
+    std::set<uint32_t> values;
+    while (values.size() < count)
+        values.insert(rng() % range);
+    return {values.begin(), values.end()};
+}
+
+TEST(PostingList, RoundTrip) {
+    for (size_t size : {0, 1, 127, 128, 129, 10000}) {
+        std::vector<uint32_t>    values = randomPostings(size, 1000000, uint32_t(size));
+        linear_memory_resource<> memory(1 << 20);
+        PostingList              list;
+        buildPostingList(list, memory, std::span<const uint32_t>(values));
+        EXPECT_EQ(list.decode(), values);
+
+        std::vector<uint32_t> iterated;
+        for (PostingList::cursor c(list); c.valid(); c.next()) {
+            EXPECT_EQ(c.index(), iterated.size());
+            iterated.push_back(c.value());
+        }
+        EXPECT_EQ(iterated, values);
+    }
+}
+
+TEST(PostingList, Compresses) {
+    std::vector<uint32_t>    values = randomPostings(100000, 2000000, 1);
+    linear_memory_resource<> memory(1 << 20);
+    PostingList              list;
+    buildPostingList(list, memory, std::span<const uint32_t>(values));
+    size_t bytes = list.words.size() * 8 + list.blocks.size() * sizeof(PostingBlock);
+    EXPECT_LT(bytes * 3, values.size() * sizeof(uint32_t));
+}
+
+TEST(PostingList, AdvanceTo) {
+    std::vector<uint32_t>    values = randomPostings(5000, 100000, 2);
+    linear_memory_resource<> memory(1 << 20);
+    PostingList              list;
+    buildPostingList(list, memory, std::span<const uint32_t>(values));
+
+    std::mt19937 rng(3);
+    for (int i = 0; i < 200; ++i) {
+        PostingList::cursor c(list);
+        uint32_t            target = 0;
+        while (c.valid()) {
+            target += rng() % 3000;
+            c.advanceTo(target);
+            auto expected = std::ranges::lower_bound(values, target);
+            if (expected == values.end()) {
+                EXPECT_FALSE(c.valid());
+                break;
+            }
+            ASSERT_TRUE(c.valid());
+            ASSERT_EQ(c.value(), *expected);
+            ASSERT_EQ(c.index(), uint64_t(expected - values.begin()));
+        }
+    }
+    EXPECT_TRUE(list.contains(values[1234]));
+    EXPECT_FALSE(list.contains(values.back() + 1));
+}
+
+TEST(PostingList, Intersect) {
+    std::vector<uint32_t>    a = randomPostings(20000, 200000, 4);
+    std::vector<uint32_t>    b = randomPostings(300, 200000, 5);
+    linear_memory_resource<> memory(1 << 20);
+    auto*                    header = create::object<PostingsHeader>(memory);
+    buildPostingList(header->a, memory, std::span<const uint32_t>(a));
+    buildPostingList(header->b, memory, std::span<const uint32_t>(b));
+
+    std::vector<uint32_t> expected;
+    std::ranges::set_intersection(a, b, std::back_inserter(expected));
+    EXPECT_EQ(intersect(header->a, header->b), expected);
+    EXPECT_EQ(intersect(header->b, header->a), expected);
+}
+
+TEST(PostingList, Unsorted) {
+    std::vector<uint32_t>    values{1, 5, 3};
+    linear_memory_resource<> memory(4096);
+    PostingList              list;
+    EXPECT_THROW(buildPostingList(list, memory, std::span<const uint32_t>(values)),
+                 std::invalid_argument);
+}
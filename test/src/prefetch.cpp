@@ -0,0 +1,96 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/header.hpp>
+#include <decodeless/prefetch.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <vector>
+
+using namespace decodeless;
+
+struct PointerTable {
+    PointerTable() {
+        for (int i = 0; i < 1000; ++i) {
+            values[i] = i;
+            pointers[i] = &values[(i * 7919) % 1000];
+        }
+    }
+    offset_span<offset_ptr<int>> span() { return offset_span<offset_ptr<int>>(pointers); }
+    int                          values[1000];
+    offset_ptr<int>              pointers[1000];
+};
+
+TEST(Prefetch, Iterator) {
+    PointerTable        table;
+    prefetch_range<int> range(table.span());
+    EXPECT_EQ(range.size(), 1000);
+    EXPECT_EQ(std::accumulate(range.begin(), range.end(), 0), 999 * 1000 / 2);
+
+    size_t i = 0;
+    for (int& value : range)
+        EXPECT_EQ(&value, table.pointers[i++].get());
+    EXPECT_EQ(i, 1000);
+}
+
+TEST(Prefetch, Empty) {
+    offset_span<offset_ptr<int>> pointers;
+    prefetch_for_each(pointers, [](int&) { FAIL(); });
+    EXPECT_EQ(prefetch_find_if(pointers, [](int&) { return true; }), pointers.end());
+}
+
+TEST(Prefetch, Algorithms) {
+    PointerTable table;
+    int          sum = 0;
+    prefetch_for_each(table.span(), [&sum](int& value) { sum += value; });
+    EXPECT_EQ(sum, 999 * 1000 / 2);
+
+    std::vector<int> doubled;
+    prefetch_transform<2>(table.span(), std::back_inserter(doubled),
+                          [](int& value) { return value * 2; });
+    ASSERT_EQ(doubled.size(), 1000);
+    EXPECT_EQ(doubled[1], *table.pointers[1] * 2);
+
+    auto found = prefetch_find_if(table.span(), [](int& value) { return value == 42; });
+    ASSERT_NE(found, table.span().end());
+    EXPECT_EQ(**found, 42);
+    EXPECT_EQ(prefetch_find_if(table.span(), [](int& value) { return value < 0; }),
+              table.span().end());
+}
+
+TEST(Prefetch, SortedGather) {
+    PointerTable        table;
+    std::vector<size_t> visits(1000, 0);
+    const int*          previous = nullptr;
+    size_t              count = 0;
+    sorted_gather(
+        table.span(),
+        [&](size_t index, int& value) {
+            EXPECT_EQ(&value, table.pointers[index].get());
+            if (count++ % 100 != 0) {
+                EXPECT_LT(previous, &value);
+            }
+            previous = &value;
+            ++visits[index];
+        },
+        100);
+    EXPECT_TRUE(std::ranges::all_of(visits, [](size_t v) { return v == 1; }));
+}
+
+TEST(Prefetch, Headers) {
+    struct File {
+        File()
+            : rootHeader("test") {}
+        RootHeader         rootHeader;
+        Header             subHeaders[3];
+        offset_ptr<Header> headers[3];
+    };
+    File file;
+    for (size_t i = 0; i < 3; ++i) {
+        file.subHeaders[i].identifier[0] = char('a' + i);
+        file.headers[i] = &file.subHeaders[i];
+    }
+    file.rootHeader.headers = file.headers;
+    auto found = prefetch_find_if(file.rootHeader.headers,
+                                  [](const Header& h) { return h.identifier[0] == 'b'; });
+    EXPECT_EQ(found->get(), &file.subHeaders[1]);
+}
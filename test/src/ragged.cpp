@@ -0,0 +1,66 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header.hpp>
+#include <decodeless/ragged.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace decodeless;
+
+struct NamesHeader : Header {
+    static constexpr Magic      HeaderIdentifier{"NAMES"};
+    RaggedArray<char, uint32_t> names;
+    RaggedArray<float>          polylines;
+};
+
+TEST(RaggedArray, Strings) {
+    std::vector<std::string> names{"alpha", "", "gamma", "delta epsilon"};
+    linear_memory_resource<> memory(4096);
+    auto*                    header = create::object<NamesHeader>(memory);
+    buildRaggedArray(header->names, memory, names);
+
+    const RaggedArray<char, uint32_t>& array = header->names;
+    ASSERT_EQ(array.size(), names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+        EXPECT_EQ(std::string_view(array[i].data(), array[i].size()), names[i]);
+    EXPECT_EQ(array.data.size(), 23u);
+}
+
+TEST(RaggedArray, ParallelGenerated) {
+    const size_t             count = 100000;
+    linear_memory_resource<> memory(16 << 20);
+    RaggedArray<float>       serial, parallel;
+    auto length = [](size_t i) { return (i * 7919) % 13; };
+    auto fill = [](size_t i, std::span<float> out) {
+        for (size_t j = 0; j < out.size(); ++j)
+            out[j] = float(i) + float(j) / 16.0f;
+    };
+    buildRaggedArray(serial, memory, count, length, fill, 1);
+    buildRaggedArray(parallel, memory, count, length, fill, 8);
+    ASSERT_TRUE(std::ranges::equal(serial.offsets, parallel.offsets));
+    ASSERT_TRUE(std::ranges::equal(serial.data, parallel.data));
+
+    size_t visited = 0;
+    parallel.forEach([&](size_t i, std::span<const float> record) {
+        ASSERT_EQ(record.size(), length(i));
+        if (!record.empty()) {
+            ASSERT_EQ(record.front(), float(i));
+        }
+        ++visited;
+    });
+    EXPECT_EQ(visited, count);
+    EXPECT_EQ(parallel[12345].size(), length(12345));
+}
+
+TEST(RaggedArray, Empty) {
+    linear_memory_resource<> memory(4096);
+    RaggedArray<int>         array;
+    buildRaggedArray(array, memory, std::vector<std::vector<int>>{});
+    EXPECT_TRUE(array.empty());
+    EXPECT_EQ(array.offsets.size(), 1u);
+}
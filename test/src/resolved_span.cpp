@@ -0,0 +1,53 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/header.hpp>
+#include <decodeless/resolved_span.hpp>
+#include <gtest/gtest.h>
+
+using namespace decodeless;
+
+TEST(ResolvedSpan, Empty) {
+    offset_span<offset_ptr<int>> pointers;
+    resolved_span<int>           resolved(pointers);
+    EXPECT_TRUE(resolved.empty());
+    EXPECT_EQ(resolved.begin(), resolved.end());
+}
+
+TEST(ResolvedSpan, Pointers) {
+    struct File {
+        int             values[100];
+        offset_ptr<int> pointers[100];
+    };
+    File file;
+    for (int i = 0; i < 100; ++i) {
+        file.values[i] = i;
+        file.pointers[i] = i % 10 == 0 ? nullptr : &file.values[99 - i];
+    }
+    offset_span<offset_ptr<int>> pointers(file.pointers);
+    resolved_span<int>           resolved(pointers);
+    ASSERT_EQ(resolved.size(), 100);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(resolved[i], file.pointers[i].get());
+    }
+    EXPECT_EQ(resolved[0], nullptr);
+    EXPECT_EQ(*resolved[1], 98);
+}
+
+TEST(ResolvedSpan, RootHeaders) {
+    struct File {
+        File()
+            : rootHeader("test") {}
+        RootHeader         rootHeader;
+        Header             exts[3];
+        offset_ptr<Header> headers[3];
+    };
+    File file;
+    for (size_t i = 0; i < 3; ++i)
+        file.headers[i] = &file.exts[i];
+    file.rootHeader.headers = file.headers;
+
+    resolved_span<Header> headers(file.rootHeader.headers);
+    EXPECT_EQ(headers.size(), 3);
+    EXPECT_EQ(headers[0], &file.exts[0]);
+    EXPECT_EQ(headers[2], &file.exts[2]);
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <atomic>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/segment_log.hpp>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace decodeless;
+
+struct Event {
+    uint32_t source;
+    float    value;
+};
+
+using EventLog = SegmentLog<Event>;
+using EventLogWriter = segment_log_writer<Event, linear_memory_resource<>>;
+
+struct LogRootHeader : RootHeader {
+    LogRootHeader()
+        : RootHeader("DECODELESS-LOG") {}
+};
+
+TEST(SegmentLog, SingleWriter) {
+    linear_memory_resource<> memory(1 << 20);
+    auto*                    root = create::object<LogRootHeader>(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    auto* log = create::object<EventLog>(memory);
+    root->headers[0] = log;
+
+    EventLogWriter writer(*log, memory, 16, 100);
+    {
+        EventLogWriter::appender appender(writer);
+        for (uint32_t i = 0; i < 250; ++i)
+            appender.append(i * 10, Event{0, float(i)});
+
+        // Two full segments are visible while the third is still open
+        const EventLog* found = root->findSupported<EventLog>();
+        ASSERT_NE(found, nullptr);
+        EXPECT_EQ(found->sealed().size(), 2);
+    }
+    ASSERT_EQ(log->sealed().size(), 3);
+    EXPECT_EQ(log->sealed()[2]->size, 50);
+    EXPECT_EQ(log->sealed()[1]->minTimestamp, 1000);
+    EXPECT_EQ(log->sealed()[1]->maxTimestamp, 1990);
+
+    std::vector<uint64_t> timestamps;
+    log->forEach(995, 1025, [&](uint64_t timestamp, const Event& event) {
+        EXPECT_EQ(event.value, float(timestamp / 10));
+        timestamps.push_back(timestamp);
+    });
+    EXPECT_EQ(timestamps, (std::vector<uint64_t>{1000, 1010, 1020}));
+}
+
+TEST(SegmentLog, Full) {
+    linear_memory_resource<> memory(1 << 16);
+    EventLog                 log;
+    EventLogWriter           writer(log, memory, 2, 10);
+    EventLogWriter::appender appender(writer);
+    for (uint32_t i = 0; i < 20; ++i)
+        appender.append(i, Event{});
+    EXPECT_THROW(appender.append(20, Event{}), std::length_error);
+}
+
+TEST(SegmentLog, ZeroCapacity) {
+    linear_memory_resource<> memory(1 << 16);
+    EventLog                 log;
+    EXPECT_THROW(EventLogWriter(log, memory, 2, 0), std::invalid_argument);
+    EXPECT_EQ(memory.size(), 0); // rejected before allocating
+}
+
+TEST(SegmentLog, ConcurrentWritersAndReader) {
+    constexpr uint32_t       threads = 4;
+    constexpr uint32_t       eventsPerThread = 10000;
+    linear_memory_resource<> memory(4 << 20);
+    EventLog                 log;
+    EventLogWriter           writer(log, memory, 1024, 256);
+
+    std::atomic<bool> done = false;
+    std::jthread      reader([&] {
+        // Sealed segments are complete and immutable whenever observed
+        while (!done) {
+            for (const offset_ptr<LogSegment<Event>>& segment : log.sealed()) {
+                ASSERT_GT(segment->size, 0);
+                ASSERT_EQ(segment->validTimestamps().back(), segment->maxTimestamp);
+            }
+        }
+    });
+    {
+        std::vector<std::jthread> writers;
+        for (uint32_t t = 0; t < threads; ++t) {
+            writers.emplace_back([&writer, t] {
+                EventLogWriter::appender appender(writer);
+                for (uint32_t i = 0; i < eventsPerThread; ++i)
+                    appender.append(i, Event{t, float(i)});
+            });
+        }
+    }
+    done = true;
+    reader.join();
+
+    std::vector<uint32_t> counts(threads, 0);
+    log.forEach(0, eventsPerThread, [&](uint64_t timestamp, const Event& event) {
+        EXPECT_EQ(event.value, float(timestamp));
+        ++counts[event.source];
+    });
+    for (uint32_t count : counts)
+        EXPECT_EQ(count, eventsPerThread);
+}
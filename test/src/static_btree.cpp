@@ -0,0 +1,78 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/header.hpp>
+#include <decodeless/static_btree.hpp>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+using namespace decodeless;
+
+struct KeysHeader : Header {
+    static constexpr Magic HeaderIdentifier{"KEYS"};
+    offset_span<uint64_t>  keys;
+    StaticBTree            index;
+};
+
+static void checkBTree(std::vector<uint64_t> keys, uint32_t seed) {
+    std::ranges::sort(keys);
+    linear_memory_resource<> memory(keys.size() * 16 + 4096);
+    auto*                    header = create::object<KeysHeader>(memory);
+    header->keys = create::array(memory, keys);
+    buildStaticBTree(header->index, memory,
+                     std::span<const uint64_t>(header->keys.data(), header->keys.size()));
+
+    const StaticBTree& index = header->index;
+    EXPECT_EQ(index.keys.size(), keys.size());
+    auto check = [&](uint64_t key) {
+        size_t expected = std::ranges::lower_bound(keys, key) - keys.begin();
+        ASSERT_EQ(index.lower_bound(key), expected) << "key " << key;
+        size_t expectedUpper = std::ranges::upper_bound(keys, key) - keys.begin();
+        ASSERT_EQ(index.upper_bound(key), expectedUpper) << "key " << key;
+    };
+    for (uint64_t key : keys) {
+        check(key);
+        check(key - 1);
+        check(key + 1);
+    }
+    std::mt19937_64 rng(seed);
+    for (int i = 0; i < 10000; ++i)
+        check(rng() >> (rng() % 64));
+    check(0);
+    check(std::numeric_limits<uint64_t>::max());
+}
+
+TEST(StaticBTree, Empty) { checkBTree({}, 0); }
+TEST(StaticBTree, OneLeaf) { checkBTree({1, 5, 9}, 1); }
+
+TEST(StaticBTree, Random) {
+    for (size_t size : {8, 9, 72, 73, 577, 5000, 100000}) {
+        std::mt19937_64       rng(size);
+        std::vector<uint64_t> keys(size);
+        for (uint64_t& key : keys)
+            key = rng() >> 20;
+        checkBTree(keys, uint32_t(size));
+    }
+}
+
+TEST(StaticBTree, Duplicates) {
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 3000; ++i)
+        keys.push_back(i / 100);
+    checkBTree(keys, 3);
+}
+
+TEST(StaticBTree, Range) {
+    std::vector<uint64_t> values;
+    for (uint64_t i = 0; i < 1000; ++i)
+        values.push_back(i * 2);
+    linear_memory_resource<> memory(1 << 16);
+    StaticBTree              index;
+    buildStaticBTree(index, memory, std::span<const uint64_t>(values));
+    EXPECT_EQ(index.range(10, 20), (std::pair<size_t, size_t>(5, 10)));
+    EXPECT_EQ(index.range(11, 11), (std::pair<size_t, size_t>(6, 6)));
+    EXPECT_TRUE(index.contains(1998));
+    EXPECT_FALSE(index.contains(1999));
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#include "test_headers.hpp"
+#include <cstdint>
+#include <cstring>
+#include <decodeless/allocator.hpp>
+#include <decodeless/allocator_construction.hpp>
+#include <decodeless/streaming.hpp>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <span>
+#include <sstream>
+
+using namespace decodeless;
+
+struct StreamRootHeader : RootHeader {
+    StreamRootHeader()
+        : RootHeader("DECODELESS-TEST") {}
+};
+
+// Writes headers in reverse identifier order so file order differs from the
+// sorted header list
+static std::string writeStreamingFile(linear_memory_resource<>& memory) {
+    streaming_writer<StreamRootHeader, linear_memory_resource<>> writer(memory, 3);
+    auto* c = writer.create<DataHeader<"streamc">>();
+    c->data = create::array<int>(writer.memory(), 1000);
+    std::iota(c->data.begin(), c->data.end(), 0);
+    auto* b = writer.create<DataHeader<"streamb">>();
+    b->data = create::array<int>(writer.memory(), 10);
+    std::ranges::fill(b->data, 42);
+    auto* a = writer.create<DataHeader<"streama">>();
+    a->data = create::array<int>(writer.memory(), 3);
+    std::ranges::fill(a->data, 7);
+    writer.finish();
+    return std::string(reinterpret_cast<const char*>(memory.data()), memory.size());
+}
+
+TEST(Streaming, RandomAccess) {
+    linear_memory_resource<> memory(8192);
+    writeStreamingFile(memory);
+    auto* root = reinterpret_cast<RootHeader*>(memory.data());
+    EXPECT_TRUE(root->binaryCompatible());
+    ASSERT_NE(root->find<DataHeader<"streamb">>(), nullptr);
+    EXPECT_EQ(root->find<DataHeader<"streamb">>()->data[9], 42);
+}
+
+TEST(Streaming, Reader) {
+    linear_memory_resource<> memory(8192);
+    std::istringstream       pipe(writeStreamingFile(memory));
+    streaming_reader         reader(pipe);
+    EXPECT_EQ(reader.root().headers.size(), 3);
+
+    // Headers come back in file order
+    const Header* header = reader.next();
+    ASSERT_NE(header, nullptr);
+    EXPECT_EQ(header->identifier, DataHeader<"streamc">::HeaderIdentifier);
+    auto* c = static_cast<const DataHeader<"streamc">*>(header);
+    ASSERT_EQ(c->data.size(), 1000);
+    EXPECT_EQ(c->data[999], 999);
+    EXPECT_GE(reader.extent().size(), sizeof(*c) + 1000 * sizeof(int));
+
+    header = reader.next();
+    ASSERT_NE(header, nullptr);
+    EXPECT_EQ(header->identifier, DataHeader<"streamb">::HeaderIdentifier);
+    EXPECT_EQ(static_cast<const DataHeader<"streamb">*>(header)->data[0], 42);
+
+    header = reader.next();
+    ASSERT_NE(header, nullptr);
+    EXPECT_EQ(header->identifier, DataHeader<"streama">::HeaderIdentifier);
+    EXPECT_EQ(static_cast<const DataHeader<"streama">*>(header)->data[2], 7);
+
+    EXPECT_EQ(reader.next(), nullptr);
+}
+
+TEST(Streaming, Bounded) {
+    linear_memory_resource<> memory(8192);
+    std::istringstream       pipe(writeStreamingFile(memory));
+    streaming_reader         reader(pipe, 1024);
+    EXPECT_THROW(reader.next(), streaming_error);
+
+    linear_memory_resource<> other(8192);
+    std::istringstream       tooSmall(writeStreamingFile(other));
+    EXPECT_THROW(streaming_reader(tooSmall, sizeof(RootHeader) - 1), std::invalid_argument);
+}
+
+TEST(Streaming, NotForward) {
+    // Header list allocated after the sub-header it points to
+    linear_memory_resource<> memory(4096);
+    auto* root = create::object<StreamRootHeader>(memory);
+    auto* header = create::object<DataHeader<"streama">>(memory);
+    root->headers = create::array<offset_ptr<Header>>(memory, 1);
+    root->headers[0] = header;
+    std::istringstream pipe(std::string(reinterpret_cast<const char*>(memory.data()),
+                                        memory.size()));
+    EXPECT_THROW(streaming_reader{pipe}, streaming_error);
+}
+
+TEST(Streaming, CorruptHeaderCount) {
+    // A header count large enough that the end of the list wraps around to
+    // just before its start, which is still past the root header
+    linear_memory_resource<> memory(4096);
+    auto* root = create::object<StreamRootHeader>(memory);
+    auto  list = create::array<offset_ptr<Header>>(memory, 2);
+    list[1] = create::object<DataHeader<"streama">>(memory);
+    root->headers = std::span(&list[1], 1);
+
+    // Written raw, as constructing a std::span of that size is itself invalid
+    size_t count = SIZE_MAX / sizeof(offset_ptr<Header>);
+    static_assert(sizeof(root->headers) == sizeof(offset_ptr<Header>) + sizeof(count));
+    std::memcpy(reinterpret_cast<std::byte*>(&root->headers) + sizeof(offset_ptr<Header>), &count,
+                sizeof(count));
+    ASSERT_EQ(root->headers.size(), count);
+    std::istringstream pipe(std::string(reinterpret_cast<const char*>(memory.data()),
+                                        memory.size()));
+    EXPECT_THROW(streaming_reader{pipe}, streaming_error);
+}
+
+TEST(Streaming, Incompatible) {
+    linear_memory_resource<> memory(8192);
+    writeStreamingFile(memory);
+    reinterpret_cast<RootHeader*>(memory.data())->decodelessVersion.major = 999;
+    std::istringstream pipe(std::string(reinterpret_cast<const char*>(memory.data()),
+                                        memory.size()));
+    EXPECT_THROW(streaming_reader{pipe}, streaming_error);
+}
+
+TEST(Streaming, WriterCount) {
+    linear_memory_resource<>                                      memory(4096);
+    streaming_writer<StreamRootHeader, linear_memory_resource<>> writer(memory, 1);
+    EXPECT_THROW(writer.finish(), std::logic_error);
+    writer.create<DataHeader<"streama">>();
+    EXPECT_THROW(writer.create<DataHeader<"streamb">>(), std::length_error);
+}
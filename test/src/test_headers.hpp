@@ -0,0 +1,17 @@
+// Copyright (c) 2024 Pyarelal Knowles, MIT License
+
+#pragma once
+
+#include <decodeless/header.hpp>
+#include <decodeless/offset_span.hpp>
+
+// Sub-header with an int array payload. Each identifier is a distinct type,
+// for tests that need several sub-headers, e.g. DataHeader<"streama">.
+template <decodeless::Magic Id>
+struct DataHeader : decodeless::Header {
+    static constexpr decodeless::Magic   HeaderIdentifier = Id;
+    static constexpr decodeless::Version VersionSupported{1, 0, 0};
+    DataHeader()
+        : Header{.identifier = HeaderIdentifier, .version = VersionSupported, .gitHash = ""} {}
+    decodeless::offset_span<int> data;
+};